@@ -0,0 +1,192 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <new>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "btree.h"
+#include "benchutil.h"
+
+using namespace std;
+
+
+// Every heap allocation in the program is counted
+static unsigned long long allocations=0;
+
+void *operator new(size_t n)
+{
+  void *p=malloc(n ? n : 1);
+
+  if (!p) {
+    throw bad_alloc();
+  }
+  allocations++;
+  return p;
+}
+
+void *operator new[](size_t n)
+{
+  return operator new(n);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  free(p);
+}
+
+
+void usage()
+{
+  cerr << "usage: alloccheck filestem [lookups]\n";
+  cerr << "       builds btrees of 8 byte keys of growing height in each node format,\n";
+  cerr << "       on 256 byte blocks held entirely in the cache, and counts the heap\n";
+  cerr << "       allocations each lookup makes.  filestem is made and deleted for\n";
+  cerr << "       each tree.  lookups defaults to 1000.  Exits nonzero if a format\n";
+  cerr << "       makes more allocations per lookup in a taller tree.\n";
+}
+
+
+static void MakeKey(const unsigned long long k, KEY_T &key)
+{
+  key.Resize(8,false);
+  for (SIZE_T j=0;j<8;j++) {
+    key.data[j]=(BYTE_T)(k>>(56-8*j));
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<2 || argc>3) {
+    usage();
+    exit(-1);
+  }
+
+  string stem(argv[1]);
+  SIZE_T lookups = argc>=3 ? atoi(argv[2]) : 1000;
+  SIZE_T keysize=8, valuesize=8, blocksize=256, blockspertrack=16;
+  SIZE_T sizes[] = {10, 100, 1000, 10000, 50000};
+  bool ok=true;
+
+  if (lookups==0) {
+    usage();
+    exit(-1);
+  }
+
+  cout << "heap allocations per lookup\n";
+  cout << setw(7) << "format" << setw(7) << "keys" << setw(7) << "height" << setw(10) << "allocs" << "\n";
+
+  for (SIZE_T format=BTREE_FORMAT_V1;format<=BTREE_FORMAT_CURRENT;format++) {
+    double first=0;
+
+    for (SIZE_T s=0;s<sizeof(sizes)/sizeof(sizes[0]);s++) {
+      SIZE_T numkeys=sizes[s];
+      ERROR_T rc;
+      VALUE_T value;
+      SIZE_T height=0;
+      double perlookup;
+
+      // the keys are made before counting starts
+      vector<KEY_T> keys(numkeys);
+      for (SIZE_T i=0;i<numkeys;i++) {
+	MakeKey((i+1)*0x9e3779b97f4a7c15ull,keys[i]);
+      }
+
+      // room for the tree with its nodes a quarter full, since slotted
+      // nodes hold few keys in blocks this small, and then some
+      BLOCKNUM_T numblocks = 8*numkeys*(keysize+valuesize)/blocksize + 4*blockspertrack;
+      numblocks -= numblocks%blockspertrack;
+
+      deletedisk(stem);
+      {
+	DiskSystem disk(stem,true,0,numblocks,blocksize,1,blockspertrack,
+			numblocks/blockspertrack,1,1,1);
+	BufferCache cache(&disk,numblocks);
+	BTreeIndex btree(keysize,valuesize,&cache,true,format);
+
+	cache.Attach();
+	if ((rc=btree.Attach(0,true))) {
+	  cerr << "alloccheck: cannot make a btree, error "<<rc<<"\n";
+	  return -1;
+	}
+
+	value.Resize(valuesize,false);
+	for (SIZE_T i=0;i<numkeys;i++) {
+	  memcpy(value.data,&i,sizeof(i)<valuesize ? sizeof(i) : valuesize);
+	  if ((rc=btree.Insert(keys[i],value))) {
+	    cerr << "alloccheck: insert failed, error "<<rc<<"\n";
+	    return -1;
+	  }
+	}
+
+	// once through, so every node is in the cache and the value has
+	// reached its size
+	for (SIZE_T i=0;i<numkeys;i++) {
+	  if (btree.Lookup(keys[i],value)) {
+	    cerr << "alloccheck: lookup failed\n";
+	    return -1;
+	  }
+	}
+
+	unsigned long long start=allocations;
+	for (SIZE_T i=0;i<lookups;i++) {
+	  btree.Lookup(keys[(i*7919)%numkeys],value);
+	}
+	perlookup=(double)(allocations-start)/lookups;
+
+	BLOCKNUM_T superblock;
+	btree.Detach(superblock);
+
+	// the height is the length of the leftmost path
+	BTreeNode node;
+	BLOCKNUM_T ptr;
+	if ((rc=node.Unserialize(&cache,0))) {
+	  cerr << "alloccheck: cannot read the superblock, error "<<rc<<"\n";
+	  return -1;
+	}
+	for (ptr=node.info.rootnode; ; height++) {
+	  if ((rc=node.Unserialize(&cache,ptr))) {
+	    cerr << "alloccheck: cannot walk the btree, error "<<rc<<"\n";
+	    return -1;
+	  }
+	  if (node.info.nodetype==BTREE_LEAF_NODE) {
+	    height++;
+	    break;
+	  }
+	  node.GetPtr(0,ptr);
+	}
+	cache.Detach();
+      }
+      deletedisk(stem);
+
+      if (s==0) {
+	first=perlookup;
+      }
+      bool same = perlookup<=first;
+      cout << setw(7) << format << setw(7) << numkeys << setw(7) << height
+	   << fixed << setprecision(2) << setw(10) << perlookup
+	   << (same ? "" : "  MORE") << "\n";
+      ok = ok && same;
+    }
+  }
+
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <time.h>
+#include "benchutil.h"
+
+
+double cpunow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+
+void deletedisk(const string &stem)
+{
+  remove((stem+".data").c_str());
+  remove((stem+".bitmap").c_str());
+  remove((stem+".config").c_str());
+}
+
+
+ERROR_T WalkTree(BufferCache *cache, const BLOCKNUM_T block, const SIZE_T depth, TreeShape &shape)
+{
+  BTreeNode b;
+  BLOCKNUM_T ptr;
+  ERROR_T rc;
+
+  if ((rc=b.Unserialize(cache,block))) {
+    return rc;
+  }
+
+  if (depth>shape.height) {
+    shape.height=depth;
+  }
+
+  if (b.info.nodetype==BTREE_LEAF_NODE) {
+    shape.leaves++;
+    shape.leafslots+=b.GetNumSlots();
+    shape.leafkeys+=b.info.numkeys;
+    shape.leafcommon+=b.GetCommonPrefixLength();
+    return ERROR_NOERROR;
+  }
+
+  shape.interiors++;
+  shape.interiorslots+=b.GetNumSlots();
+  shape.interiorkeys+=b.info.numkeys;
+  for (SIZE_T i=0;i<=b.info.numkeys;i++) {
+    b.GetPtr(i,ptr);
+    if ((rc=WalkTree(cache,ptr,depth+1,shape))) {
+      return rc;
+    }
+  }
+  return ERROR_NOERROR;
+}
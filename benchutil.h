@@ -0,0 +1,32 @@
+#ifndef _benchutil
+#define _benchutil
+
+#include <string>
+#include "btree.h"
+
+using namespace std;
+
+//
+// What the benchmarks share
+//
+
+// CPU time in nanoseconds
+double cpunow();
+
+// Removes a disk the benchmark made
+void deletedisk(const string &stem);
+
+// The shape of a btree, totalled over its nodes
+struct TreeShape {
+  SIZE_T height;
+  SIZE_T leaves, leafslots, leafkeys, leafcommon;
+  SIZE_T interiors, interiorslots, interiorkeys;
+
+  TreeShape() : height(0), leaves(0), leafslots(0), leafkeys(0), leafcommon(0),
+		interiors(0), interiorslots(0), interiorkeys(0) {}
+};
+
+// Adds the subtree at block, which is depth levels down, to shape
+ERROR_T WalkTree(BufferCache *cache, const BLOCKNUM_T block, const SIZE_T depth, TreeShape &shape);
+
+#endif
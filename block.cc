@@ -2,19 +2,20 @@
 #include <string.h>
 
 #include "block.h"
+#include "keycompare.h"
 
-Block::Block() : data(0), length(0), lastaccessed(-1), dirty(false)
+Block::Block() : data(0), length(0), lastaccessed(-1), dirty(false), pins(0)
 {}
 
 
-Block::Block(const SIZE_T s) : data(0), length(0), lastaccessed(-1), dirty(false)
+Block::Block(const SIZE_T s) : data(0), length(0), lastaccessed(-1), dirty(false), pins(0)
 {
   Resize(s);
 }
 
 
 
-Block::Block(const Block &rhs) : data(0), length(0), lastaccessed(rhs.lastaccessed), dirty(rhs.dirty)
+Block::Block(const Block &rhs) : data(0), length(0), lastaccessed(rhs.lastaccessed), dirty(rhs.dirty), pins(0)
 {
   if (Resize(rhs.length)!=ERROR_NOERROR) { 
     throw GenericException();
@@ -22,7 +23,13 @@ Block::Block(const Block &rhs) : data(0), length(0), lastaccessed(rhs.lastaccess
   memcpy(data,rhs.data,rhs.length);
 }
 
-Block::Block(const char * str) : data(0), length(0), lastaccessed(-1), dirty(false)
+Block::Block(Block &&rhs) : data(rhs.data), length(rhs.length), lastaccessed(rhs.lastaccessed), dirty(rhs.dirty), pins(0)
+{
+  rhs.data=0;
+  rhs.length=0;
+}
+
+Block::Block(const char * str) : data(0), length(0), lastaccessed(-1), dirty(false), pins(0)
 {
   if (Resize(strlen(str))!=ERROR_NOERROR) { 
     throw GenericException();
@@ -40,7 +47,31 @@ Block::~Block()
 
 Block & Block::operator=(const Block &rhs)
 {
-  return *(new (this) Block(rhs));
+  if (this==&rhs) { 
+    return *this;
+  }
+  if (Resize(rhs.length,false)!=ERROR_NOERROR) { 
+    throw GenericException();
+  }
+  memcpy(data,rhs.data,rhs.length);
+  lastaccessed=rhs.lastaccessed;
+  dirty=rhs.dirty;
+  return *this;
+}
+
+Block & Block::operator=(Block &&rhs)
+{
+  if (this==&rhs) { 
+    return *this;
+  }
+  if (data) { delete [] data; }
+  data=rhs.data;
+  length=rhs.length;
+  lastaccessed=rhs.lastaccessed;
+  dirty=rhs.dirty;
+  rhs.data=0;
+  rhs.length=0;
+  return *this;
 }
 
 
@@ -50,6 +81,10 @@ Block & Block::operator=(const Block &rhs)
 ERROR_T Block::Resize(const SIZE_T newlen, const bool copy)
 {
   BYTE_T *d;
+
+  if (newlen==length && data) { 
+    return ERROR_NOERROR;
+  }
   
   try {
     d = new BYTE_T [newlen];
@@ -90,13 +125,13 @@ static char low2hex(BYTE_T x)
 
 bool Block::operator<(const Block &rhs) const
 {
-  return memcmp(data,rhs.data,MAX(length,rhs.length))<0;
+  return CompareKeyBytes(data,rhs.data,MAX(length,rhs.length))<0;
 }
 
 
 bool Block::operator==(const Block &rhs) const
 {
-  return memcmp(data,rhs.data,MAX(length,rhs.length))==0;
+  return CompareKeyBytes(data,rhs.data,MAX(length,rhs.length))==0;
 }
 
 ostream & Block::Print(ostream &os) const
@@ -12,16 +12,22 @@ struct Block {
   SIZE_T 	length;
   double        lastaccessed;  // for use in buffercache only
   bool          dirty;         // for use in buffercahce only
+  SIZE_T        pins;          // for use in buffercache only, belongs to the
+                               // frame and is not copied with the contents
 
   Block();
   Block(const SIZE_T size);
   Block(const Block &rhs);
+  Block(Block &&rhs);
   Block(const char *data);
   virtual ~Block();
+  // Copying into a block of the same length reuses its buffer
   Block & operator=(const Block &rhs);
+  Block & operator=(Block &&rhs);
 
   // returns one of ERROR_NOERROR (zero)
   // ERROR_NOMEM or other nonzero error code.
+  // Resizing to the current length keeps the buffer (and its contents).
   ERROR_T Resize(const SIZE_T newlength, const bool copy=true);
 
   bool operator<(const Block &rhs) const;
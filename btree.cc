@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 #include "btree.h"
 #include <vector>
 
@@ -17,27 +18,48 @@ KeyValuePair::KeyValuePair(const KeyValuePair &rhs) :
 {}
 
 
+KeyValuePair::KeyValuePair(KeyValuePair &&rhs) :
+  key(std::move(rhs.key)), value(std::move(rhs.value))
+{}
+
+
 KeyValuePair::~KeyValuePair()
 {}
 
 
 KeyValuePair & KeyValuePair::operator=(const KeyValuePair &rhs)
 {
-  return *( new (this) KeyValuePair(rhs));
+  key=rhs.key;
+  value=rhs.value;
+  return *this;
+}
+
+
+KeyValuePair & KeyValuePair::operator=(KeyValuePair &&rhs)
+{
+  key=std::move(rhs.key);
+  value=std::move(rhs.value);
+  return *this;
 }
 
 BTreeIndex::BTreeIndex(SIZE_T keysize,
 		       SIZE_T valuesize,
 		       BufferCache *cache,
-		       bool unique)
+		       bool unique,
+		       SIZE_T format,
+		       const KeyType &type)
 {
   superblock.info.keysize=keysize;
   superblock.info.valuesize=valuesize;
+  superblock.info.format=BTREE_FORMAT_MAGIC|format;
+  keytype=type;
+  if (keytype.IsTyped() && keysize==0) {
+    superblock.info.keysize=keytype.GetKeySize();
+  }
   buffercache=cache;
+  freemaphint=0;
+  freemapdirty=false;
   // note: ignoring unique now
-  SIZE_T blockSize = buffercache->GetBlockSize();
-  maxNumKeys = (blockSize - sizeof(NodeMetadata))/(16);
-
 }
 
 BTreeIndex::BTreeIndex()
@@ -54,6 +76,12 @@ BTreeIndex::BTreeIndex(const BTreeIndex &rhs)
   buffercache=rhs.buffercache;
   superblock_index=rhs.superblock_index;
   superblock=rhs.superblock;
+  keytype=rhs.keytype;
+  freemap=rhs.freemap;
+  freemapblocks=rhs.freemapblocks;
+  freelistmap=rhs.freelistmap;
+  freemaphint=rhs.freemaphint;
+  freemapdirty=rhs.freemapdirty;
 }
 
 BTreeIndex::~BTreeIndex()
@@ -68,55 +96,267 @@ BTreeIndex & BTreeIndex::operator=(const BTreeIndex &rhs)
 }
 
 
-ERROR_T BTreeIndex::AllocateNode(SIZE_T &n)
+ERROR_T BTreeIndex::AllocateNode(BLOCKNUM_T &n)
 {
-  n=superblock.info.freelist;
+  BLOCKNUM_T numblocks=buffercache->GetNumBlocks();
 
-  if (n==0) {
-    return ERROR_NOSPACE;
+  // Scan a word at a time for the first clear bit.  When the bitmap
+  // is full, it is extended past the high water mark by another word.
+  for (BLOCKNUM_T w=freemaphint; w*64<numblocks; w++) {
+    if (w==freemap.size()) {
+      freemap.push_back(0);
+    }
+    if (~freemap[w]) {
+      SIZE_T bit=__builtin_ctzll(~freemap[w]);
+      if (w*64+bit>=numblocks) {
+	break;
+      }
+      freemap[w] |= ((FREEMAP_WORD_T)1)<<bit;
+      freemaphint=w;
+      freemapdirty=true;
+      n=w*64+bit;
+      if (n>=superblock.info.highwater) {
+	superblock.info.highwater=n+1;
+      }
+      buffercache->NotifyAllocateBlock(n);
+      return ERROR_NOERROR;
+    }
   }
 
-  BTreeNode node;
+  // The word holding the last block may still have free bits past it
+  // that become usable if the disk grows
+  freemaphint=numblocks/64;
+  n=0;
+  return ERROR_NOSPACE;
+}
 
-  node.Unserialize(buffercache,n);
 
-  assert(node.info.nodetype==BTREE_UNALLOCATED_BLOCK);
+// Whether AllocateNode would succeed n more times.  It looks no
+// further than it has to, so from the hint this is usually one word.
+bool BTreeIndex::CanAllocateNodes(const SIZE_T n) const
+{
+  BLOCKNUM_T numblocks=buffercache->GetNumBlocks();
+  SIZE_T found=0;
+
+  for (BLOCKNUM_T w=freemaphint; w*64<numblocks && found<n; w++) {
+    FREEMAP_WORD_T clear = (w<freemap.size()) ? ~freemap[w] : ~(FREEMAP_WORD_T)0;
+    if (numblocks-w*64<64) {
+      clear &= (((FREEMAP_WORD_T)1)<<(numblocks-w*64))-1;
+    }
+    found+=__builtin_popcountll(clear);
+  }
+  return found>=n;
+}
+
+
+ERROR_T BTreeIndex::DeallocateNode(const BLOCKNUM_T &n)
+{
+  BLOCKNUM_T w=n/64;
+  FREEMAP_WORD_T mask=((FREEMAP_WORD_T)1)<<(n%64);
 
-  superblock.info.freelist=node.info.freelist;
+  assert(w<freemap.size() && (freemap[w]&mask));
 
-  superblock.Serialize(buffercache,superblock_index);
+  freemap[w] &= ~mask;
+  if (w<freemaphint) {
+    freemaphint=w;
+  }
+  freemapdirty=true;
 
-  buffercache->NotifyAllocateBlock(n);
+  buffercache->NotifyDeallocateBlock(n);
 
   return ERROR_NOERROR;
+
+}
+
+
+SIZE_T BTreeIndex::GetFreeMapWordsPerBlock() const
+{
+  return superblock.info.GetNumDataBytes()/sizeof(FREEMAP_WORD_T);
 }
 
 
-ERROR_T BTreeIndex::DeallocateNode(const SIZE_T &n)
+//
+// The freemap blocks form a chain starting at superblock.info.freemap.
+// Each one holds GetFreeMapWordsPerBlock() consecutive words of the bitmap.
+//
+ERROR_T BTreeIndex::ReadFreeMap()
 {
+  if (superblock.info.GetFormatVersion()==BTREE_FORMAT_V0) {
+    return ReadFreeList();
+  }
+
+  BLOCKNUM_T highwater=superblock.info.highwater;
+  SIZE_T wordsperblock=GetFreeMapWordsPerBlock();
+  BLOCKNUM_T block=superblock.info.freemap;
   BTreeNode node;
+  ERROR_T rc;
+
+  freemap.assign(highwater/64 + (highwater%64 != 0), 0);
+  freemapblocks.clear();
+
+  for (BLOCKNUM_T w=0; w<freemap.size(); w+=wordsperblock) {
+    if (block==0) {
+      return ERROR_INSANE;
+    }
+    rc=node.Unserialize(buffercache,block);
+    if (rc) { return rc; }
+    if (node.info.nodetype!=BTREE_FREEMAP_NODE) {
+      return ERROR_INSANE;
+    }
+    SIZE_T n = (freemap.size()-w < wordsperblock) ? freemap.size()-w : wordsperblock;
+    memcpy(&freemap[w],node.data,n*sizeof(FREEMAP_WORD_T));
+    freemapblocks.push_back(block);
+    block=node.info.freemap;
+  }
+
+  freemaphint=0;
+  freemapdirty=false;
+  return ERROR_NOERROR;
+}
+
 
-  node.Unserialize(buffercache,n);
+ERROR_T BTreeIndex::WriteFreeMap()
+{
+  SIZE_T wordsperblock=GetFreeMapWordsPerBlock();
+  ERROR_T rc;
 
-  assert(node.info.nodetype!=BTREE_UNALLOCATED_BLOCK);
+  if (!freemapdirty) {
+    return ERROR_NOERROR;
+  }
 
-  node.info.nodetype=BTREE_UNALLOCATED_BLOCK;
+  if (superblock.info.GetFormatVersion()==BTREE_FORMAT_V0) {
+    return WriteFreeList();
+  }
 
-  node.info.freelist=superblock.info.freelist;
+  // The bitmap grows with the high water mark, so the chain may need
+  // more blocks.  Allocating them can grow the bitmap again.
+  while (freemapblocks.size()*wordsperblock < freemap.size()) {
+    BLOCKNUM_T block;
+    rc=AllocateNode(block);
+    if (rc) { return rc; }
+    freemapblocks.push_back(block);
+  }
 
-  node.Serialize(buffercache,n);
+  for (SIZE_T i=0, w=0; w<freemap.size(); i++, w+=wordsperblock) {
+    BTreeNode node(BTREE_FREEMAP_NODE,
+		   superblock.info.keysize,
+		   superblock.info.valuesize,
+		   superblock.info.blocksize,
+		   superblock.info.GetFormatVersion());
+    SIZE_T n = (freemap.size()-w < wordsperblock) ? freemap.size()-w : wordsperblock;
+    memcpy(node.data,&freemap[w],n*sizeof(FREEMAP_WORD_T));
+    node.info.rootnode=superblock.info.rootnode;
+    node.info.freemap = (i+1<freemapblocks.size()) ? freemapblocks[i+1] : 0;
+    rc=node.Serialize(buffercache,freemapblocks[i]);
+    if (rc) { return rc; }
+  }
 
-  superblock.info.freelist=n;
+  freemapdirty=false;
+  return ERROR_NOERROR;
+}
 
-  superblock.Serialize(buffercache,superblock_index);
 
-  buffercache->NotifyDeallocateBlock(n);
+//
+// A version 0 image has no freemap.  Each free block is marked
+// unallocated and names the next in its freelist field, starting from
+// the superblock's, and every other block is in use.  The chain is
+// turned into a freemap covering the whole disk at Attach, and written
+// back from it at Detach, so the image stays one that code from
+// before the freemap can still use.
+//
+ERROR_T BTreeIndex::ReadFreeList()
+{
+  BLOCKNUM_T numblocks=buffercache->GetNumBlocks();
+  BLOCKNUM_T last=0;
+  bool inorder=true;
+  BTreeNode node;
+  ERROR_T rc;
+
+  freemap.assign(numblocks/64 + (numblocks%64 != 0), ~(FREEMAP_WORD_T)0);
+  if (numblocks%64) {
+    freemap.back()=(((FREEMAP_WORD_T)1)<<(numblocks%64))-1;
+  }
+  freemapblocks.clear();
+
+  for (BLOCKNUM_T block=superblock.info.freemap; block!=0; block=node.info.freemap) {
+    FREEMAP_WORD_T mask=((FREEMAP_WORD_T)1)<<(block%64);
+
+    // off the disk, or on the chain twice
+    if (block>=numblocks || !(freemap[block/64]&mask)) {
+      return ERROR_INSANE;
+    }
+    rc=node.Unserialize(buffercache,block);
+    if (rc) { return rc; }
+    if (node.info.nodetype!=BTREE_UNALLOCATED_BLOCK) {
+      return ERROR_INSANE;
+    }
+    freemap[block/64] &= ~mask;
+    inorder = inorder && block>last;
+    last=block;
+  }
+
+  freelistmap.clear();
+  if (inorder) {
+    freelistmap.resize(freemap.size());
+    for (SIZE_T w=0; w<freemap.size(); w++) {
+      freelistmap[w]=~freemap[w];
+    }
+  }
 
+  superblock.info.highwater=numblocks;
+  freemaphint=0;
+  freemapdirty=false;
   return ERROR_NOERROR;
+}
+
 
+// Chains the free blocks in block order.  A block already on the chain
+// on disk with the same block after it is not written again.
+ERROR_T BTreeIndex::WriteFreeList()
+{
+  BLOCKNUM_T numblocks=buffercache->GetNumBlocks();
+  BLOCKNUM_T next=0, oldnext=0;
+  ERROR_T rc;
+
+  for (BLOCKNUM_T block=numblocks; block-- > superblock_index+1; ) {
+    FREEMAP_WORD_T mask=((FREEMAP_WORD_T)1)<<(block%64);
+    bool wasfree = block/64<freelistmap.size() && (freelistmap[block/64]&mask);
+    bool isfree = block/64>=freemap.size() || !(freemap[block/64]&mask);
+
+    if (isfree) {
+      if (!wasfree || oldnext!=next) {
+	BTreeNode node(BTREE_UNALLOCATED_BLOCK,
+		       superblock.info.keysize,
+		       superblock.info.valuesize,
+		       superblock.info.blocksize,
+		       BTREE_FORMAT_V0);
+	node.info.rootnode=superblock.info.rootnode;
+	node.info.freemap=next;
+	rc=node.Serialize(buffercache,block);
+	if (rc) { return rc; }
+      }
+      next=block;
+    }
+    if (wasfree) {
+      oldnext=block;
+    }
+  }
+
+  superblock.info.freemap=next;
+
+  freelistmap.assign(numblocks/64 + (numblocks%64 != 0), 0);
+  for (BLOCKNUM_T block=superblock_index+1; block<numblocks; block++) {
+    if (block/64>=freemap.size() || !(freemap[block/64]&(((FREEMAP_WORD_T)1)<<(block%64)))) {
+      freelistmap[block/64] |= ((FREEMAP_WORD_T)1)<<(block%64);
+    }
+  }
+
+  freemapdirty=false;
+  return ERROR_NOERROR;
 }
 
-ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
+
+ERROR_T BTreeIndex::Attach(const BLOCKNUM_T initblock, const bool create)
 {
   ERROR_T rc;
 
@@ -124,19 +364,60 @@ ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
   assert(superblock_index==0);
 
   if (create) {
-    // build a super block, root node, and a free space list
+    // build a super block, root node, and a free space bitmap
     //
     // Superblock at superblock_index
     // root node at superblock_index+1
-    // free space list for rest
+    // first freemap block at superblock_index+2
+    //
+    // Nothing else is written.  The rest of the disk lies beyond the
+    // high water mark, so it is free without having been touched.
     BTreeNode newsuperblock(BTREE_SUPERBLOCK,
 			    superblock.info.keysize,
 			    superblock.info.valuesize,
-			    buffercache->GetBlockSize());
+			    buffercache->GetBlockSize(),
+			    superblock.info.GetFormatVersion());
     newsuperblock.info.rootnode=superblock_index+1;
-    newsuperblock.info.freelist=superblock_index+2;
+    newsuperblock.info.freemap=superblock_index+2;
+    newsuperblock.info.highwater=superblock_index+3;
     newsuperblock.info.numkeys=0;
 
+    // A typed index keeps its key type in the superblock, one word
+    // per field, and the number of fields where other nodes keep
+    // their number of keys
+    if (keytype.IsTyped()) {
+      if (keytype.GetKeySize()!=newsuperblock.info.keysize ||
+	  keytype.GetStoredSize()>newsuperblock.info.GetNumDataBytes()) {
+	return ERROR_SIZE;
+      }
+      newsuperblock.info.numkeys=keytype.GetNumFields();
+      keytype.Store((BYTE_T *)newsuperblock.data);
+    }
+
+    if (newsuperblock.info.HasShortSeparators() &&
+	newsuperblock.info.blocksize>BTREE_SLOTTED_MAX_BLOCKSIZE) {
+      return ERROR_SIZE;
+    }
+
+    // packed leaves take keys as 64 bit integers
+    if (newsuperblock.info.HasPackedLeaves() &&
+	(newsuperblock.info.keysize==0 || newsuperblock.info.keysize>sizeof(unsigned long long))) {
+      return ERROR_SIZE;
+    }
+
+    if (newsuperblock.info.highwater>buffercache->GetNumBlocks()) {
+      return ERROR_NOSPACE;
+    }
+
+    superblock=newsuperblock;
+
+    freemap.assign(1,0);
+    for (BLOCKNUM_T i=0; i<newsuperblock.info.highwater; i++) {
+      freemap[i/64] |= ((FREEMAP_WORD_T)1)<<(i%64);
+    }
+    freemapblocks.assign(1,superblock_index+2);
+    freemapdirty=true;
+
     buffercache->NotifyAllocateBlock(superblock_index);
 
     rc=newsuperblock.Serialize(buffercache,superblock_index);
@@ -148,9 +429,10 @@ ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
     BTreeNode newrootnode(BTREE_ROOT_NODE,
 			  superblock.info.keysize,
 			  superblock.info.valuesize,
-			  buffercache->GetBlockSize());
+			  buffercache->GetBlockSize(),
+			  newsuperblock.info.GetFormatVersion());
     newrootnode.info.rootnode=superblock_index+1;
-    newrootnode.info.freelist=superblock_index+2;
+    newrootnode.info.freemap=0;
     newrootnode.info.numkeys=0;
 
     buffercache->NotifyAllocateBlock(superblock_index+1);
@@ -161,117 +443,151 @@ ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
       return rc;
     }
 
-    for (SIZE_T i=superblock_index+2; i<buffercache->GetNumBlocks();i++) {
-      BTreeNode newfreenode(BTREE_UNALLOCATED_BLOCK,
-			    superblock.info.keysize,
-			    superblock.info.valuesize,
-			    buffercache->GetBlockSize());
-      newfreenode.info.rootnode=superblock_index+1;
-      newfreenode.info.freelist= ((i+1)==buffercache->GetNumBlocks()) ? 0: i+1;
+    buffercache->NotifyAllocateBlock(superblock_index+2);
 
-      rc = newfreenode.Serialize(buffercache,i);
-
-      if (rc) {
-	return rc;
-      }
+    rc=WriteFreeMap();
 
+    if (rc) {
+      return rc;
     }
   }
 
   // OK, now, mounting the btree is simply a matter of reading the superblock
+  // and the free space bitmap
+
+  rc=superblock.Unserialize(buffercache,initblock);
+
+  if (rc) {
+    return rc;
+  }
+
+  if (superblock.info.nodetype!=BTREE_SUPERBLOCK) {
+    return ERROR_NOTANINDEX;
+  }
+
+  // Superblocks written before key types have 0 here
+  keytype=KeyType();
+  if (superblock.info.numkeys>0) {
+    if (superblock.info.numkeys*sizeof(SIZE_T)>superblock.info.GetNumDataBytes() ||
+	(rc=keytype.Load((const BYTE_T *)superblock.data,superblock.info.numkeys)) ||
+	keytype.GetKeySize()!=superblock.info.keysize) {
+      return ERROR_NOTANINDEX;
+    }
+  }
 
-  return superblock.Unserialize(buffercache,initblock);
+  return ReadFreeMap();
 }
 
 
-ERROR_T BTreeIndex::Detach(SIZE_T &initblock)
+ERROR_T BTreeIndex::Detach(BLOCKNUM_T &initblock)
 {
+  ERROR_T rc=WriteFreeMap();
+
+  if (rc) {
+    return rc;
+  }
+
   return superblock.Serialize(buffercache,superblock_index);
 }
 
 
-ERROR_T BTreeIndex::LookupOrUpdateInternal(const SIZE_T &node,
+ERROR_T BTreeIndex::MakeKey(const string &text, KEY_T &key) const
+{
+  if (keytype.IsTyped()) {
+    return keytype.Encode(text,key);
+  }
+  key=KEY_T(text.c_str());
+  return ERROR_NOERROR;
+}
+
+
+string BTreeIndex::KeyToString(const KEY_T &key) const
+{
+  string text;
+
+  if (keytype.IsTyped() && keytype.Decode(key,text)==ERROR_NOERROR) {
+    return text;
+  }
+  return string((const char *)key.data,key.length);
+}
+
+
+ERROR_T BTreeIndex::LookupOrUpdateInternal(const BLOCKNUM_T &root,
 					   const BTreeOp op,
 					   const KEY_T &key,
 					   VALUE_T &value)
 {
+  // One node serves every level of the descent.  It is pinned on each
+  // block's cache frame in turn, so keys are compared where they sit in
+  // the cache and nothing is copied but the value.
   BTreeNode b;
   ERROR_T rc;
   SIZE_T offset;
-  KEY_T testkey;
-  SIZE_T ptr;
+  KeyView searchkey(key);
+  BLOCKNUM_T node=root;
+  BLOCKNUM_T ptr;
 
-  rc= b.Unserialize(buffercache,node);
+  while (1) { 
+    rc= b.Pin(buffercache,node);
 
-  if (rc!=ERROR_NOERROR) {
-    return rc;
-  }
+    if (rc!=ERROR_NOERROR) {
+      return rc;
+    }
 
-  switch (b.info.nodetype) {
-  case BTREE_ROOT_NODE:
-  case BTREE_INTERIOR_NODE:
-    // Scan through key/ptr pairs
-    //and recurse if possible
-    for (offset=0;offset<b.info.numkeys;offset++) {
-      rc=b.GetKey(offset,testkey);
-      if (rc) {  return rc; }
-      if (key<testkey || key==testkey) {
-        // OK, so we now have the first key that's larger
-    	// so we ned to recurse on the ptr immediately previous to
-    	// this one, if it exists
-    	rc=b.GetPtr(offset,ptr);
-    	if (rc) { return rc; }
-    	return LookupOrUpdateInternal(ptr,op,key,value);
+    switch (b.info.nodetype) {
+    case BTREE_ROOT_NODE:
+    case BTREE_INTERIOR_NODE:
+      // Find the first key that's no smaller
+      // so we ned to descend on the ptr immediately previous to
+      // this one, if it exists
+      offset=b.LowerBound(searchkey);
+      if (b.info.numkeys==0) {
+	// There are no keys at all on this node, so nowhere to go
+	return ERROR_NONEXISTENT;
       }
-    }
-    // if we got here, we need to go to the next pointer, if it exists
-    if (b.info.numkeys>0) {
-      rc=b.GetPtr(b.info.numkeys,ptr);
+      // if we ran off the end, we go to the last pointer
+      rc=b.GetPtr(offset,ptr);
       if (rc) { return rc; }
-      return LookupOrUpdateInternal(ptr,op,key,value);
-    } else {
-      // There are no keys at all on this node, so nowhere to go
-      return ERROR_NONEXISTENT;
-    }
-    break;
-  case BTREE_LEAF_NODE:
-    // Scan through keys looking for matching value
-    for (offset=0;offset<b.info.numkeys;offset++) {
-      rc=b.GetKey(offset,testkey);
-      if (rc) {  return rc; }
-      if (testkey==key) {
-      	if (op==BTREE_OP_LOOKUP) {
-      	  return b.GetVal(offset,value);
-      	} else {
-      	  // BTREE_OP_UPDATE
-      	  // WRITE ME - Done
-            rc = b.SetVal(offset, value);
-            if (rc) { return rc; }
-
-            rc = b.Serialize(buffercache, node);
-            if (rc) { return rc; }
-
-      	  return ERROR_NOERROR;
-      	}
+      node=ptr;
+      break;
+    case BTREE_LEAF_NODE:
+      // Search the keys for a matching value
+      offset=b.LowerBound(searchkey);
+      if (offset<b.info.numkeys) {
+	if (b.CompareKey(offset,searchkey)==0) {
+	  if (op==BTREE_OP_LOOKUP) {
+	    return b.GetVal(offset,value);
+	  } else {
+	    // BTREE_OP_UPDATE
+	    // WRITE ME - Done
+	    rc = b.SetVal(offset, value);
+	    if (rc) { return rc; }
+
+	    // the value was written into the frame
+	    b.MarkDirty();
+	    return b.Unpin();
+	  }
+	}
       }
+      return ERROR_NONEXISTENT;
+      break;
+    default:
+      // We can't be looking at anything other than a root, internal, or leaf
+      return ERROR_INSANE;
+      break;
     }
-    return ERROR_NONEXISTENT;
-    break;
-  default:
-    // We can't be looking at anything other than a root, internal, or leaf
-    return ERROR_INSANE;
-    break;
   }
 
   return ERROR_INSANE;
 }
 
 
-static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplayType dt)
+static ERROR_T PrintNode(ostream &os, BLOCKNUM_T nodenum, BTreeNode &b, BTreeDisplayType dt,
+			 const BTreeIndex &index)
 {
   KEY_T key;
   VALUE_T value;
-  SIZE_T ptr;
+  BLOCKNUM_T ptr;
   SIZE_T offset;
   ERROR_T rc;
   unsigned i;
@@ -300,10 +616,7 @@ static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplay
 	if (offset==b.info.numkeys) break;
 	rc=b.GetKey(offset,key);
 	if (rc) {  return rc; }
-	for (i=0;i<b.info.keysize;i++) {
-	  os << key.data[i];
-	}
-	os << " ";
+	os << index.KeyToString(key) << " ";
       }
     }
     break;
@@ -326,9 +639,7 @@ static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplay
       }
       rc=b.GetKey(offset,key);
       if (rc) {  return rc; }
-      for (i=0;i<b.info.keysize;i++) {
-	os << key.data[i];
-      }
+      os << index.KeyToString(key);
       if (dt==BTREE_SORTED_KEYVAL) {
 	os << ",";
       } else {
@@ -336,7 +647,7 @@ static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplay
       }
       rc=b.GetVal(offset,value);
       if (rc) {  return rc; }
-      for (i=0;i<b.info.valuesize;i++) {
+      for (i=0;i<value.length;i++) {
 	os << value.data[i];
       }
       if (dt==BTREE_SORTED_KEYVAL) {
@@ -365,6 +676,13 @@ ERROR_T BTreeIndex::Lookup(const KEY_T &key, VALUE_T &value)
 }
 
 ERROR_T BTreeIndex::Insert(const KEY_T &key, const VALUE_T &value)
+{
+  ERROR_T rc = InsertInternal(key, value, scratch);
+  scratch.Release();
+  return rc;
+}
+
+ERROR_T BTreeIndex::InsertInternal(const KEY_T &key, const VALUE_T &value, ScratchArena &arena)
 {
   // WRITE ME - Done
 
@@ -374,248 +692,251 @@ ERROR_T BTreeIndex::Insert(const KEY_T &key, const VALUE_T &value)
   // this makes deleting a key more complicated as we must get rid of all
   // instances of a key and then rebalance
 
-  VALUE_T val;
-  ERROR_T ret;
-
   //cout << "Starting Insert Function" << endl;
 
-  // lookup and attempt update key
-  ret = LookupOrUpdateInternal(superblock.info.rootnode, BTREE_OP_LOOKUP, key, val);
+  ERROR_T rc;
 
-  switch(ret)
+  // keys and values of their own lengths are kept up to the sizes the
+  // index was made with
+  if (superblock.info.HasVariableRecords() &&
+      (key.length > superblock.info.keysize || value.length > superblock.info.valuesize))
   {
-    // key already exists, so do not do anything but update value
-    case ERROR_NOERROR:
-      //cout << "Key aleady in tree, value updated successfully" << endl;
-      return ERROR_INSANE;
-      break;
-    // if key doesn't exist, we will try to insert
-    case ERROR_NONEXISTENT:
-    {
-      // traverse to find the leaf
-      // keep stack of pointers to track path down the node
-      // where the key should go
-      //cout << "New key, begin insert process" << endl;
-      ERROR_T rc;
+    return ERROR_SIZE;
+  }
+
+  // and packed keys are integers of exactly the key size
+  if (superblock.info.HasPackedLeaves() && key.length != superblock.info.keysize)
+  {
+    return ERROR_SIZE;
+  }
 
-      BTreeNode leafNode;
-      BTreeNode rootNode;
-      BTreeNode rightLeafNode;
+  // the root and the leaf are worked on in place in their cache frames,
+  // new nodes live in the arena
+  BTreeNode leafNode(&arena);
+  BTreeNode rootNode;
 
-      SIZE_T leafPtr;
-      SIZE_T rightLeafPtr;
+  BLOCKNUM_T leafPtr;
+  BLOCKNUM_T rightLeafPtr;
 
-      SIZE_T rootPtr = superblock.info.rootnode;
-      rootNode.Unserialize(buffercache, rootPtr);
+  BLOCKNUM_T rootPtr = superblock.info.rootnode;
+  rc = rootNode.Pin(buffercache, rootPtr);
+  if (rc) { return rc; }
 
+  initBlock = false;
+  if (rootNode.info.numkeys != 0)
+    initBlock = true;
 
-      initBlock = false;
-      if (rootNode.info.numkeys != 0)
-        initBlock = true;
+  // if no keys exist yet
+  if (!initBlock)
+  {
+    //cout << "No keys in tree yet, adding to root" << endl;
+    initBlock = true;
 
-      rootNode.Serialize(buffercache, rootPtr);
+    if (!CanAllocateNodes(2)) { return ERROR_NOSPACE; }
 
-      // if no keys exist yet
-      if (!initBlock)
-      {
-        //cout << "No keys in tree yet, adding to root" << endl;
-        initBlock = true;
-
-        // allocate new block and set the values to the first key position
-        AllocateNode(leafPtr);
-        leafNode = BTreeNode(BTREE_LEAF_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-        leafNode.Serialize(buffercache, leafPtr);
-        rc = leafNode.Unserialize(buffercache, leafPtr);
-        if (rc) { return rc; }
+    // allocate new block and set the values to the first key position
+    rc = AllocateNode(leafPtr);
+    if (rc) { return rc; }
+    rc = AllocateNode(rightLeafPtr);
+    if (rc) { return rc; }
 
-        leafNode.info.numkeys++;
-        leafNode.SetKey(0, key);
-        leafNode.SetVal(0, value);
-        // serialize again after setting value and key
-        leafNode.Serialize(buffercache, leafPtr);
+    leafNode = BTreeNode(BTREE_LEAF_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize, superblock.info.GetFormatVersion(), &arena);
+    leafNode.info.numkeys++;
+    leafNode.SetKey(0, key);
+    leafNode.SetVal(0, value);
+    leafNode.SetPtr(0, rightLeafPtr);
+    rc = leafNode.Serialize(buffercache, leafPtr);
+    if (rc) { return rc; }
 
-        // connect this to the root
-        rc = rootNode.Unserialize(buffercache, superblock.info.rootnode);
-        if (rc) { return rc; }
-        rootNode.info.numkeys++;
-        rootNode.SetPtr(0, leafPtr);
-        rootNode.SetKey(0, key);
-
-        // build right node and connect
-        AllocateNode(rightLeafPtr);
-        rightLeafNode = BTreeNode(BTREE_LEAF_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-        rc = rightLeafNode.Serialize(buffercache, rightLeafPtr);
-        if (rc) { return rc; }
-        rootNode.SetPtr(1, rightLeafPtr);
-        rc = rootNode.Serialize(buffercache, superblock.info.rootnode);
-        if(rc) { return rc;}
-      }
-      // else some keys do exist so we need to find the path to the leaf node
-      else
-      {
-        vector<SIZE_T> path;
-        path.push_back(superblock.info.rootnode);
+    // build empty right node
+    leafNode = BTreeNode(BTREE_LEAF_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize, superblock.info.GetFormatVersion(), &arena);
+    rc = leafNode.Serialize(buffercache, rightLeafPtr);
+    if (rc) { return rc; }
 
-        //cout << "Starting lookupleaf" << endl;
-        LookupLeaf(superblock.info.rootnode, key, path);
-        // get the node from the last pointer (which will be the leaf node where we
-        // we need to put our key) and remove it from stack
-        //cout << "Finished lookupleaf" << endl;
-        leafPtr = path.back();
-        path.pop_back();
+    // connect both to the root
+    rootNode.info.numkeys++;
+    rootNode.SetPtr(0, leafPtr);
+    rootNode.SetKey(0, key);
+    rootNode.SetPtr(1, rightLeafPtr);
+    rootNode.MarkDirty();
+    rc = rootNode.Unpin();
+    if(rc) { return rc;}
+  }
+  // else some keys do exist so we need to find the path to the leaf node
+  else
+  {
+    rc = rootNode.Unpin();
+    if (rc) { return rc; }
 
-        //cout << "LeafPtr: " << leafPtr << endl;
+    // deeper than any tree will get, so the path never regrows
+    vector<BLOCKNUM_T> path;
+    path.reserve(32);
+    path.push_back(superblock.info.rootnode);
 
-        KEY_T testKey;
-        KEY_T oldKey;
-        VALUE_T oldVal;
+    // One descent both finds where the key goes and tells us if it is
+    // already there, since it leads to the same leaf a lookup does
+    //cout << "Starting lookupleaf" << endl;
+    rc = LookupLeaf(superblock.info.rootnode, key, path);
+    if (rc) { return rc; }
+    // get the node from the last pointer (which will be the leaf node where we
+    // we need to put our key) and remove it from stack
+    //cout << "Finished lookupleaf" << endl;
+    leafPtr = path.back();
+    path.pop_back();
 
-        rc = leafNode.Unserialize(buffercache, leafPtr);
-        if (rc) { return rc; }
+    //cout << "LeafPtr: " << leafPtr << endl;
 
-        // increment the key count of the leaf node
-        leafNode.info.numkeys++;
+    KeyView searchKey(key);
+    SIZE_T offset;
 
-        // walk accross the leaf node
-        if (leafNode.info.numkeys == 1)
-        {
-          rc = leafNode.SetKey(0, key);
-          if (rc) { return rc; }
-          rc = leafNode.SetVal(0, value);
-          if (rc) { return rc; }
-        }
-        else
-        {
-          bool inserted = false;
+    rc = leafNode.Pin(buffercache, leafPtr);
+    if (rc) { return rc; }
 
-          for (SIZE_T offset = 0; offset < (unsigned) leafNode.info.numkeys - 1; offset++)
-          {
-            rc = leafNode.GetKey(offset, testKey);
-            if (rc) { return rc; }
-            if (key < testKey)
-            {
-              // found position where our new key needs to go
-              // move all other keys over by 1
-              for (int offset2 = (int) leafNode.info.numkeys - 2; offset2 >= (int) offset; offset2--)
-              {
-                // grab old key and value
-                rc = leafNode.GetKey((SIZE_T) offset2, oldKey);
-                if (rc) { return rc; }
-                rc = leafNode.GetVal((SIZE_T) offset2, oldVal);
-                if (rc) { return rc; }
-                // move old key up by 1
-                rc = leafNode.SetKey((SIZE_T) offset2 + 1, oldKey);
-                if (rc) { return rc; }
-                rc = leafNode.SetVal((SIZE_T) offset2 + 1, oldVal);
-                if (rc) { return rc; }
-              }
-
-              // found place for key so assign new key to offset
-              inserted = true;
-              rc = leafNode.SetKey(offset, key);
-              if (rc) { return rc; }
-              rc = leafNode.SetVal(offset, value);
-              if (rc) { return rc; }
-
-              break;
-            }
-          }
+    // search the leaf node for the first key that is no smaller
+    offset = leafNode.LowerBound(searchKey);
+    if (offset < leafNode.info.numkeys)
+    {
+      if (leafNode.CompareKey(offset, searchKey) == 0)
+      {
+        // key already exists, so do not do anything
+        //cout << "Key aleady in tree" << endl;
+        return ERROR_INSANE;
+      }
+    }
 
-          // did not find place for key so add to the end
-          if (!inserted)
-          {
-            rc = leafNode.SetKey(leafNode.info.numkeys - 1, key);
-            if (rc) { return rc; }
-            rc = leafNode.SetVal(leafNode.info.numkeys - 1, value);
-            if (rc) { return rc; }
-          }
-        }
+    // The insert may split every node on the path and add a new root.
+    // The blocks for that are checked for before anything changes, so
+    // running out leaves the tree as it was.
+    if (!CanAllocateNodes(path.size() + 1)) { return ERROR_NOSPACE; }
 
-        // re serialize after access and write
-        leafNode.Serialize(buffercache, leafPtr);
+    // move the pairs from there on over by 1, in place, and put the
+    // new one in the gap
+    rc = leafNode.InsertKeyVal(offset, searchKey, value);
+    if (rc == ERROR_SIZE && leafNode.info.numkeys > 1)
+    {
+      // values that grew in updates, or a key that makes a packed leaf
+      // repack its keys wider, have filled the leaf, so split it first
+      // and go down again
+      leafNode.MarkDirty();
+      rc = leafNode.Unpin();
+      if (rc) { return rc; }
+      path.pop_back();
+      rc = Rebalance(leafPtr, path, arena);
+      if (rc) { return rc; }
+      return InsertInternal(key, value, arena);
+    }
+    if (rc) { return rc; }
 
-        // check if node length is over maxNumKeys, call rebalance if so
-        if ((int) leafNode.info.numkeys > (int) (maxNumKeys)) {
-          SIZE_T parentPtr = path.back();
-          path.pop_back();
-          rc = Rebalance(parentPtr, path);
-          // if (rc) { return rc; }
-        }
-      }
-      break;
+    // a node is split once it fills, so it always has room for one
+    // more key
+    bool full = leafNode.IsFull();
+
+    // the pair went straight into the frame
+    leafNode.MarkDirty();
+    rc = leafNode.Unpin();
+    if (rc) { return rc; }
+
+    if (full) {
+      BLOCKNUM_T parentPtr = path.back();
+      path.pop_back();
+      rc = Rebalance(parentPtr, path, arena);
+      if (rc) { return rc; }
     }
   }
 
   return ERROR_NOERROR;
 }
 
-ERROR_T BTreeIndex::LookupLeaf(const SIZE_T &node, const KEY_T &key, vector<SIZE_T> &path)
+ERROR_T BTreeIndex::LookupLeaf(const BLOCKNUM_T &node, const KEY_T &key, vector<BLOCKNUM_T> &path)
 {
   ERROR_T rc;
   BTreeNode b;
   SIZE_T offset;
-  SIZE_T ptr;
-  KEY_T testKey;
+  BLOCKNUM_T ptr=node;
+  KeyView searchKey(key);
 
-  rc = b.Unserialize(buffercache, node);
-  if (rc != ERROR_NOERROR) { return rc; }
+  // one node, pinned on each frame in turn, serves every level on the
+  // way down
+  while (1)
+  {
+    rc = b.Pin(buffercache, ptr);
+    if (rc != ERROR_NOERROR) { return rc; }
 
-  switch (b.info.nodetype) {
-    case BTREE_ROOT_NODE:
-    case BTREE_INTERIOR_NODE:
-      // scan through key/ptr pairs and recurse if possible
-      for (offset = 0; offset < b.info.numkeys; offset++)
-      {
-        rc = b.GetKey(offset, testKey);
-        if (rc) { return rc; }
-        if (key < testKey)
+    switch (b.info.nodetype) {
+      case BTREE_ROOT_NODE:
+      case BTREE_INTERIOR_NODE:
+        if (b.info.numkeys == 0)
         {
-          // found first key that is larger
-          // recurse on ptr immediately previous to this one
-          rc = b.GetPtr(offset, ptr);
-          if (rc) { return rc; }
-
-          path.push_back(ptr);
-          //cout << "path now has: " << path[0] << endl;
-          return LookupLeaf(ptr, key, path);
+          // no keys at all on this node, so nowhere to go
+          return ERROR_NONEXISTENT;
         }
-      }
-
-      // did not find, so go to next pointer if exists
-      if (b.info.numkeys > 0)
-      {
-        rc = b.GetPtr(b.info.numkeys, ptr);
+        // search key/ptr pairs for the first key that is no
+        // smaller, as a lookup does, and descend on ptr immediately
+        // previous to it, or on the last pointer if there is none
+        offset = b.LowerBound(searchKey);
+        rc = b.GetPtr(offset, ptr);
         if (rc) { return rc; }
 
         path.push_back(ptr);
-        return LookupLeaf(ptr, key, path);
-      }
-      else
-      {
-        // no keys at all on this node, so nowhere to go
-        return ERROR_NONEXISTENT;
-      }
-      break;
-    case BTREE_LEAF_NODE:
-      path.push_back(node);
-      return ERROR_NOERROR;
-      break;
-    default:
-      return ERROR_INSANE;
-      break;
+        break;
+      case BTREE_LEAF_NODE:
+        path.push_back(ptr);
+        return ERROR_NOERROR;
+        break;
+      default:
+        return ERROR_INSANE;
+        break;
+    }
   }
 
   return ERROR_INSANE;
 }
 
-ERROR_T BTreeIndex::Rebalance(const SIZE_T &node, vector<SIZE_T> path)
+// The nodes from the root down to the parent of node, which key leads
+// to, for when the path a split was given no longer holds
+ERROR_T BTreeIndex::LookupPath(const BLOCKNUM_T &node, const KEY_T &key, vector<BLOCKNUM_T> &path)
 {
   ERROR_T rc;
   BTreeNode b;
-  BTreeNode leftNode;
-  BTreeNode rightNode;
+  BLOCKNUM_T ptr = superblock.info.rootnode;
+  KeyView searchKey(key);
 
-  SIZE_T offset;
+  path.clear();
+  while (ptr != node)
+  {
+    rc = b.Pin(buffercache, ptr);
+    if (rc) { return rc; }
+    if (b.info.nodetype == BTREE_LEAF_NODE || b.info.numkeys == 0)
+    {
+      return ERROR_INSANE;
+    }
+    path.push_back(ptr);
+    rc = b.GetPtr(b.LowerBound(searchKey), ptr);
+    if (rc) { return rc; }
+  }
+
+  return ERROR_NOERROR;
+}
+
+// Bytes at the start of two keys that are the same
+static SIZE_T CommonPrefixLength(const KEY_T &a, const KEY_T &b)
+{
+  SIZE_T n = a.length < b.length ? a.length : b.length;
+  SIZE_T i;
+
+  for (i = 0; i < n && a.data[i] == b.data[i]; i++) { }
+  return i;
+}
+
+ERROR_T BTreeIndex::Rebalance(const BLOCKNUM_T &node, vector<BLOCKNUM_T> &path, ScratchArena &arena)
+{
+  ERROR_T rc;
+  BTreeNode b(&arena);
+  BTreeNode leftNode(&arena);
+  BTreeNode rightNode(&arena);
+  BTreeNode parentNode(&arena);
+  BLOCKNUM_T parentPtr = 0;
+  SIZE_T offset = 0;
 
   int newType;
 
@@ -624,129 +945,194 @@ ERROR_T BTreeIndex::Rebalance(const SIZE_T &node, vector<SIZE_T> path)
 
   //cout << "Rebalancing" << endl;
 
-  // allocate two new nodes
-  // fill them from the place you're splitting
-  SIZE_T leftPtr;
-  SIZE_T rightPtr;
-  AllocateNode(leftPtr);
+  SIZE_T numkeys = b.info.numkeys;
+  SIZE_T midpoint;
+  bool leaf = b.info.nodetype == BTREE_LEAF_NODE;
 
-  if (b.info.nodetype == BTREE_LEAF_NODE)
+  if (numkeys < 2)
   {
-    newType = BTREE_LEAF_NODE;
+    // nothing to split
+    return ERROR_SIZE;
+  }
+
+  // find splitting point.  A leaf keeps the splitting key in its
+  // left half, while an interior node moves it up to the parent.
+  if (leaf)
+  {
+    midpoint = numkeys / 2;
   }
   else
   {
-    newType = BTREE_INTERIOR_NODE;
+    midpoint = (numkeys + 1) / 2;
   }
 
-  leftNode = BTreeNode(newType, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-  rc = leftNode.Serialize(buffercache, leftPtr);
-  if (rc) { return rc; }
-  AllocateNode(rightPtr);
-  rightNode = BTreeNode(newType, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-  rc = rightNode.Serialize(buffercache, rightPtr);
-  if (rc) { return rc; }
-  // unserialize to write to new nodes
-  rc = leftNode.Unserialize(buffercache, leftPtr);
-  if (rc) { return rc; }
-  rc = rightNode.Unserialize(buffercache, rightPtr);
-  if (rc) { return rc; }
+  if ((leaf && b.info.HasVariableRecords()) || (!leaf && b.info.HasShortSeparators()))
+  {
+    // entries of their own sizes are split where half their bytes are,
+    // leaving a key or more on each side
+    SIZE_T total = 0, left = 0;
+    SIZE_T lowest = leaf ? 1 : 2;
 
-  // variables to hold key pos/ vals
-  KEY_T keyPos;
-  KEY_T testKey;
-  VALUE_T val;
-  SIZE_T tempPtr;
+    for (SIZE_T i = 0; i < numkeys; i++)
+    {
+      total += b.GetSlotBytes(i);
+    }
+    for (midpoint = 0; midpoint < numkeys && 2 * left < total; midpoint++)
+    {
+      left += b.GetSlotBytes(midpoint);
+    }
+    if (midpoint < lowest)
+    {
+      midpoint = lowest;
+    }
+    if (midpoint > numkeys - 1)
+    {
+      midpoint = numkeys - 1;
+    }
+  }
 
-  // find splitting point
-  int midpoint = (b.info.numkeys + 0.5) / 2;
+  // find key to split on, a copy since b may keep only part of it
+  KEY_T splitKey;
+  rc = b.GetKey(midpoint - 1, splitKey);
+  if (rc) { return rc;}
 
-  // if a leaf node
-  if (b.info.nodetype == BTREE_LEAF_NODE)
+  if (b.info.nodetype == BTREE_LEAF_NODE && b.info.HasShortSeparators())
   {
-    // build left leaf node, include splitting key
-    for (offset = 0; (int) offset < midpoint; offset++)
-    {
-      //cout << "Offset for building new left leaf node: " << offset << endl;
-      leftNode.info.numkeys++;
+    // The parent needs only something no smaller than every key on the
+    // left and smaller than every key on the right.  The first key on
+    // the right cut just past where it differs from the last key on
+    // the left is that, unless nothing would be cut.
+    KEY_T rightKey;
+    rc = b.GetKey(midpoint, rightKey);
+    if (rc) { return rc; }
 
-      // get old node values
-      rc = b.GetKey(offset, keyPos);
-      if (rc) { return rc; }
-      rc = b.GetVal(offset, val);
-      if (rc) { return rc; }
-      // set values in new left node
-      rc = leftNode.SetKey(offset, keyPos);
-      if (rc) { return rc; }
-      rc = leftNode.SetVal(offset, val);
-      if (rc) { return rc; }
-    }
-    // build right leaf node
-    int pos = 0;
-    for (offset = midpoint; offset < b.info.numkeys; offset++)
+    SIZE_T length = CommonPrefixLength(splitKey, rightKey) + 1;
+    if (length < rightKey.length)
     {
-      rightNode.info.numkeys++;
+      splitKey = rightKey;
+      splitKey.Resize(length);
+    }
+  }
 
-      //cout << "Offset for building new right leaf node: " << pos << endl;
-      //cout << "Offset for total block: " << offset << endl;
-      // get old node values
-      rc = b.GetKey(offset, keyPos);
-      if (rc) { return rc; }
-      rc = b.GetVal(offset, val);
+  // find parent node, unless we have reached the root
+  if (b.info.nodetype != BTREE_ROOT_NODE)
+  {
+    parentPtr = path.back();
+    path.pop_back();
+
+    rc = parentNode.Unserialize(buffercache, parentPtr);
+    if (rc) { return rc; }
+
+    if (parentNode.IsFull())
+    {
+      // A parent is split once it fills, but one left full by a split
+      // that ran out of blocks has no room for the split key.  Split
+      // it first, then find which half now points to b.
+      KEY_T firstKey;
+      rc = b.GetKey(0, firstKey);
       if (rc) { return rc; }
-      // set values in new right node
-      rc = rightNode.SetKey(pos, keyPos);
+      rc = Rebalance(parentPtr, path, arena);
       if (rc) { return rc; }
-      rc = rightNode.SetVal(pos, val);
+      rc = LookupPath(node, firstKey, path);
       if (rc) { return rc; }
-      pos++;
+      return Rebalance(node, path, arena);
     }
+
+    // the new key goes before the first larger key, which is where
+    // the pointer to b is
+    offset = parentNode.UpperBound(splitKey);
+  }
+
+  // the left half goes back in the node's own block, so whatever
+  // pointed to the node, the previous leaf's link included, now points
+  // to it, and the right half goes in a new node.  A new root is
+  // allocated now too, so that nothing is written unless both are had.
+  BLOCKNUM_T leftPtr = node;
+  BLOCKNUM_T rightPtr;
+  BLOCKNUM_T newRootPtr = 0;
+  if (!CanAllocateNodes(b.info.nodetype == BTREE_ROOT_NODE ? 2 : 1)) { return ERROR_NOSPACE; }
+  rc = AllocateNode(rightPtr);
+  if (rc) { return rc; }
+  if (b.info.nodetype == BTREE_ROOT_NODE)
+  {
+    rc = AllocateNode(newRootPtr);
+    if (rc) { return rc; }
+  }
+
+  if (b.info.nodetype == BTREE_LEAF_NODE)
+  {
+    newType = BTREE_LEAF_NODE;
   }
-  // if an interior node
   else
   {
-    // build left interior node, include splitting key
-    for (offset = 0; (int) offset < midpoint; offset++)
-    {
-      //cout << "offset for building new left interior node: " << offset << endl;
-      leftNode.info.numkeys++;
+    newType = BTREE_INTERIOR_NODE;
+  }
 
-      // get old node values
-      rc = b.GetKey(offset, keyPos);
-      if (rc) { return rc; }
-      rc = b.GetPtr(offset, tempPtr);
-      if (rc) { return rc; }
-      // set values in new left node
-      rc = leftNode.SetKey(offset, keyPos);
-      if (rc) { return rc; }
-      rc = leftNode.SetPtr(offset, tempPtr);
+  // the halves are in the same format as the node they come from, so
+  // their bytes can be copied across directly
+  leftNode = BTreeNode(newType, b.info.keysize, b.info.valuesize, b.info.blocksize, b.info.GetFormatVersion(), &arena);
+  rightNode = BTreeNode(newType, b.info.keysize, b.info.valuesize, b.info.blocksize, b.info.GetFormatVersion(), &arena);
+
+  if (b.info.HasCommonPrefix())
+  {
+    // Any key that reaches a half lies between the keys on either side
+    // of its pointer in the parent, the split key being one of them,
+    // so it starts with the bytes those two share.  The bytes b kept
+    // hold too, so a half never keeps fewer, and never needs more room.
+    SIZE_T leftCommon = b.GetCommonPrefixLength();
+    SIZE_T rightCommon = leftCommon;
+    SIZE_T common;
+    KEY_T fence;
+
+    if (b.info.nodetype != BTREE_ROOT_NODE && offset > 0)
+    {
+      rc = parentNode.GetKey(offset - 1, fence);
       if (rc) { return rc; }
+      common = CommonPrefixLength(fence, splitKey);
+      leftCommon = common > leftCommon ? common : leftCommon;
     }
-    // build right interior node
-    int pos = 0;
-    for (offset = midpoint; offset < b.info.numkeys; offset++)
+    if (b.info.nodetype != BTREE_ROOT_NODE && offset < parentNode.info.numkeys)
     {
-      rightNode.info.numkeys++;
-
-      //cout << "offset for building new right interior node: " << pos << endl;
-      //cout << "offset for total block: " << offset << endl;
-
-      // get old node values
-      rc = b.GetKey(offset, keyPos);
-      if (rc) { return rc; }
-      rc = b.GetPtr(offset, tempPtr);
+      rc = parentNode.GetKey(offset, fence);
       if (rc) { return rc; }
-      // set values in new right node
-      rc = rightNode.SetKey(pos, keyPos);
-      if (rc) { return rc; }
-      rc = rightNode.SetPtr(pos, tempPtr);
-      if (rc) { return rc; }
-      pos++;
+      common = CommonPrefixLength(splitKey, fence);
+      rightCommon = common > rightCommon ? common : rightCommon;
     }
 
-    rc = b.GetPtr(offset, tempPtr);
+    rc = leftNode.SetCommonPrefix(splitKey, leftCommon);
+    if (rc) { return rc; }
+    rc = rightNode.SetCommonPrefix(splitKey, rightCommon);
+    if (rc) { return rc; }
+  }
+
+  // if a leaf node
+  if (b.info.nodetype == BTREE_LEAF_NODE)
+  {
+    // build left leaf node, include splitting key
+    rc = leftNode.CopySlots(b, 0, midpoint);
+    if (rc) { return rc; }
+
+    // build right leaf node
+    rc = rightNode.CopySlots(b, midpoint, numkeys - midpoint);
     if (rc) { return rc; }
-    rc = rightNode.SetPtr(pos, tempPtr);
+
+    // and put it in the chain of leaves after the left one
+    BLOCKNUM_T next;
+    rc = b.GetPtr(0, next);
+    if (rc) { return rc; }
+    leftNode.SetPtr(0, rightPtr);
+    rightNode.SetPtr(0, next);
+  }
+  // if an interior node
+  else
+  {
+    // the left interior node gets the keys before the splitting key
+    // and the pointers up to it
+    rc = leftNode.CopySlots(b, 0, midpoint - 1);
+    if (rc) { return rc; }
+
+    // build right interior node from the pointer after it on
+    rc = rightNode.CopySlots(b, midpoint, numkeys - midpoint);
     if (rc) { return rc; }
   }
 
@@ -755,13 +1141,6 @@ ERROR_T BTreeIndex::Rebalance(const SIZE_T &node, vector<SIZE_T> path)
   if (rc) { return rc;}
   rc = rightNode.Serialize(buffercache, rightPtr);
   if (rc) { return rc;}
-  rc = b.Serialize(buffercache, node);
-
-  // find key to split on
-
-  KEY_T splitKey;
-  rc = b.GetKey(midpoint - 1, splitKey);
-  if (rc) { return rc;}
 
   //cout << "Node type: " << b.info.nodetype << endl;
 
@@ -769,11 +1148,9 @@ ERROR_T BTreeIndex::Rebalance(const SIZE_T &node, vector<SIZE_T> path)
   if (b.info.nodetype == BTREE_ROOT_NODE)
   {
     //cout << "Building new root" << endl;
-    SIZE_T newRootPtr;
-    BTreeNode newRootNode;
-    AllocateNode(newRootPtr);
+    BTreeNode newRootNode(&arena);
 
-    newRootNode = BTreeNode(BTREE_ROOT_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
+    newRootNode = BTreeNode(BTREE_ROOT_NODE, b.info.keysize, b.info.valuesize, b.info.blocksize, b.info.GetFormatVersion(), &arena);
     superblock.info.rootnode = newRootPtr;
     newRootNode.info.rootnode = newRootPtr;
     newRootNode.info.numkeys = 1;
@@ -783,119 +1160,358 @@ ERROR_T BTreeIndex::Rebalance(const SIZE_T &node, vector<SIZE_T> path)
     rc = newRootNode.Serialize(buffercache, newRootPtr);
     if (rc) { return rc; }
   }
-  // find parent node
   else
   {
-    SIZE_T parentPtr = path.back();
+    // move the keys and pointers after the old pointer over by 1, in
+    // place, and put the split key between the two new nodes
+    rc = parentNode.InsertKeyPtr(offset, splitKey, rightPtr);
+    if (rc) { return rc; }
+    parentNode.SetPtr(offset, leftPtr);
 
-    path.pop_back();
+    // a node is split once it fills
+    bool full = parentNode.IsFull();
 
-    BTreeNode parentNode;
-    rc = parentNode.Unserialize(buffercache, parentPtr);
+    rc = parentNode.Serialize(buffercache, parentPtr);
     if (rc) { return rc; }
 
-    if (parentNode.info.nodetype == BTREE_SUPERBLOCK)
+    if (full)
     {
-      AllocateNode(parentPtr);
+      rc = Rebalance(parentPtr, path, arena);
+      if (rc) { return rc; }
     }
+  }
 
-    // create new parent node, increment key and copy over free list
-    BTreeNode newParentNode = BTreeNode(parentNode.info.nodetype, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-    newParentNode.info.numkeys = parentNode.info.numkeys + 1;
-    newParentNode.info.freelist = parentNode.info.freelist;
+  return ERROR_NOERROR;
+}
 
-    bool newKeyInserted = false;
-    for (offset = 0; offset < newParentNode.info.numkeys - 1; offset++)
-    {
-      rc = parentNode.GetKey(offset, testKey);
+ERROR_T BTreeIndex::Update(const KEY_T &key, const VALUE_T &value)
+{
+  // WRITE ME - Done
+  VALUE_T newvalue = value;
+  ERROR_T rc;
 
-      if (newKeyInserted)
-      {
-        rc = parentNode.GetKey(offset, keyPos);
-        if (rc) { return rc; }
-        rc = newParentNode.SetKey(offset + 1, keyPos);
-        if (rc) { return rc; }
+  if (superblock.info.HasVariableRecords() && value.length > superblock.info.valuesize)
+  {
+    return ERROR_SIZE;
+  }
 
-        rc = parentNode.GetPtr(offset + 1, tempPtr);
-        if (rc) { return rc; }
-        rc = newParentNode.SetPtr(offset + 2, tempPtr);
-        if (rc) { return rc; }
+  rc = LookupOrUpdateInternal(superblock.info.rootnode, BTREE_OP_UPDATE, key, newvalue);
+  if (rc == ERROR_SIZE && superblock.info.HasVariableRecords())
+  {
+    // a longer value has no room in its leaf until the leaf is split
+    vector<BLOCKNUM_T> path;
+    path.push_back(superblock.info.rootnode);
+    rc = LookupLeaf(superblock.info.rootnode, key, path);
+    if (rc) { return rc; }
+    BLOCKNUM_T leafPtr = path.back();
+    path.pop_back();
+    if (!CanAllocateNodes(path.size() + 1)) { return ERROR_NOSPACE; }
+    path.pop_back();
+    rc = Rebalance(leafPtr, path, scratch);
+    scratch.Release();
+    if (rc) { return rc; }
+    rc = LookupOrUpdateInternal(superblock.info.rootnode, BTREE_OP_UPDATE, key, newvalue);
+  }
+  return rc;
+}
 
-      }
-      else
-      {
-        if (splitKey < testKey)
-        {
-          newKeyInserted = true;
-          newParentNode.SetPtr(offset, leftPtr);
-          newParentNode.SetKey(offset, splitKey);
-          newParentNode.SetPtr(offset + 1, rightPtr);
-          offset = offset - 1;
-        }
-        else
+ERROR_T BTreeIndex::Delete(const KEY_T &key)
+{
+  // This is optional extra credit
+  //
+  //
+  return ERROR_UNIMPL;
+}
+
+//
+//
+// DEPTH first traversal
+// DOT is Depth + DOT format
+//
+
+BTreeCursor::BTreeCursor() :
+  block(0), offset(0), atend(true), pathvalid(false), resumeinclusive(true)
+{}
+
+
+ERROR_T BTreeCursor::GetKey(KEY_T &key) const
+{
+  if (atend)
+  {
+    return ERROR_NONEXISTENT;
+  }
+  return leaf.GetKey(offset, key);
+}
+
+
+ERROR_T BTreeCursor::GetVal(VALUE_T &value) const
+{
+  if (atend)
+  {
+    return ERROR_NONEXISTENT;
+  }
+  return leaf.GetVal(offset, value);
+}
+
+
+// Goes down from node to a leaf, by key if there is one, or else by
+// the last pointer of each node if last and the first if not, and adds
+// the way down to the cursor's path.  ERROR_NONEXISTENT if the tree has
+// no leaves yet.
+ERROR_T BTreeIndex::CursorDescend(const BLOCKNUM_T &node,
+				  const KEY_T *key,
+				  const bool last,
+				  BTreeCursor &cursor) const
+{
+  BTreeNode b;
+  BLOCKNUM_T ptr = node;
+  SIZE_T offset;
+  ERROR_T rc;
+
+  while (1)
+  {
+    rc = b.Unserialize(buffercache, ptr);
+    if (rc) { return rc; }
+
+    switch (b.info.nodetype) {
+      case BTREE_ROOT_NODE:
+      case BTREE_INTERIOR_NODE:
+        if (b.info.numkeys == 0)
         {
-          rc = parentNode.GetKey(offset, keyPos);
-          if (rc) { return rc; }
-          rc = newParentNode.SetKey(offset, keyPos);
-          if (rc) { return rc; }
-
-          rc = parentNode.GetPtr(offset, tempPtr);
-          if (rc) { return rc; }
-          rc = newParentNode.SetPtr(offset, tempPtr);
-          if (rc) { return rc; }
+          return ERROR_NONEXISTENT;
         }
-      }
+        offset = key ? b.LowerBound(KeyView(*key)) : last ? b.info.numkeys : 0;
+        cursor.path.push_back(ptr);
+        cursor.pathoffsets.push_back(offset);
+        rc = b.GetPtr(offset, ptr);
+        if (rc) { return rc; }
+        break;
+      case BTREE_LEAF_NODE:
+        cursor.leaf = std::move(b);
+        cursor.block = ptr;
+        return ERROR_NOERROR;
+        break;
+      default:
+        return ERROR_INSANE;
+        break;
     }
+  }
+
+  return ERROR_INSANE;
+}
+
+
+// Moves the cursor to the leaf after its own, or before it if not
+// forward, through the nodes on its path.  moved is false, and the path
+// is used up, if there is no such leaf.
+ERROR_T BTreeIndex::CursorStepLeaf(BTreeCursor &cursor, const bool forward, bool &moved) const
+{
+  BTreeNode b;
+  BLOCKNUM_T ptr;
+  ERROR_T rc;
 
-    if (newKeyInserted == false)
+  moved = false;
+
+  // up to the nearest node with a pointer on that side of the one
+  // taken, and down its other side
+  while (!cursor.path.empty())
+  {
+    SIZE_T offset = cursor.pathoffsets.back();
+
+    rc = b.Unserialize(buffercache, cursor.path.back());
+    if (rc) { return rc; }
+
+    if (forward ? offset < b.info.numkeys : offset > 0)
     {
-      newKeyInserted = true;
-      newParentNode.SetPtr(offset, leftPtr);
-      newParentNode.SetKey(offset, splitKey);
-      newParentNode.SetPtr(offset + 1, rightPtr);
+      offset = forward ? offset + 1 : offset - 1;
+      cursor.pathoffsets.back() = offset;
+      rc = b.GetPtr(offset, ptr);
+      if (rc) { return rc; }
+      moved = true;
+      return CursorDescend(ptr, 0, !forward, cursor);
     }
+    cursor.path.pop_back();
+    cursor.pathoffsets.pop_back();
+  }
+
+  cursor.pathvalid = false;
+  return ERROR_NOERROR;
+}
 
-    newParentNode.Serialize(buffercache, parentPtr);
 
-    if ((int) newParentNode.info.numkeys > (int) (maxNumKeys))
+// Moves the cursor from its offset in its leaf on to the first key
+// there or after, or to the end
+ERROR_T BTreeIndex::CursorForward(BTreeCursor &cursor) const
+{
+  BLOCKNUM_T next;
+  ERROR_T rc;
+  bool moved;
+  bool uselinks = true;
+
+  while (cursor.offset >= cursor.leaf.info.numkeys)
+  {
+    if (cursor.leaf.info.numkeys > 0)
+    {
+      rc = cursor.leaf.GetKey(cursor.leaf.info.numkeys - 1, cursor.resume);
+      if (rc) { return rc; }
+      cursor.resumeinclusive = false;
+    }
+
+    rc = cursor.leaf.GetPtr(0, next);
+    if (rc) { return rc; }
+
+    if (next && uselinks)
     {
-      rc = Rebalance(parentPtr, path);
+      // the next leaf, without going back up
+      rc = cursor.leaf.Unserialize(buffercache, next);
       if (rc) { return rc; }
+      cursor.block = next;
+      cursor.offset = 0;
+      cursor.pathvalid = false;
+      continue;
+    }
+
+    if (!cursor.pathvalid)
+    {
+      // The chain ends here, at the last leaf or at one written
+      // before leaves were linked.  Find the way down to where the
+      // cursor is, and go on through the nodes above from there.
+      cursor.path.clear();
+      cursor.pathoffsets.clear();
+      rc = CursorDescend(superblock.info.rootnode, &cursor.resume, false, cursor);
+      if (rc) { return rc; }
+      cursor.pathvalid = true;
+      cursor.offset = cursor.resumeinclusive ?
+	cursor.leaf.LowerBound(KeyView(cursor.resume)) : cursor.leaf.UpperBound(KeyView(cursor.resume));
+      uselinks = false;
+      continue;
+    }
+
+    rc = CursorStepLeaf(cursor, true, moved);
+    if (rc) { return rc; }
+    if (!moved)
+    {
+      cursor.atend = true;
+      return ERROR_NOERROR;
     }
+    cursor.offset = 0;
   }
 
-  // deallocate the old node
-  DeallocateNode(node);
   return ERROR_NOERROR;
 }
 
-ERROR_T BTreeIndex::Update(const KEY_T &key, const VALUE_T &value)
+
+ERROR_T BTreeIndex::Seek(const KEY_T &key, BTreeCursor &cursor) const
 {
-  // WRITE ME - Done
-  VALUE_T newvalue = value;
-  return LookupOrUpdateInternal(superblock.info.rootnode, BTREE_OP_UPDATE, key, newvalue);
+  ERROR_T rc;
+
+  cursor.path.clear();
+  cursor.pathoffsets.clear();
+  cursor.pathvalid = false;
+  cursor.atend = true;
+
+  rc = CursorDescend(superblock.info.rootnode, &key, false, cursor);
+  if (rc == ERROR_NONEXISTENT)
+  {
+    // nothing in the tree, so at the end
+    return ERROR_NOERROR;
+  }
+  if (rc) { return rc; }
+
+  cursor.pathvalid = true;
+  cursor.atend = false;
+  cursor.resume = key;
+  cursor.resumeinclusive = true;
+  cursor.offset = cursor.leaf.LowerBound(KeyView(key));
+  return CursorForward(cursor);
 }
 
-ERROR_T BTreeIndex::Delete(const KEY_T &key)
+
+ERROR_T BTreeIndex::Next(BTreeCursor &cursor) const
 {
-  // This is optional extra credit
-  //
-  //
-  return ERROR_UNIMPL;
+  if (cursor.atend)
+  {
+    return ERROR_NONEXISTENT;
+  }
+  cursor.offset++;
+  return CursorForward(cursor);
 }
 
-//
-//
-// DEPTH first traversal
-// DOT is Depth + DOT format
-//
 
-ERROR_T BTreeIndex::DisplayInternal(const SIZE_T &node,
+ERROR_T BTreeIndex::Prev(BTreeCursor &cursor) const
+{
+  ERROR_T rc;
+  bool moved;
+  bool fromend = cursor.atend;
+  KEY_T first;
+
+  if (fromend)
+  {
+    // from the end, back from the last leaf
+    cursor.path.clear();
+    cursor.pathoffsets.clear();
+    rc = CursorDescend(superblock.info.rootnode, 0, true, cursor);
+    if (rc == ERROR_NONEXISTENT)
+    {
+      return rc;
+    }
+    if (rc) { return rc; }
+    cursor.pathvalid = true;
+    cursor.offset = cursor.leaf.info.numkeys;
+  }
+  else
+  {
+    if (cursor.offset > 0)
+    {
+      cursor.offset--;
+      return ERROR_NOERROR;
+    }
+
+    // at the first key of its leaf, which the nodes above lead to
+    rc = cursor.leaf.GetKey(0, first);
+    if (rc) { return rc; }
+    if (!cursor.pathvalid)
+    {
+      cursor.path.clear();
+      cursor.pathoffsets.clear();
+      rc = CursorDescend(superblock.info.rootnode, &first, false, cursor);
+      if (rc) { return rc; }
+      cursor.pathvalid = true;
+      cursor.offset = 0;
+    }
+  }
+
+  // back to the nearest leaf with keys
+  while (cursor.offset == 0)
+  {
+    rc = CursorStepLeaf(cursor, false, moved);
+    if (rc) { return rc; }
+    if (!moved)
+    {
+      // nothing before, so the cursor goes back where it was
+      if (fromend)
+      {
+        cursor.atend = true;
+        return ERROR_NONEXISTENT;
+      }
+      rc = Seek(first, cursor);
+      return rc ? rc : ERROR_NONEXISTENT;
+    }
+    cursor.offset = cursor.leaf.info.numkeys;
+  }
+
+  cursor.offset--;
+  cursor.atend = false;
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T BTreeIndex::DisplayInternal(const BLOCKNUM_T &node,
 				    ostream &o,
 				    BTreeDisplayType display_type) const
 {
   KEY_T testkey;
-  SIZE_T ptr;
+  BLOCKNUM_T ptr;
   BTreeNode b;
   ERROR_T rc;
   SIZE_T offset;
@@ -906,7 +1522,7 @@ ERROR_T BTreeIndex::DisplayInternal(const SIZE_T &node,
     return rc;
   }
 
-  rc = PrintNode(o,node,b,display_type);
+  rc = PrintNode(o,node,b,display_type,*this);
 
   if (rc) { return rc; }
 
@@ -952,6 +1568,27 @@ ERROR_T BTreeIndex::DisplayInternal(const SIZE_T &node,
 ERROR_T BTreeIndex::Display(ostream &o, BTreeDisplayType display_type) const
 {
   ERROR_T rc;
+
+  if (display_type==BTREE_SORTED_KEYVAL) {
+    // the pairs in key order, along the leaves
+    BTreeCursor cursor;
+    KEY_T key;
+    VALUE_T value;
+    SIZE_T i;
+
+    for (rc=Seek(KEY_T(),cursor); !rc && !cursor.AtEnd(); rc=Next(cursor)) {
+      if ((rc=cursor.GetKey(key)) || (rc=cursor.GetVal(value))) {
+	return rc;
+      }
+      o << "(" << KeyToString(key) << ",";
+      for (i=0;i<value.length;i++) {
+	o << value.data[i];
+      }
+      o << ")\n";
+    }
+    return rc;
+  }
+
   if (display_type==BTREE_DEPTH_DOT) {
     o << "digraph tree { \n";
   }
@@ -968,17 +1605,37 @@ ERROR_T BTreeIndex::SanityCheck() const
   // WRITE ME
   ERROR_T rc;
   rc = SanityHelper(superblock.info.rootnode);
+  if (rc) { return rc; }
+
+  // the leaves, followed along their links, hold the keys in order
+  BTreeCursor cursor;
+  KEY_T key;
+  KEY_T lastKey;
+  bool first = true;
+
+  for (rc = Seek(KEY_T(), cursor); !rc && !cursor.AtEnd(); rc = Next(cursor))
+  {
+    rc = cursor.GetKey(key);
+    if (rc) { return rc; }
+    if (!first && !(KeyView(lastKey) < KeyView(key)))
+    {
+      cout << "Leaves not in order along their links" << endl;
+      return ERROR_INSANE;
+    }
+    lastKey = key;
+    first = false;
+  }
   return rc;
 
 }
 
-ERROR_T BTreeIndex::SanityHelper(const SIZE_T &node) const
+ERROR_T BTreeIndex::SanityHelper(const BLOCKNUM_T &node) const
 {
 
   ERROR_T rc;
   BTreeNode b;
   SIZE_T offset;
-  SIZE_T tempPtr;
+  BLOCKNUM_T tempPtr;
   KEY_T testKey;
   KEY_T tempKey;
   VALUE_T value;
@@ -988,9 +1645,9 @@ ERROR_T BTreeIndex::SanityHelper(const SIZE_T &node) const
   if (rc != ERROR_NOERROR) { return rc; }
 
   // check nodes have correct lengths
-  if (b.info.numkeys > (unsigned) (maxNumKeys))
+  if (b.IsFull())
   {
-    cout << "Current Node: " << b.info.nodetype << " has " << b.info.numkeys << " keys which is greater than the max: " << maxNumKeys << endl;
+    cout << "Current Node: " << b.info.nodetype << " has " << b.info.numkeys << " keys which is greater than the max: " << b.GetNumSlots() - 1 << endl;
   }
 
   switch (b.info.nodetype)
@@ -1007,7 +1664,7 @@ ERROR_T BTreeIndex::SanityHelper(const SIZE_T &node) const
         if (offset + 1 < b.info.numkeys - 1)
         {
           rc = b.GetKey(offset + 1, tempKey);
-          if (tempKey < testKey)
+          if (KeyView(tempKey) < KeyView(testKey))
           {
             cout << "Keys Not in Order!" << endl;
           }
@@ -1055,7 +1712,7 @@ ERROR_T BTreeIndex::SanityHelper(const SIZE_T &node) const
         // check if keys are not in order
         if(offset+1<b.info.numkeys){
           rc = b.GetKey(offset+1, tempKey);
-          if(tempKey < testKey){
+          if(KeyView(tempKey) < KeyView(testKey)){
             cout<<"The keys not in order" << endl;
           }
         }
@@ -12,6 +12,7 @@
 #include "buffercache.h"
 
 #include "btree_ds.h"
+#include "keytype.h"
 
 using namespace std;
 
@@ -34,8 +35,10 @@ struct KeyValuePair {
   KeyValuePair();
   KeyValuePair(const KEY_T &key, const VALUE_T &value);
   KeyValuePair(const KeyValuePair &rhs);
+  KeyValuePair(KeyValuePair &&rhs);
   virtual ~KeyValuePair();
   KeyValuePair & operator=(const KeyValuePair &rhs);
+  KeyValuePair & operator=(KeyValuePair &&rhs);
 
 };
 
@@ -43,29 +46,100 @@ enum BTreeOp {BTREE_OP_INSERT, BTREE_OP_DELETE, BTREE_OP_UPDATE,BTREE_OP_LOOKUP}
 
 enum BTreeDisplayType {BTREE_DEPTH, BTREE_DEPTH_DOT, BTREE_SORTED_KEYVAL};
 
+typedef unsigned long long FREEMAP_WORD_T;
+
+//
+// A position in the keys of an index, in key order (see
+// BTreeIndex::Seek).  It holds a copy of the leaf it is in, so reading
+// the key and value there does no I/O.  Any change to the index leaves
+// the cursors on it undefined; seek them again.
+//
+struct BTreeCursor {
+  BTreeNode  leaf;
+  BLOCKNUM_T block;
+  SIZE_T     offset;
+  bool       atend;
+
+  // The interior nodes from the root down to the leaf, and which
+  // pointer of each leads there.  Following a leaf's link leaves
+  // this behind, and it is found again from resume when needed: the
+  // cursor is at the first key past resume, or at resume itself if
+  // resumeinclusive.
+  vector<BLOCKNUM_T> path;
+  vector<SIZE_T>     pathoffsets;
+  bool               pathvalid;
+  KEY_T              resume;
+  bool               resumeinclusive;
+
+  BTreeCursor();
+
+  bool    AtEnd() const { return atend; }
+  ERROR_T GetKey(KEY_T &key) const;
+  ERROR_T GetVal(VALUE_T &value) const;
+};
+
+
 class BTreeIndex {
 private:
   BufferCache *buffercache;
-  SIZE_T       superblock_index;
+  BLOCKNUM_T   superblock_index;
   BTreeNode    superblock;
-  unsigned int maxNumKeys;
+  KeyType      keytype;
   bool initBlock;
 
+  // In-memory copy of the free space bitmap, one bit per block,
+  // set if the block is in use.  It is read at Attach and written
+  // back to the freemap blocks at Detach, so allocation does no I/O.
+  // It only covers blocks below the superblock's high water mark;
+  // blocks past the mark have never been used and are implicitly free.
+  vector<FREEMAP_WORD_T> freemap;
+  vector<BLOCKNUM_T> freemapblocks;  // the chain of blocks it is stored in
+  // A version 0 index has no freemap blocks.  Its free blocks are
+  // chained through their headers instead, and this has a bit set
+  // for each one on the chain as it is on disk, if the chain is in
+  // block order.  Otherwise it is empty.
+  vector<FREEMAP_WORD_T> freelistmap;
+  SIZE_T       freemaphint;  // no clear bits in words before this one
+  bool         freemapdirty;
+
+  // Holds the nodes an insert builds.  Insert releases it when it
+  // returns.  Lookups and updates work on the cache frames instead.
+  ScratchArena scratch;
+
 protected:
 
-  ERROR_T      AllocateNode(SIZE_T &node);
+  ERROR_T      AllocateNode(BLOCKNUM_T &node);
+  bool         CanAllocateNodes(const SIZE_T n) const;
+
+  ERROR_T      DeallocateNode(const BLOCKNUM_T &node);
 
-  ERROR_T      DeallocateNode(const SIZE_T &node);
+  SIZE_T       GetFreeMapWordsPerBlock() const;
+  ERROR_T      ReadFreeMap();
+  ERROR_T      WriteFreeMap();
+  ERROR_T      ReadFreeList();
+  ERROR_T      WriteFreeList();
 
-  ERROR_T      LookupOrUpdateInternal(const SIZE_T &Node,
+  ERROR_T      LookupOrUpdateInternal(const BLOCKNUM_T &Node,
     const BTreeOp op,
     const KEY_T &key,
     VALUE_T &val);
 
+  ERROR_T      InsertInternal(const KEY_T &key,
+    const VALUE_T &value,
+    ScratchArena &arena);
 
-  ERROR_T      DisplayInternal(const SIZE_T &node,
+
+  ERROR_T      DisplayInternal(const BLOCKNUM_T &node,
     ostream &o,
     const BTreeDisplayType display_type=BTREE_DEPTH) const;
+
+  // Moving cursors between leaves
+  ERROR_T      CursorDescend(const BLOCKNUM_T &node,
+    const KEY_T *key,
+    const bool last,
+    BTreeCursor &cursor) const;
+  ERROR_T      CursorStepLeaf(BTreeCursor &cursor, const bool forward, bool &moved) const;
+  ERROR_T      CursorForward(BTreeCursor &cursor) const;
 public:
   //
   // keysize and valueszie should be stored in the
@@ -76,11 +150,17 @@ public:
   // and actually write the data in the superblock.
   // otherwise, the expectation is that keysize and valuesize
   // will be zero and will be read when Attach(initialblock,false) is
-  // invoked
+  // invoked.  The same goes for format, the on-disk format version
+  // (see btree_ds.h); BTREE_FORMAT_V2 gives nodes key prefix arrays,
+  // and BTREE_FORMAT_V3 also keeps the bytes a node's keys share once.
+  // type, if it has fields, is what the keys are made of (see
+  // keytype.h), and keysize may then be 0 for its size.
   BTreeIndex(SIZE_T keysize,
     SIZE_T valuesize,
     BufferCache *cache,
-	     bool unique=true);   // true if a  key maps to a single value
+	     bool unique=true,   // true if a  key maps to a single value
+	     SIZE_T format=BTREE_FORMAT_DEFAULT,
+	     const KeyType &type=KeyType());
 
 
   BTreeIndex();
@@ -97,12 +177,21 @@ public:
   // you need to find the elements of the tree.
   // return zero on success or ERROR_NOTANINDEX if we are
   // giving you an incorrect block to start with
-  ERROR_T Attach(const SIZE_T initblock, const bool create=false );
+  ERROR_T Attach(const BLOCKNUM_T initblock, const bool create=false );
 
   // This is called after all inserts, updates, or deletes are done.
   // We expect you to tell us the number of your superblock, which
   // we will return to you on the next attach
-  ERROR_T Detach(SIZE_T &initblock);
+  ERROR_T Detach(BLOCKNUM_T &initblock);
+
+  // The key type the index was made with, read from the superblock at
+  // Attach.  MakeKey turns text into a key of this index, encoding it
+  // if the index is typed and otherwise taking its bytes, and returns
+  // ERROR_SIZE if the text is not a key of the type.  KeyToString does
+  // the reverse.
+  const KeyType &GetKeyType() const { return keytype; }
+  ERROR_T MakeKey(const string &text, KEY_T &key) const;
+  string  KeyToString(const KEY_T &key) const;
 
   // return zero on success
   // return ERROR_NOSPACE if you run out of disk space
@@ -124,6 +213,18 @@ public:
   // return ERROR_NONEXISTENT  if the key doesn't exist
   ERROR_T Lookup(const KEY_T &key, VALUE_T &value);
 
+  // Cursors.  Seek puts the cursor at the first key no smaller than
+  // key, or at the end if there is none.  Next moves it to the next
+  // key, or to the end from the last one.  Prev moves it to the key
+  // before, or to the last key from the end.  Next at the end and Prev
+  // at the first key return ERROR_NONEXISTENT and do not move it.
+  // Leaves are linked in key order, so Next reads each leaf once, in
+  // order, and a range of k keys costs one descent and k/fanout leaf
+  // reads.  Prev goes back through the nodes above.
+  ERROR_T Seek(const KEY_T &key, BTreeCursor &cursor) const;
+  ERROR_T Next(BTreeCursor &cursor) const;
+  ERROR_T Prev(BTreeCursor &cursor) const;
+
   // Here you should figure out if your index makes sense
   // Is it a tree?  Is it in order?  Is it balanced?  Does each node have
   // a valid use ratio?
@@ -145,15 +246,19 @@ public:
 
   // Find the path to the node where the passed in key should go,
   // return path as a stack of pointers.
-  ERROR_T LookupLeaf(const SIZE_T &node, const KEY_T &key, vector<SIZE_T> &path);
+  ERROR_T LookupLeaf(const BLOCKNUM_T &node, const KEY_T &key, vector<BLOCKNUM_T> &path);
+
+  // Find the path from the root to the parent of node, which the
+  // passed in key leads to.
+  ERROR_T LookupPath(const BLOCKNUM_T &node, const KEY_T &key, vector<BLOCKNUM_T> &path);
 
   // Takes a path of pointers and a node at the bottom of that path.
   // Will split the node and recursively walk up the parent path
   // guaranteeing the sanity of each parent.
-  ERROR_T Rebalance(const SIZE_T &node, vector<SIZE_T> path);
+  ERROR_T Rebalance(const BLOCKNUM_T &node, vector<BLOCKNUM_T> &path, ScratchArena &arena);
 
   //Walks the tree starting at root node. For our sanity check.
-  ERROR_T SanityHelper(const SIZE_T &node) const;
+  ERROR_T SanityHelper(const BLOCKNUM_T &node) const;
 
 };
 
@@ -11,7 +11,7 @@ int main(int argc, char **argv)
 {
   char *filestem;
   SIZE_T cachesize;
-  SIZE_T superblocknum;
+  BLOCKNUM_T superblocknum;
   char *key;
 
   if (argc!=4) { 
@@ -40,7 +40,8 @@ int main(int argc, char **argv)
     return -1;
   } else {
     cerr << "Index attached!"<<endl;
-    if ((rc=btree.Delete(KEY_T(key)))!=ERROR_NOERROR) { 
+    KEY_T k;
+    if ((rc=btree.MakeKey(key,k)) || (rc=btree.Delete(k))!=ERROR_NOERROR) { 
       cerr <<"Can't delete from index due to error "<<rc<<endl;
     } else {
       cerr <<"Delete succeeded\n";
@@ -64,6 +65,7 @@ int main(int argc, char **argv)
     cerr << endl;
     
     cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+    disk.PrintStats(cerr);
 
     return 0;
   }
@@ -12,7 +12,7 @@ int main(int argc, char **argv)
   char *filestem;
   bool dot;
   SIZE_T cachesize;
-  SIZE_T superblocknum;
+  BLOCKNUM_T superblocknum;
 
   if (argc!=4) { 
     usage();
@@ -65,6 +65,7 @@ int main(int argc, char **argv)
     cerr << endl;
     
     cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+    disk.PrintStats(cerr);
 
     return 0;
   }
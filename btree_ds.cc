@@ -1,4 +1,5 @@
 #include <new>
+#include <algorithm>
 #include <iostream>
 #include <assert.h>
 #include <string.h>
@@ -7,24 +8,125 @@
 #include "buffercache.h"
 
 #include "btree.h"
+#include "keycompare.h"
 
 using namespace std;
 
+//
+// Version 0 metadata layout, as found at the start of every block of
+// an image written before the format word was introduced.  There is
+// no high water mark, and the superblock's freelist is the first
+// block of a chain of free blocks, each naming the next in its own
+// freelist (see BTreeIndex::ReadFreeMap).
+//
+struct NodeMetadataV0 {
+  int nodetype;
+  unsigned int keysize; 
+  unsigned int valuesize;
+  unsigned int blocksize;
+  unsigned int rootnode;
+  unsigned int freelist;
+  unsigned int numkeys;
+};
+
+
+int KeyView::Compare(const KeyView &rhs) const
+{
+  int c=CompareKeyBytes(data,rhs.data,length<rhs.length ? length : rhs.length);
+
+  if (c) { 
+    return c;
+  }
+  return length<rhs.length ? -1 : length>rhs.length ? 1 : 0;
+}
+
+
+SIZE_T NodeMetadata::GetFormatVersion() const
+{
+  return format & ~BTREE_FORMAT_MAGIC;
+}
+
+SIZE_T NodeMetadata::GetHeaderSize() const
+{
+  return GetFormatVersion()==BTREE_FORMAT_V0 ? sizeof(NodeMetadataV0) : sizeof(NodeMetadata);
+}
+
+SIZE_T NodeMetadata::GetPtrSize() const
+{
+  return GetFormatVersion()==BTREE_FORMAT_V0 ? sizeof(SIZE_T) : sizeof(BLOCKNUM_T);
+}
+
+SIZE_T NodeMetadata::GetPrefixSize() const
+{
+  return GetFormatVersion()>=BTREE_FORMAT_V2 ? sizeof(KEYPREFIX_T) : 0;
+}
+
+bool NodeMetadata::HasCommonPrefix() const
+{
+  return GetFormatVersion()>=BTREE_FORMAT_V3;
+}
+
+bool NodeMetadata::HasShortSeparators() const
+{
+  return GetFormatVersion()>=BTREE_FORMAT_V4;
+}
+
+// Versions 5 and 6 are two different leaf layouts on top of version 4
+bool NodeMetadata::HasVariableRecords() const
+{
+  return GetFormatVersion()==BTREE_FORMAT_V5;
+}
+
+bool NodeMetadata::HasSplitLeaves() const
+{
+  return GetFormatVersion()==BTREE_FORMAT_V6;
+}
+
+bool NodeMetadata::HasPackedLeaves() const
+{
+  return GetFormatVersion()==BTREE_FORMAT_V7;
+}
+
 SIZE_T NodeMetadata::GetNumDataBytes() const
 {
-  SIZE_T n=blocksize-sizeof(*this);
+  SIZE_T n=blocksize-GetHeaderSize();
   return n;
 }
 
+// The length of the common bytes, then the bytes
+SIZE_T NodeMetadata::GetSlotsOffset(const SIZE_T common) const
+{
+  return HasCommonPrefix() ? sizeof(SIZE_T)+common : 0;
+}
+
 
-SIZE_T NodeMetadata::GetNumSlotsAsInterior() const
+SIZE_T NodeMetadata::GetNumSlotsAsInterior(const SIZE_T common) const
 {
-  return (GetNumDataBytes()-sizeof(SIZE_T))/(keysize+sizeof(SIZE_T));  // floor intended
+  if (HasShortSeparators()) { 
+    // the heap size, then a directory entry, a prefix and a full
+    // length key per slot
+    return (GetNumDataBytes()-GetSlotsOffset(common)-sizeof(SLOTOFF_T)-GetPtrSize())/
+      (GetPtrSize()+2*sizeof(SLOTOFF_T)+GetPrefixSize()+keysize-common);  // floor intended
+  }
+  return (GetNumDataBytes()-GetSlotsOffset(common)-GetPtrSize())/(keysize-common+GetPtrSize()+GetPrefixSize());  // floor intended
 }
 
-SIZE_T NodeMetadata::GetNumSlotsAsLeaf() const
+SIZE_T NodeMetadata::GetNumSlotsAsLeaf(const SIZE_T common) const
 {
-  return (GetNumDataBytes()-sizeof(SIZE_T))/(keysize+valuesize);  // floor intended
+  if (HasVariableRecords()) { 
+    // the heap size and the unused pointer, then a directory entry, a
+    // prefix and a full length key and value per slot
+    return (GetNumDataBytes()-GetSlotsOffset(common)-sizeof(SLOTOFF_T)-GetPtrSize())/
+      (4*sizeof(SLOTOFF_T)+GetPrefixSize()+keysize-common+valuesize);  // floor intended
+  }
+  if (HasPackedLeaves()) { 
+    // the pointer, base and width, and the 8 bytes a load can read past
+    // the last delta, then full width deltas and values.  A leaf of
+    // keys closer together has more.
+    return (GetNumDataBytes()-GetSlotsOffset()-GetPtrSize()-sizeof(unsigned long long)-sizeof(SIZE_T)-8)*8/
+      (PACKED_MAX_WIDTH+8*valuesize);  // floor intended
+  }
+  return (GetNumDataBytes()-GetSlotsOffset(common)-GetPtrSize())/(keysize-common+valuesize+GetPrefixSize());  // floor intended
 }
 
 
@@ -34,40 +136,151 @@ ostream & NodeMetadata::Print(ostream &os) const
 				   nodetype==BTREE_SUPERBLOCK ? "SUPERBLOCK" :
 				   nodetype==BTREE_ROOT_NODE ? "ROOT_NODE" :
 				   nodetype==BTREE_INTERIOR_NODE ? "INTERIOR_NODE" :
-				   nodetype==BTREE_LEAF_NODE ? "LEAF_NODE" : "UNKNOWN_TYPE")
+				   nodetype==BTREE_LEAF_NODE ? "LEAF_NODE" :
+				   nodetype==BTREE_FREEMAP_NODE ? "FREEMAP_NODE" : "UNKNOWN_TYPE")
+     << ", format="<<GetFormatVersion()
      << ", keysize="<<keysize<<", valuesize="<<valuesize<<", blocksize="<<blocksize
-     << ", rootnode="<<rootnode<<", freelist="<<freelist<<", numkeys="<<numkeys<<")";
+     << ", rootnode="<<rootnode<<", freemap="<<freemap<<", highwater="<<highwater<<", numkeys="<<numkeys<<")";
   return os;
 }
 
+//
+// Scratch arena
+//
+ScratchArena::ScratchArena(const SIZE_T chunk_size) : 
+  chunksize(chunk_size), curchunk(0), used(0), inuse(0)
+{}
+
+
+ScratchArena::~ScratchArena()
+{
+  for (SIZE_T i=0;i<chunks.size();i++) { 
+    delete [] chunks[i];
+  }
+}
+
+
+void *ScratchArena::Allocate(const SIZE_T bytes)
+{
+  // new[] gives at least 16 byte alignment, so keep every piece a
+  // multiple of 16 long
+  SIZE_T need=(bytes+15)&~(SIZE_T)15;
+
+  while (curchunk<chunks.size() && used+need>chunklens[curchunk]) { 
+    curchunk++;
+    used=0;
+  }
+  if (curchunk==chunks.size()) { 
+    SIZE_T len = need>chunksize ? need : chunksize;
+    chunks.push_back(new char [len]);
+    chunklens.push_back(len);
+    used=0;
+  }
+
+  void *p=chunks[curchunk]+used;
+  used+=need;
+  inuse+=need;
+  return p;
+}
+
+
+void ScratchArena::Release()
+{
+  curchunk=0;
+  used=0;
+  inuse=0;
+}
+
+
+SIZE_T ScratchArena::GetBytesInUse() const
+{
+  return inuse;
+}
+
+
+SIZE_T ScratchArena::GetBytesReserved() const
+{
+  SIZE_T n=0;
+  for (SIZE_T i=0;i<chunklens.size();i++) { 
+    n+=chunklens[i];
+  }
+  return n;
+}
+
+
 BTreeNode::BTreeNode() 
 {
   info.nodetype=BTREE_UNALLOCATED_BLOCK;
+  info.format=BTREE_FORMAT_MAGIC|BTREE_FORMAT_DEFAULT;
+  data=0;
+  arena=0;
+  ClearFrame();
+}
+
+BTreeNode::BTreeNode(ScratchArena *a) 
+{
+  info.nodetype=BTREE_UNALLOCATED_BLOCK;
+  info.format=BTREE_FORMAT_MAGIC|BTREE_FORMAT_DEFAULT;
   data=0;
+  arena=a;
+  ClearFrame();
 }
 
 BTreeNode::~BTreeNode()
 {
-  if (data) { 
+  Unpin();
+  FreeData();
+  info.nodetype=BTREE_UNALLOCATED_BLOCK;
+}
+
+
+void BTreeNode::ClearFrame()
+{
+  pincache=0;
+  frame=0;
+  frameblock=0;
+  framedirty=false;
+}
+
+
+void BTreeNode::AllocData()
+{
+  if (arena) { 
+    data = (char *) arena->Allocate(info.GetNumDataBytes());
+  } else {
+    data = new char [info.GetNumDataBytes()];
+  }
+}
+
+
+void BTreeNode::FreeData()
+{
+  // arena memory goes back when the arena is released, and a frame
+  // belongs to the cache
+  if (data && !arena && !frame) { 
     delete [] data;
   }
   data=0;
-  info.nodetype=BTREE_UNALLOCATED_BLOCK;
 }
 
 
-BTreeNode::BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T block_size)
+BTreeNode::BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T block_size,
+		     SIZE_T format_version, ScratchArena *a)
 {
   info.nodetype=node_type;
+  info.format=BTREE_FORMAT_MAGIC|format_version;
   info.keysize=key_size;
   info.valuesize=value_size;
   info.blocksize=block_size;
   info.rootnode=0;
-  info.freelist=0;
+  info.freemap=0;
+  info.highwater=0;
   info.numkeys=0;				       
   data=0;
-  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) {
-    data = new char [info.GetNumDataBytes()];
+  arena=a;
+  ClearFrame();
+  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK) {
+    AllocData();
     memset(data,0,info.GetNumDataBytes());
   }
 }
@@ -75,233 +288,1401 @@ BTreeNode::BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T b
 BTreeNode::BTreeNode(const BTreeNode &rhs) 
 {
   info.nodetype=rhs.info.nodetype;
+  info.format=rhs.info.format;
   info.keysize=rhs.info.keysize;
   info.valuesize=rhs.info.valuesize;
   info.blocksize=rhs.info.blocksize;
   info.rootnode=rhs.info.rootnode;
-  info.freelist=rhs.info.freelist;
+  info.freemap=rhs.info.freemap;
+  info.highwater=rhs.info.highwater;
   info.numkeys=rhs.info.numkeys;				       
   data=0;
+  arena=0;
+  ClearFrame();
   if (rhs.data) { 
-   data=new char [info.GetNumDataBytes()];
+    AllocData();
     memcpy(data,rhs.data,info.GetNumDataBytes());
   }
 }
 
 
+BTreeNode::BTreeNode(BTreeNode &&rhs) 
+{
+  info=rhs.info;
+  data=rhs.data;
+  arena=rhs.arena;
+  pincache=rhs.pincache;
+  frame=rhs.frame;
+  frameblock=rhs.frameblock;
+  framedirty=rhs.framedirty;
+  rhs.data=0;
+  rhs.ClearFrame();
+}
+
+
 BTreeNode & BTreeNode::operator=(const BTreeNode &rhs) 
 {
-  return *(new (this) BTreeNode(rhs));
+  if (this==&rhs) { 
+    return *this;
+  }
+  Unpin();
+  if (data && (!rhs.data || info.GetNumDataBytes()!=rhs.info.GetNumDataBytes())) { 
+    FreeData();
+  }
+  info=rhs.info;
+  if (rhs.data) { 
+    if (!data) { 
+      AllocData();
+    }
+    memcpy(data,rhs.data,info.GetNumDataBytes());
+  }
+  return *this;
+}
+
+
+BTreeNode & BTreeNode::operator=(BTreeNode &&rhs) 
+{
+  if (this==&rhs) { 
+    return *this;
+  }
+  Unpin();
+  FreeData();
+  info=rhs.info;
+  data=rhs.data;
+  arena=rhs.arena;
+  pincache=rhs.pincache;
+  frame=rhs.frame;
+  frameblock=rhs.frameblock;
+  framedirty=rhs.framedirty;
+  rhs.data=0;
+  rhs.ClearFrame();
+  return *this;
 }
 
 
-ERROR_T BTreeNode::Serialize(BufferCache *b, const SIZE_T blocknum) const
+ERROR_T BTreeNode::Serialize(BufferCache *b, const BLOCKNUM_T blocknum) const
 {
   assert((unsigned)info.blocksize==b->GetBlockSize());
 
-  Block block(sizeof(info)+info.GetNumDataBytes());
+  Block local;
+  Block &block = arena ? arena->block : local;
 
-  memcpy(block.data,&info,sizeof(info));
-  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) { 
-    memcpy(block.data+sizeof(info),data,info.GetNumDataBytes());
+  block.Resize(info.GetHeaderSize()+info.GetNumDataBytes(),false);
+
+  WriteHeader(block.data);
+  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK) { 
+    memcpy(block.data+info.GetHeaderSize(),data,info.GetNumDataBytes());
   }
 
   return b->WriteBlock(blocknum,block);
 }
 
 
-ERROR_T  BTreeNode::Unserialize(BufferCache *b, const SIZE_T blocknum)
+ERROR_T  BTreeNode::Unserialize(BufferCache *b, const BLOCKNUM_T blocknum)
 {
-  Block block;
+  Block local;
 
+  return Unserialize(b,blocknum,arena ? arena->block : local);
+}
+
+
+ERROR_T  BTreeNode::Unserialize(BufferCache *b, const BLOCKNUM_T blocknum, Block &block)
+{
   ERROR_T rc;
 
+  // don't read a copy over the frame
+  rc=Unpin();
+
+  if (rc!=ERROR_NOERROR) {
+    return rc;
+  }
+
+  SIZE_T olddatabytes = data ? info.GetNumDataBytes() : 0;
+
   rc=b->ReadBlock(blocknum,block);
 
   if (rc!=ERROR_NOERROR) {
     return rc;
   }
 
-  memcpy(&info,block.data,sizeof(info));
+  rc=ReadHeader(block.data);
   
-  if (data) { 
-    delete [] data;
-    data=0;
+  if (data && (rc!=ERROR_NOERROR ||
+	       info.nodetype==BTREE_UNALLOCATED_BLOCK || 
+	       info.GetNumDataBytes()!=olddatabytes)) { 
+    FreeData();
+  }
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
   }
 
   assert(b->GetBlockSize()==(unsigned)info.blocksize);
 
-  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) {
-    data = new char [info.GetNumDataBytes()];
-    memcpy(data,block.data+sizeof(info),info.GetNumDataBytes());
+  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK) {
+    if (!data) { 
+      AllocData();
+    }
+    memcpy(data,block.data+info.GetHeaderSize(),info.GetNumDataBytes());
   }
   
   return ERROR_NOERROR;
 }
 
 
-char * BTreeNode::ResolveKey(const SIZE_T offset) const
+ERROR_T BTreeNode::Pin(BufferCache *b, const BLOCKNUM_T blocknum)
 {
-  switch (info.nodetype) { 
-  case BTREE_INTERIOR_NODE:
-  case BTREE_ROOT_NODE:
-    assert(offset<info.numkeys);
-    return data+sizeof(SIZE_T)+offset*(sizeof(SIZE_T)+info.keysize);
-    break;
-  case BTREE_LEAF_NODE:
-    assert(offset<info.numkeys);
-    return data+sizeof(SIZE_T)+offset*(info.keysize+info.valuesize);
-    break;
-  default:
-    return 0;
-  }
-}
+  ERROR_T rc;
+  Block *f;
 
+  rc=Unpin();
 
-char * BTreeNode::ResolvePtr(const SIZE_T offset) const
-{
-  switch (info.nodetype) { 
-  case BTREE_INTERIOR_NODE:
-  case BTREE_ROOT_NODE:
-    assert(offset<=info.numkeys);
-    return data+offset*(sizeof(SIZE_T)+info.keysize);
-    break;
-  case BTREE_LEAF_NODE:
-    assert(offset==0);
-    return data;
-    break;
-  default:
-    return 0;
+  if (rc!=ERROR_NOERROR) {
+    return rc;
   }
-}
 
+  FreeData();
 
+  rc=b->PinBlock(blocknum,f);
 
-char * BTreeNode::ResolveVal(const SIZE_T offset) const
-{
-  switch (info.nodetype) { 
-  case BTREE_LEAF_NODE:
-    assert(offset<info.numkeys);
-    return data+sizeof(SIZE_T)+offset*(info.keysize+info.valuesize)+info.keysize;
-    break;
-  default:
-    return 0;
+  if (rc!=ERROR_NOERROR) {
+    return rc;
   }
-}
 
+  rc=ReadHeader(f->data);
 
+  if (rc!=ERROR_NOERROR) {
+    b->UnpinBlock(blocknum);
+    return rc;
+  }
 
-char * BTreeNode::ResolveKeyVal(const SIZE_T offset) const
-{
-  return ResolveKey(offset);
-}
+  assert(b->GetBlockSize()==(unsigned)info.blocksize);
 
-ERROR_T BTreeNode::GetKey(const SIZE_T offset, KEY_T &k) const
-{
-  char *p=ResolveKey(offset);
+  pincache=b;
+  frame=f;
+  frameblock=blocknum;
+  framedirty=false;
 
-  if (p==0) { 
-    return ERROR_NOMEM;
+  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK) {
+    data=(char *)frame->data+info.GetHeaderSize();
   }
-  
-  k.Resize(info.keysize,false);
-  memcpy(k.data,p,info.keysize);
+
   return ERROR_NOERROR;
 }
 
-ERROR_T BTreeNode::GetPtr(const SIZE_T offset, SIZE_T &ptr) const
+
+ERROR_T BTreeNode::Unpin()
 {
-  char *p=ResolvePtr(offset);
+  if (!frame) { 
+    return ERROR_NOERROR;
+  }
 
-  if (p==0) { 
-    return ERROR_NOMEM;
+  if (framedirty) { 
+    WriteHeader(frame->data);
   }
-  
-  memcpy(&ptr,p,sizeof(SIZE_T));
-  return ERROR_NOERROR;
+
+  ERROR_T rc=pincache->UnpinBlock(frameblock,framedirty);
+
+  data=0;
+  ClearFrame();
+
+  return rc;
 }
 
-ERROR_T BTreeNode::GetVal(const SIZE_T offset, VALUE_T &v) const
+
+// Fills in info from the metadata at the start of a block
+ERROR_T BTreeNode::ReadHeader(const BYTE_T *header)
 {
-  char *p=ResolveVal(offset);
+  // A version 0 block has its key size where later versions have
+  // the format word
+  SIZE_T format;
+  memcpy(&format,header+sizeof(int),sizeof(format));
+
+  if ((format&0xffff0000)!=BTREE_FORMAT_MAGIC) { 
+    NodeMetadataV0 old;
+    memcpy(&old,header,sizeof(old));
+    info.nodetype=old.nodetype;
+    info.format=BTREE_FORMAT_MAGIC|BTREE_FORMAT_V0;
+    info.keysize=old.keysize;
+    info.valuesize=old.valuesize;
+    info.blocksize=old.blocksize;
+    info.rootnode=old.rootnode;
+    info.freemap=old.freelist;
+    info.highwater=0;
+    info.numkeys=old.numkeys;
+  } else {
+    memcpy(&info,header,sizeof(info));
+  }
 
-  if (p==0) { 
-    return ERROR_NOMEM;
+  if (info.GetFormatVersion()>BTREE_FORMAT_CURRENT) { 
+    // written by a newer version of this code
+    return ERROR_NOTANINDEX;
   }
-  
-  v.Resize(info.valuesize,false);
-  memcpy(v.data,p,info.valuesize);
+
   return ERROR_NOERROR;
 }
 
 
-ERROR_T BTreeNode::GetKeyVal(const SIZE_T offset, KeyValuePair &p) const
+// Stores info at the start of a block, in the node's format
+void BTreeNode::WriteHeader(BYTE_T *header) const
 {
-  ERROR_T rc= GetKey(offset,p.key);
-
-  if (rc!=ERROR_NOERROR) { 
-    return rc; 
+  if (info.GetFormatVersion()==BTREE_FORMAT_V0) { 
+    NodeMetadataV0 old;
+    old.nodetype=info.nodetype;
+    old.keysize=info.keysize;
+    old.valuesize=info.valuesize;
+    old.blocksize=info.blocksize;
+    old.rootnode=info.rootnode;
+    old.freelist=info.freemap;
+    old.numkeys=info.numkeys;
+    memcpy(header,&old,sizeof(old));
   } else {
-    return GetVal(offset,p.value);
+    memcpy(header,&info,sizeof(info));
   }
 }
 
 
-ERROR_T BTreeNode::SetKey(const SIZE_T offset, const KEY_T &k)
+SIZE_T BTreeNode::GetCommonPrefixLength() const
 {
-  char *p=ResolveKey(offset);
+  SIZE_T n=0;
 
-  if (p==0) { 
-    return ERROR_NOMEM;
+  switch (info.nodetype) { 
+  case BTREE_INTERIOR_NODE:
+  case BTREE_ROOT_NODE:
+  case BTREE_LEAF_NODE:
+    if (info.HasCommonPrefix()) { 
+      memcpy(&n,data,sizeof(n));
+    }
+    return n;
+  default:
+    return 0;
   }
+}
 
-  memcpy(p,k.data,info.keysize);
 
-  return ERROR_NOERROR;
+char * BTreeNode::ResolveCommonPrefix() const
+{
+  switch (info.nodetype) { 
+  case BTREE_INTERIOR_NODE:
+  case BTREE_ROOT_NODE:
+  case BTREE_LEAF_NODE:
+    return info.HasCommonPrefix() ? data+sizeof(SIZE_T) : 0;
+  default:
+    return 0;
+  }
 }
 
 
-ERROR_T BTreeNode::SetPtr(const SIZE_T offset, const SIZE_T &ptr)
+ERROR_T BTreeNode::SetCommonPrefix(const KeyView &k, const SIZE_T length)
 {
-  char *p=ResolvePtr(offset);
+  char *p=ResolveCommonPrefix();
 
-  if (p==0) { 
-    return ERROR_NOMEM;
+  if (IsPacked() && info.numkeys==0) { 
+    // its deltas leave out what its keys have in common anyway
+    return ERROR_NOERROR;
   }
 
-  memcpy(p,&ptr,sizeof(SIZE_T));
+  if (p==0 || info.numkeys!=0) { 
+    return ERROR_INSANE;
+  }
+  if (length>=info.keysize || length>k.length) { 
+    return ERROR_SIZE;
+  }
 
+  memcpy(data,&length,sizeof(length));
+  memcpy(p,k.data,length);
   return ERROR_NOERROR;
 }
 
 
+// Past the common bytes, if the node keeps any
+char * BTreeNode::ResolveSlots() const
+{
+  return data+info.GetSlotsOffset(GetCommonPrefixLength());
+}
 
-ERROR_T BTreeNode::SetVal(const SIZE_T offset, const VALUE_T &v)
+
+// What is left of each key in its slot
+SIZE_T BTreeNode::GetStoredKeySize() const
 {
-  char *p=ResolveVal(offset);
-  
-  if (p==0) { 
-    return ERROR_NOMEM;
-  }
-  
-  memcpy(p,v.data,info.valuesize);
-  
-  return ERROR_NOERROR;
+  return info.keysize-GetCommonPrefixLength();
 }
 
 
-ERROR_T BTreeNode::SetKeyVal(const SIZE_T offset, const KeyValuePair &p)
+// The same for one key, which can be shorter in a version 4 interior
+// node or a version 5 leaf
+SIZE_T BTreeNode::GetStoredKeyLength(const SIZE_T offset) const
 {
-  ERROR_T rc=SetKey(offset,p.key);
+  if (IsSlotted()) { 
+    SLOTOFF_T n;
+    memcpy(&n,ResolveKeyField(offset)+sizeof(SLOTOFF_T),sizeof(n));
+    return n;
+  }
+  return GetStoredKeySize();
+}
 
-  if (rc!=ERROR_NOERROR) { 
-    return rc;
-  } else {
-    return SetVal(offset,p.value);
+
+SIZE_T BTreeNode::GetStoredValLength(const SIZE_T offset) const
+{
+  if (IsSlotted()) { 
+    SLOTOFF_T n;
+    memcpy(&n,ResolveValField(offset)+sizeof(SLOTOFF_T),sizeof(n));
+    return n;
   }
+  return info.valuesize;
 }
 
 
+bool BTreeNode::IsSlotted() const
+{
+  switch (info.nodetype) { 
+  case BTREE_INTERIOR_NODE:
+  case BTREE_ROOT_NODE:
+    return info.HasShortSeparators();
+  case BTREE_LEAF_NODE:
+    return info.HasVariableRecords();
+  default:
+    return false;
+  }
+}
+
+
+SIZE_T BTreeNode::GetEntrySize() const
+{
+  if (info.nodetype==BTREE_LEAF_NODE) { 
+    return 4*sizeof(SLOTOFF_T);
+  }
+  return info.GetPtrSize()+2*sizeof(SLOTOFF_T);
+}
+
+
+char * BTreeNode::ResolveEntry(const SIZE_T offset) const
+{
+  return ResolveSlots()+sizeof(SLOTOFF_T)+info.GetPtrSize()+offset*GetEntrySize();
+}
+
+
+// An interior entry starts with its pointer
+char * BTreeNode::ResolveKeyField(const SIZE_T offset) const
+{
+  return ResolveEntry(offset)+(info.nodetype==BTREE_LEAF_NODE ? 0 : info.GetPtrSize());
+}
+
+
+char * BTreeNode::ResolveValField(const SIZE_T offset) const
+{
+  assert(info.nodetype==BTREE_LEAF_NODE);
+  return ResolveEntry(offset)+2*sizeof(SLOTOFF_T);
+}
+
+
+SIZE_T BTreeNode::GetHeapBytes() const
+{
+  SLOTOFF_T n;
+  memcpy(&n,ResolveSlots(),sizeof(n));
+  return n;
+}
+
+
+void BTreeNode::SetHeapBytes(const SIZE_T n)
+{
+  SLOTOFF_T used=n;
+  memcpy(ResolveSlots(),&used,sizeof(used));
+}
+
+
+// Between the last prefix and the keys
+SIZE_T BTreeNode::GetFreeBytes() const
+{
+  char *end=ResolveEntry(info.numkeys)+info.numkeys*info.GetPrefixSize();
+
+  return data+info.GetNumDataBytes()-GetHeapBytes()-end;
+}
+
+
+// Takes n bytes off the bottom of the heap, compacting it first if
+// that makes room, and 0 if nothing does
+char * BTreeNode::AllocateBytes(const SIZE_T n)
+{
+  if (GetFreeBytes()<n) { 
+    Compact();
+  }
+  if (GetFreeBytes()<n) { 
+    return 0;
+  }
+
+  SetHeapBytes(GetHeapBytes()+n);
+  return data+info.GetNumDataBytes()-GetHeapBytes();
+}
+
+
+// Packs the bytes the directory still points at against the end of
+// the block, which gives back those of replaced keys and values.
+// Going from the highest offset down, each piece only moves up, onto
+// bytes already moved or no longer used.
+void BTreeNode::Compact()
+{
+  vector<pair<SIZE_T,char *> > pieces;
+  SLOTOFF_T off, len;
+
+  for (SIZE_T i=0;i<info.numkeys;i++) { 
+    pieces.push_back(make_pair((SIZE_T)0,ResolveKeyField(i)));
+    if (info.nodetype==BTREE_LEAF_NODE) { 
+      pieces.push_back(make_pair((SIZE_T)0,ResolveValField(i)));
+    }
+  }
+  for (SIZE_T i=0;i<pieces.size();i++) { 
+    memcpy(&off,pieces[i].second,sizeof(off));
+    pieces[i].first=off;
+  }
+  sort(pieces.rbegin(),pieces.rend());
+
+  SIZE_T top=info.GetNumDataBytes();
+
+  for (SIZE_T i=0;i<pieces.size();i++) { 
+    memcpy(&off,pieces[i].second,sizeof(off));
+    memcpy(&len,pieces[i].second+sizeof(off),sizeof(len));
+    if (len==0) { 
+      continue;
+    }
+    top-=len;
+    memmove(data+top,data+off,len);
+    off=top;
+    memcpy(pieces[i].second,&off,sizeof(off));
+  }
+  SetHeapBytes(info.GetNumDataBytes()-top);
+}
+
+
+// A key of a version 7 leaf is the integer its bytes make, big endian,
+// as if padded with zeros to the key size
+static unsigned long long PackedKeyOf(const KeyView &k, const SIZE_T keysize)
+{
+  unsigned long long x=0;
+
+  for (SIZE_T i=0;i<keysize;i++) { 
+    x = (x<<8) | (i<k.length ? k.data[i] : 0);
+  }
+  return x;
+}
+
+
+bool BTreeNode::IsPacked() const
+{
+  return info.nodetype==BTREE_LEAF_NODE && info.HasPackedLeaves();
+}
+
+
+// After the link
+unsigned long long BTreeNode::GetPackedBase() const
+{
+  unsigned long long base;
+  memcpy(&base,ResolveSlots()+info.GetPtrSize(),sizeof(base));
+  return base;
+}
+
+
+SIZE_T BTreeNode::GetPackedWidth() const
+{
+  SIZE_T width;
+  memcpy(&width,ResolveSlots()+info.GetPtrSize()+sizeof(unsigned long long),sizeof(width));
+  return width;
+}
+
+
+BYTE_T * BTreeNode::ResolvePackedDeltas() const
+{
+  return (BYTE_T *)ResolveSlots()+info.GetPtrSize()+sizeof(unsigned long long)+sizeof(SIZE_T);
+}
+
+
+// Keys the leaf has room for, with their values, were its deltas
+// width bits wide.  The 8 bytes after the last delta are kept free for
+// the load that reads it.
+SIZE_T BTreeNode::GetPackedSlots(const SIZE_T width) const
+{
+  SIZE_T bytes=data+info.GetNumDataBytes()-(char *)ResolvePackedDeltas()-8;
+  SIZE_T bits=width+8*info.valuesize;
+
+  return bits ? bytes*8/bits : bytes*8;
+}
+
+
+unsigned long long BTreeNode::GetPackedKey(const SIZE_T offset) const
+{
+  return GetPackedBase()+GetPackedDelta(ResolvePackedDeltas(),GetPackedWidth(),offset);
+}
+
+
+// Makes keys, which need not be sorted, the keys of the leaf, with the
+// smallest as the base.  The values are left where they are.  The leaf
+// is unchanged if they do not fit.
+ERROR_T BTreeNode::RepackKeys(const vector<unsigned long long> &keys)
+{
+  unsigned long long lo=0, hi=0;
+
+  if (!keys.empty()) { 
+    lo=*min_element(keys.begin(),keys.end());
+    hi=*max_element(keys.begin(),keys.end());
+  }
+
+  SIZE_T width=GetDeltaWidth(hi-lo);
+
+  if (keys.size()>GetPackedSlots(width)) { 
+    return ERROR_SIZE;
+  }
+
+  char *p=ResolveSlots()+info.GetPtrSize();
+  BYTE_T *deltas=ResolvePackedDeltas();
+
+  memcpy(p,&lo,sizeof(lo));
+  memcpy(p+sizeof(lo),&width,sizeof(width));
+  for (SIZE_T i=0;i<keys.size();i++) { 
+    PutPackedDelta(deltas,width,i,keys[i]-lo);
+  }
+  return ERROR_NOERROR;
+}
+
+
+char * BTreeNode::ResolveKey(const SIZE_T offset) const
+{
+  switch (info.nodetype) { 
+  case BTREE_INTERIOR_NODE:
+  case BTREE_ROOT_NODE:
+    assert(offset<info.numkeys);
+    if (IsSlotted()) { 
+      SLOTOFF_T off;
+      memcpy(&off,ResolveKeyField(offset),sizeof(off));
+      return data+off;
+    }
+    return ResolveSlots()+info.GetPtrSize()+offset*(info.GetPtrSize()+GetStoredKeySize());
+    break;
+  case BTREE_LEAF_NODE:
+    assert(offset<info.numkeys);
+    if (IsSlotted()) { 
+      SLOTOFF_T off;
+      memcpy(&off,ResolveKeyField(offset),sizeof(off));
+      return data+off;
+    }
+    if (info.HasSplitLeaves()) { 
+      return ResolveSlots()+info.GetPtrSize()+offset*GetStoredKeySize();
+    }
+    if (IsPacked()) { 
+      // a packed key has no bytes of its own to point at
+      return 0;
+    }
+    return ResolveSlots()+info.GetPtrSize()+offset*(GetStoredKeySize()+info.valuesize);
+    break;
+  default:
+    return 0;
+  }
+}
+
+
+char * BTreeNode::ResolvePtr(const SIZE_T offset) const
+{
+  switch (info.nodetype) { 
+  case BTREE_INTERIOR_NODE:
+  case BTREE_ROOT_NODE:
+    assert(offset<=info.numkeys);
+    if (IsSlotted()) { 
+      return offset==0 ? ResolveSlots()+sizeof(SLOTOFF_T) : ResolveEntry(offset-1);
+    }
+    return ResolveSlots()+offset*(info.GetPtrSize()+GetStoredKeySize());
+    break;
+  case BTREE_LEAF_NODE:
+    assert(offset==0);
+    if (IsSlotted()) { 
+      return ResolveSlots()+sizeof(SLOTOFF_T);
+    }
+    return ResolveSlots();
+    break;
+  default:
+    return 0;
+  }
+}
+
+
+
+char * BTreeNode::ResolveVal(const SIZE_T offset) const
+{
+  switch (info.nodetype) { 
+  case BTREE_LEAF_NODE:
+    assert(offset<info.numkeys);
+    if (IsSlotted()) { 
+      SLOTOFF_T off;
+      memcpy(&off,ResolveValField(offset),sizeof(off));
+      return data+off;
+    }
+    if (info.HasSplitLeaves()) { 
+      return ResolveSlots()+info.GetPtrSize()+GetNumSlots()*GetStoredKeySize()+offset*info.valuesize;
+    }
+    if (IsPacked()) { 
+      return data+info.GetNumDataBytes()-(info.numkeys-offset)*info.valuesize;
+    }
+    return ResolveSlots()+info.GetPtrSize()+offset*(GetStoredKeySize()+info.valuesize)+GetStoredKeySize();
+    break;
+  default:
+    return 0;
+  }
+}
+
+
+
+char * BTreeNode::ResolveKeyVal(const SIZE_T offset) const
+{
+  return ResolveKey(offset);
+}
+
+
+SIZE_T BTreeNode::GetNumSlots() const
+{
+  switch (info.nodetype) { 
+  case BTREE_INTERIOR_NODE:
+  case BTREE_ROOT_NODE:
+    if (IsSlotted()) { 
+      return info.numkeys+GetFreeBytes()/(GetEntrySize()+info.GetPrefixSize()+GetStoredKeySize());
+    }
+    return info.GetNumSlotsAsInterior(GetCommonPrefixLength());
+  case BTREE_LEAF_NODE:
+    if (IsSlotted()) { 
+      return info.numkeys+GetFreeBytes()/
+	(GetEntrySize()+info.GetPrefixSize()+GetStoredKeySize()+info.valuesize);
+    }
+    if (IsPacked()) { 
+      return GetPackedSlots(GetPackedWidth());
+    }
+    return info.GetNumSlotsAsLeaf(GetCommonPrefixLength());
+  default:
+    return 0;
+  }
+}
+
+
+bool BTreeNode::IsFull()
+{
+  if (IsSlotted() && info.numkeys>=GetNumSlots()) { 
+    Compact();
+  }
+  return info.numkeys>=GetNumSlots();
+}
+
+
+SIZE_T BTreeNode::GetSlotBytes(const SIZE_T offset) const
+{
+  SIZE_T bytes=info.GetPrefixSize();
+
+  if (IsSlotted()) { 
+    bytes+=GetEntrySize()+GetStoredKeyLength(offset);
+    if (info.nodetype==BTREE_LEAF_NODE) { 
+      bytes+=GetStoredValLength(offset);
+    }
+    return bytes;
+  }
+  if (IsPacked()) { 
+    return (GetPackedWidth()+7)/8+info.valuesize;
+  }
+  if (info.nodetype==BTREE_LEAF_NODE) { 
+    return bytes+GetStoredKeySize()+info.valuesize;
+  }
+  return bytes+GetStoredKeySize()+info.GetPtrSize();
+}
+
+
+char * BTreeNode::ResolvePrefix(const SIZE_T offset) const
+{
+  SIZE_T size=info.GetPrefixSize();
+
+  if (size==0 || IsPacked()) { 
+    return 0;
+  }
+
+  SIZE_T slots=GetNumSlots();
+
+  if (slots==0) { 
+    return 0;
+  }
+  if (IsSlotted()) { 
+    assert(offset<info.numkeys);
+    return ResolveEntry(info.numkeys)+offset*size;
+  }
+  assert(offset<slots);
+  return data+info.GetNumDataBytes()-slots*size+offset*size;
+}
+
+ERROR_T BTreeNode::GetKey(const SIZE_T offset, KEY_T &k) const
+{
+  if (IsPacked()) { 
+    assert(offset<info.numkeys);
+    unsigned long long x=GetPackedKey(offset);
+    k.Resize(info.keysize,false);
+    for (SIZE_T i=info.keysize;i>0;i--) { 
+      k.data[i-1]=(BYTE_T)x;
+      x>>=8;
+    }
+    return ERROR_NOERROR;
+  }
+
+  char *p=ResolveKey(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  
+  SIZE_T common=GetCommonPrefixLength();
+  SIZE_T length=GetStoredKeyLength(offset);
+
+  k.Resize(common+length,false);
+  if (common) { 
+    memcpy(k.data,ResolveCommonPrefix(),common);
+  }
+  memcpy(k.data+common,p,length);
+  return ERROR_NOERROR;
+}
+
+ERROR_T BTreeNode::GetKey(const SIZE_T offset, KeyView &k) const
+{
+  if (IsPacked()) { 
+    // the key is not stored as bytes at all
+    return ERROR_INSANE;
+  }
+
+  char *p=ResolveKey(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  if (GetCommonPrefixLength()) { 
+    // only the rest of the key is here
+    return ERROR_INSANE;
+  }
+  
+  k=KeyView((const BYTE_T *)p,GetStoredKeyLength(offset));
+  return ERROR_NOERROR;
+}
+
+
+// Offset of the first key for which key.Compare(k)<limit fails
+SIZE_T BTreeNode::SearchKeys(const KeyView &fullkey, const int limit) const
+{
+  SIZE_T n=info.numkeys;
+
+  if (n==0 || GetNumSlots()==0) { 
+    return 0;
+  }
+
+  if (IsPacked()) { 
+    // Keys compare as their integers do, except with a fullkey of
+    // another length.  One shorter sorts before the keys it pads out
+    // to, and one longer after the key it is cut to, so a search for
+    // either is one for the first integer no smaller, or for the first
+    // larger.
+    unsigned long long t=PackedKeyOf(fullkey,info.keysize);
+    bool after = fullkey.length>info.keysize || (fullkey.length==info.keysize && limit>0);
+
+    if (after) { 
+      if (t==~0ull) { 
+	return n;
+      }
+      t++;
+    }
+
+    unsigned long long base=GetPackedBase();
+    SIZE_T width=GetPackedWidth();
+
+    if (t<=base) { 
+      return 0;
+    }
+    if (width<PACKED_MAX_WIDTH && ((t-base)>>width)!=0) { 
+      // past every delta
+      return n;
+    }
+    return SearchPacked(ResolvePackedDeltas(),width,n,t-base);
+  }
+
+  // k either sorts outside all the keys on the bytes they have in
+  // common, or the search goes on with the rest of it
+  SIZE_T common=GetCommonPrefixLength();
+  KeyView k(fullkey);
+
+  if (common) { 
+    int c=CompareKeyBytes((const BYTE_T *)ResolveCommonPrefix(),fullkey.data,
+			  common<fullkey.length ? common : fullkey.length);
+    if (c<0) { 
+      return n;
+    }
+    if (c>0 || fullkey.length<common) { 
+      return 0;
+    }
+    k=KeyView(fullkey.data+common,fullkey.length-common);
+  }
+
+  if (!info.GetPrefixSize()) { 
+    return SearchKeyRange(k,limit,0,n);
+  }
+
+  // Keys are ordered by their prefixes where those differ, so only the
+  // keys that share k's prefix have to be compared in full
+  const BYTE_T *p=(const BYTE_T *)ResolvePrefix(0);
+  KEYPREFIX_T q=MakeKeyPrefix(k.data,k.length);
+  KEYPREFIX_T x;
+  SIZE_T lo=SearchPrefixes(p,n,q);
+
+  if (lo==n) { 
+    return lo;
+  }
+  memcpy(&x,p+lo*sizeof(x),sizeof(x));
+  if (x!=q) { 
+    return lo;
+  }
+
+  SIZE_T hi = q==(KEYPREFIX_T)~0 ? n : lo+SearchPrefixes(p+lo*sizeof(x),n-lo,q+1);
+
+  return SearchKeyRange(k,limit,lo,hi-lo);
+}
+
+
+// The same over the n keys from base on.  The keys are a fixed stride
+// apart.  Each step halves the range and picks a half with a
+// conditional move rather than a branch, so that search does not pay
+// for mispredicted branches.
+SIZE_T BTreeNode::SearchKeyRange(const KeyView &k, const int limit, SIZE_T base, SIZE_T n) const
+{
+  SIZE_T stride;
+
+  SIZE_T keysize=GetStoredKeySize();
+
+  switch (info.nodetype) { 
+  case BTREE_INTERIOR_NODE:
+  case BTREE_ROOT_NODE:
+    stride=info.GetPtrSize()+keysize;
+    break;
+  case BTREE_LEAF_NODE:
+    stride = info.HasSplitLeaves() ? keysize : keysize+info.valuesize;
+    break;
+  default:
+    return 0;
+  }
+
+  if (n==0) { 
+    return base;
+  }
+
+  if (IsSlotted()) { 
+    // the same, but with each key found through the directory
+    while (n>1) { 
+      SIZE_T half=n/2;
+      KeyView key((const BYTE_T *)ResolveKey(base+half),GetStoredKeyLength(base+half));
+      base = key.Compare(k)<limit ? base+half : base;
+      n-=half;
+    }
+
+    KeyView key((const BYTE_T *)ResolveKey(base),GetStoredKeyLength(base));
+    return base + (key.Compare(k)<limit);
+  }
+
+  const BYTE_T *keys=(const BYTE_T *)ResolveSlots()+info.GetPtrSize();
+
+  while (n>1) { 
+    SIZE_T half=n/2;
+    KeyView key(keys+(base+half)*stride,keysize);
+    base = key.Compare(k)<limit ? base+half : base;
+    n-=half;
+  }
+
+  KeyView key(keys+base*stride,keysize);
+  return base + (key.Compare(k)<limit);
+}
+
+
+SIZE_T BTreeNode::LowerBound(const KeyView &k) const
+{
+  return SearchKeys(k,0);
+}
+
+
+SIZE_T BTreeNode::UpperBound(const KeyView &k) const
+{
+  return SearchKeys(k,1);
+}
+
+
+int BTreeNode::CompareKey(const SIZE_T offset, const KeyView &k) const
+{
+  if (IsPacked()) { 
+    unsigned long long x=GetPackedKey(offset);
+    unsigned long long t=PackedKeyOf(k,info.keysize);
+
+    if (x!=t) { 
+      return x<t ? -1 : 1;
+    }
+    // as in SearchKeys
+    return k.length<info.keysize ? 1 : k.length>info.keysize ? -1 : 0;
+  }
+
+  SIZE_T common=GetCommonPrefixLength();
+  KeyView key((const BYTE_T *)ResolveKey(offset),GetStoredKeyLength(offset));
+
+  if (common) { 
+    int c=CompareKeyBytes((const BYTE_T *)ResolveCommonPrefix(),k.data,
+			  common<k.length ? common : k.length);
+    if (c) { 
+      return c;
+    }
+    if (k.length<common) { 
+      // k is a proper prefix of the key
+      return 1;
+    }
+    return key.Compare(KeyView(k.data+common,k.length-common));
+  }
+  return key.Compare(k);
+}
+
+
+ERROR_T BTreeNode::GetPtr(const SIZE_T offset, BLOCKNUM_T &ptr) const
+{
+  char *p=ResolvePtr(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  
+  if (info.GetPtrSize()==sizeof(SIZE_T)) { 
+    SIZE_T narrow;
+    memcpy(&narrow,p,sizeof(narrow));
+    ptr=narrow;
+  } else {
+    memcpy(&ptr,p,sizeof(BLOCKNUM_T));
+  }
+  return ERROR_NOERROR;
+}
+
+ERROR_T BTreeNode::GetVal(const SIZE_T offset, VALUE_T &v) const
+{
+  char *p=ResolveVal(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  
+  SIZE_T length=GetStoredValLength(offset);
+
+  v.Resize(length,false);
+  memcpy(v.data,p,length);
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T BTreeNode::GetKeyVal(const SIZE_T offset, KeyValuePair &p) const
+{
+  ERROR_T rc= GetKey(offset,p.key);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc; 
+  } else {
+    return GetVal(offset,p.value);
+  }
+}
+
+
+ERROR_T BTreeNode::SetKey(const SIZE_T offset, const KEY_T &k)
+{
+  return SetKey(offset,KeyView(k));
+}
+
+
+ERROR_T BTreeNode::SetKey(const SIZE_T offset, const KeyView &k)
+{
+  if (IsPacked()) { 
+    // the other keys may have to be repacked around it
+    if (offset>=info.numkeys || k.length!=info.keysize) { 
+      return ERROR_INSANE;
+    }
+    vector<unsigned long long> keys(info.numkeys);
+    for (SIZE_T i=0;i<info.numkeys;i++) { 
+      keys[i]=GetPackedKey(i);
+    }
+    keys[offset]=PackedKeyOf(k,info.keysize);
+    return RepackKeys(keys);
+  }
+
+  char *p=ResolveKey(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+
+  SIZE_T common=GetCommonPrefixLength();
+  SIZE_T length=info.keysize;
+
+  if (common && (k.length<common || memcmp(k.data,ResolveCommonPrefix(),common))) { 
+    // the key does not belong in this node
+    return ERROR_INSANE;
+  }
+
+  if (IsSlotted()) { 
+    // a key takes only the bytes it has, in new space.  Any bytes it
+    // had before are left behind, and the node keeps them until it is
+    // next compacted, so the key is unchanged if there is no room.
+    length = k.length<info.keysize ? k.length : info.keysize;
+    p=AllocateBytes(length-common);
+    if (p==0) { 
+      return ERROR_SIZE;
+    }
+    SLOTOFF_T field[2]={(SLOTOFF_T)(p-data),(SLOTOFF_T)(length-common)};
+    memcpy(ResolveKeyField(offset),field,sizeof(field));
+  }
+
+  memcpy(p,k.data+common,length-common);
+
+  char *q=ResolvePrefix(offset);
+
+  if (q) { 
+    KEYPREFIX_T x=MakeKeyPrefix((const BYTE_T *)p,length-common);
+    memcpy(q,&x,sizeof(x));
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T BTreeNode::SetPtr(const SIZE_T offset, const BLOCKNUM_T &ptr)
+{
+  char *p=ResolvePtr(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+
+  if (info.GetPtrSize()==sizeof(SIZE_T)) { 
+    SIZE_T narrow=(SIZE_T)ptr;
+    if (narrow!=ptr) { 
+      // a version 0 node cannot point past 4G blocks
+      return ERROR_SIZE;
+    }
+    memcpy(p,&narrow,sizeof(narrow));
+  } else {
+    memcpy(p,&ptr,sizeof(BLOCKNUM_T));
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+
+ERROR_T BTreeNode::SetVal(const SIZE_T offset, const VALUE_T &v)
+{
+  char *p=ResolveVal(offset);
+  
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+
+  SIZE_T length=info.valuesize;
+
+  if (IsSlotted()) { 
+    // a value of the same length is rewritten where it is, and one of
+    // another length moves to new space like a key
+    length = v.length<info.valuesize ? v.length : info.valuesize;
+    if (length!=GetStoredValLength(offset)) { 
+      p=AllocateBytes(length);
+      if (p==0) { 
+	return ERROR_SIZE;
+      }
+      SLOTOFF_T field[2]={(SLOTOFF_T)(p-data),(SLOTOFF_T)length};
+      memcpy(ResolveValField(offset),field,sizeof(field));
+    }
+  }
+  
+  memcpy(p,v.data,length);
+  
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T BTreeNode::SetKeyVal(const SIZE_T offset, const KeyValuePair &p)
+{
+  ERROR_T rc=SetKey(offset,p.key);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  } else {
+    return SetVal(offset,p.value);
+  }
+}
+
+
+
+
+ERROR_T BTreeNode::InsertKeyVal(const SIZE_T offset, const KeyView &k, const VALUE_T &v)
+{
+  if (info.nodetype!=BTREE_LEAF_NODE || offset>info.numkeys) { 
+    return ERROR_INSANE;
+  }
+
+  ERROR_T rc;
+
+  if (IsPacked()) { 
+    if (k.length!=info.keysize) { 
+      return ERROR_INSANE;
+    }
+
+    SIZE_T n=info.numkeys;
+    unsigned long long x=PackedKeyOf(k,info.keysize);
+    unsigned long long base=GetPackedBase();
+    SIZE_T width=GetPackedWidth();
+    BYTE_T *deltas=ResolvePackedDeltas();
+
+    if (n>0 && x>=base && GetDeltaWidth(x-base)<=width && n<GetPackedSlots(width)) { 
+      // the key fits as the others are packed, so the deltas after it
+      // move up one, last first
+      for (SIZE_T i=n;i>offset;i--) { 
+	PutPackedDelta(deltas,width,i,GetPackedDelta(deltas,width,i-1));
+      }
+      PutPackedDelta(deltas,width,offset,x-base);
+    } else {
+      // a new base or a wider delta, which every key takes
+      vector<unsigned long long> keys(n+1);
+      for (SIZE_T i=0;i<n;i++) { 
+	keys[i<offset ? i : i+1]=GetPackedKey(i);
+      }
+      keys[offset]=x;
+      if ((rc=RepackKeys(keys))) { 
+	return rc;
+      }
+    }
+
+    // the values before the new one move down to make room for it
+    char *end=data+info.GetNumDataBytes();
+    memmove(end-(n+1)*info.valuesize,end-n*info.valuesize,offset*info.valuesize);
+    info.numkeys++;
+    return SetVal(offset,v);
+  }
+
+  if (IsSlotted()) { 
+    SIZE_T keylength = k.length<info.keysize ? k.length : info.keysize;
+    SIZE_T vallength = v.length<info.valuesize ? v.length : info.valuesize;
+    SIZE_T common = GetCommonPrefixLength();
+
+    if (keylength<common) { 
+      return ERROR_INSANE;
+    }
+    if ((rc=OpenEntry(offset,keylength-common+vallength))) { 
+      return rc;
+    }
+  } else {
+    if (info.numkeys>=GetNumSlots()) { 
+      return ERROR_SIZE;
+    }
+
+    SIZE_T move=info.numkeys-offset;
+
+    info.numkeys++;
+    if (move && info.HasSplitLeaves()) { 
+      memmove(ResolveKey(offset+1),ResolveKey(offset),move*GetStoredKeySize());
+      memmove(ResolveVal(offset+1),ResolveVal(offset),move*info.valuesize);
+    } else if (move) { 
+      memmove(ResolveKeyVal(offset+1),ResolveKeyVal(offset),move*(GetStoredKeySize()+info.valuesize));
+    }
+    if (move && ResolvePrefix(0)) { 
+      memmove(ResolvePrefix(offset+1),ResolvePrefix(offset),move*info.GetPrefixSize());
+    }
+  }
+
+  rc=SetKey(offset,k);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+  return SetVal(offset,v);
+}
+
+
+ERROR_T BTreeNode::InsertKeyPtr(const SIZE_T offset, const KeyView &k, const BLOCKNUM_T &ptr)
+{
+  if ((info.nodetype!=BTREE_INTERIOR_NODE && info.nodetype!=BTREE_ROOT_NODE) || offset>info.numkeys) { 
+    return ERROR_INSANE;
+  }
+
+  ERROR_T rc;
+
+  if (IsSlotted()) { 
+    SIZE_T length = k.length<info.keysize ? k.length : info.keysize;
+    SIZE_T common = GetCommonPrefixLength();
+
+    if (length<common) { 
+      return ERROR_INSANE;
+    }
+    if ((rc=OpenEntry(offset,length-common))) { 
+      return rc;
+    }
+  } else {
+    if (info.numkeys>=GetNumSlots()) { 
+      return ERROR_SIZE;
+    }
+
+    // each key moves over with the pointer after it
+    SIZE_T move=info.numkeys-offset;
+    SIZE_T slotsize=GetStoredKeySize()+info.GetPtrSize();
+    char *from=ResolvePtr(offset)+info.GetPtrSize();
+
+    memmove(from+slotsize,from,move*slotsize);
+    if (move && ResolvePrefix(0)) { 
+      memmove(ResolvePrefix(offset+1),ResolvePrefix(offset),move*info.GetPrefixSize());
+    }
+    info.numkeys++;
+  }
+
+  rc=SetKey(offset,k);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+  return SetPtr(offset+1,ptr);
+}
+
+
+ERROR_T BTreeNode::CopySlots(const BTreeNode &src, const SIZE_T first, const SIZE_T count)
+{
+  bool leaf = info.nodetype==BTREE_LEAF_NODE;
+
+  if (leaf!=(src.info.nodetype==BTREE_LEAF_NODE) || GetNumSlots()==0 ||
+      info.format!=src.info.format || info.keysize!=src.info.keysize ||
+      info.valuesize!=src.info.valuesize || info.blocksize!=src.info.blocksize) { 
+    return ERROR_INSANE;
+  }
+  if (first+count>src.info.numkeys) { 
+    return ERROR_SIZE;
+  }
+  if (IsSlotted()) { 
+    return CopySlotsRekeyed(src,first,count);
+  }
+  if (IsPacked()) { 
+    // packed again from their own smallest key, so often narrower
+    vector<unsigned long long> keys(count);
+    ERROR_T rc;
+
+    for (SIZE_T i=0;i<count;i++) { 
+      keys[i]=src.GetPackedKey(first+i);
+    }
+    if ((rc=RepackKeys(keys))) { 
+      return rc;
+    }
+    info.numkeys=count;
+    if (count) { 
+      memcpy(ResolveVal(0),src.ResolveVal(first),count*info.valuesize);
+    }
+    return ERROR_NOERROR;
+  }
+  if (count>GetNumSlots()) { 
+    return ERROR_SIZE;
+  }
+
+  SIZE_T common=GetCommonPrefixLength();
+
+  if (common!=src.GetCommonPrefixLength() ||
+      (common && memcmp(ResolveCommonPrefix(),src.ResolveCommonPrefix(),common))) { 
+    return CopySlotsRekeyed(src,first,count);
+  }
+
+  info.numkeys=count;
+
+  if (leaf) { 
+    if (count && info.HasSplitLeaves()) { 
+      memcpy(ResolveKey(0),src.ResolveKey(first),count*GetStoredKeySize());
+      memcpy(ResolveVal(0),src.ResolveVal(first),count*info.valuesize);
+    } else if (count) { 
+      memcpy(ResolveKeyVal(0),src.ResolveKeyVal(first),count*(GetStoredKeySize()+info.valuesize));
+    }
+  } else {
+    memcpy(ResolvePtr(0),src.ResolvePtr(first),count*(GetStoredKeySize()+info.GetPtrSize())+info.GetPtrSize());
+  }
+  if (count && ResolvePrefix(0)) { 
+    memcpy(ResolvePrefix(0),src.ResolvePrefix(first),count*info.GetPrefixSize());
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+// Opens an empty directory entry at offset in a version 4 interior
+// node or version 5 leaf, once there is room for it and for bytes more
+// on the heap
+ERROR_T BTreeNode::OpenEntry(const SIZE_T offset, const SIZE_T bytes)
+{
+  SIZE_T n=info.numkeys;
+  SIZE_T entrysize=GetEntrySize();
+  SIZE_T prefixsize=info.GetPrefixSize();
+
+  if (GetFreeBytes()<entrysize+prefixsize+bytes) { 
+    Compact();
+  }
+  if (GetFreeBytes()<entrysize+prefixsize+bytes) { 
+    return ERROR_SIZE;
+  }
+
+  // The prefixes make room for the new one, and all move up past the
+  // end of the longer directory.  Then the entries make room.
+  char *entries=ResolveEntry(0);
+  char *prefixes=ResolveEntry(n);
+
+  memmove(prefixes+entrysize+(offset+1)*prefixsize,prefixes+offset*prefixsize,(n-offset)*prefixsize);
+  memmove(prefixes+entrysize,prefixes,offset*prefixsize);
+  memmove(entries+(offset+1)*entrysize,entries+offset*entrysize,(n-offset)*entrysize);
+  memset(entries+offset*entrysize,0,entrysize);
+  info.numkeys++;
+
+  return ERROR_NOERROR;
+}
+
+
+// CopySlots between nodes that keep different common bytes, so each
+// key has to be put back together and split again.  Version 4
+// interior nodes and version 5 leaves always copy this way.
+ERROR_T BTreeNode::CopySlotsRekeyed(const BTreeNode &src, const SIZE_T first, const SIZE_T count)
+{
+  ERROR_T rc;
+  KEY_T key;
+  VALUE_T value;
+  BLOCKNUM_T ptr;
+
+  info.numkeys=count;
+  if (IsSlotted()) { 
+    SetHeapBytes(0);
+    memset(ResolveEntry(0),0,count*GetEntrySize());
+  }
+
+  for (SIZE_T i=0;i<count;i++) { 
+    rc=src.GetKey(first+i,key);
+    if (rc==ERROR_NOERROR) { 
+      rc=SetKey(i,key);
+    }
+    if (rc!=ERROR_NOERROR) { 
+      info.numkeys=0;
+      return rc;
+    }
+    if (info.nodetype==BTREE_LEAF_NODE) { 
+      if (IsSlotted()) { 
+	src.GetVal(first+i,value);
+	if ((rc=SetVal(i,value))) { 
+	  info.numkeys=0;
+	  return rc;
+	}
+      } else {
+	memcpy(ResolveVal(i),src.ResolveVal(first+i),info.valuesize);
+      }
+    } else {
+      src.GetPtr(first+i,ptr);
+      SetPtr(i,ptr);
+    }
+  }
+  if (info.nodetype!=BTREE_LEAF_NODE) { 
+    src.GetPtr(first+count,ptr);
+    SetPtr(count,ptr);
+  }
+
+  return ERROR_NOERROR;
+}
 
 
 ostream & BTreeNode::Print(ostream &os) const 
@@ -310,7 +1691,7 @@ ostream & BTreeNode::Print(ostream &os) const
   if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) { 
     os <<", ";
     if (info.nodetype==BTREE_INTERIOR_NODE || info.nodetype==BTREE_ROOT_NODE) {
-      SIZE_T ptr;
+      BLOCKNUM_T ptr;
       KEY_T key;
       os << "pointers_and_values=(";
       if (info.numkeys>0) { // ==0 implies an empty root node
@@ -2,8 +2,10 @@
 #define _btree_ds
 
 #include <iostream>
+#include <vector>
 #include "global.h"
 #include "block.h"
+#include "keycompare.h"
 
 using namespace std;
 
@@ -13,6 +15,7 @@ using namespace std;
 #define BTREE_ROOT_NODE 2
 #define BTREE_INTERIOR_NODE 3
 #define BTREE_LEAF_NODE 4
+#define BTREE_FREEMAP_NODE 5
 
 
 typedef Block Buffer;
@@ -21,21 +24,144 @@ typedef KeyOrValue KEY_T;
 typedef KeyOrValue VALUE_T;
 
 
+//
+// A key that points at bytes owned by something else, usually a node's
+// data or the caller's KEY_T.  Searches compare views against the node
+// in place instead of copying each key out into a KEY_T.  A view is only
+// good as long as what it points into.
+//
+struct KeyView {
+  const BYTE_T *data;
+  SIZE_T        length;
+
+  KeyView() : data(0), length(0) {}
+  KeyView(const BYTE_T *d, const SIZE_T len) : data(d), length(len) {}
+  KeyView(const Block &b) : data(b.data), length(b.length) {}
+
+  // <0, 0, >0 like memcmp; a proper prefix is less
+  int Compare(const KeyView &rhs) const;
+
+  bool operator<(const KeyView &rhs) const { return Compare(rhs)<0; }
+  bool operator<=(const KeyView &rhs) const { return Compare(rhs)<=0; }
+  bool operator==(const KeyView &rhs) const { return Compare(rhs)==0; }
+};
+
+
 class BufferCache;
 struct KeyValuePair;
 
+
+//
+// Scratch memory for one tree operation.  Allocate carves pieces off
+// large chunks and nothing is freed individually.  Release gives back
+// everything at once when the operation is done, and keeps the chunks
+// for the next one, so a steady stream of operations does not touch
+// the general purpose allocator.
+//
+class ScratchArena {
+private:
+  vector<char *> chunks;
+  vector<SIZE_T> chunklens;
+  SIZE_T chunksize;
+  SIZE_T curchunk;  // chunk being carved
+  SIZE_T used;      // bytes carved from it
+  SIZE_T inuse;     // bytes handed out since the last Release
+
+  ScratchArena(const ScratchArena &rhs);
+  ScratchArena & operator=(const ScratchArena &rhs);
+
+public:
+  // Staging buffer for reading and writing nodes that live in the arena
+  Block block;
+
+  ScratchArena(const SIZE_T chunk_size=65536);
+  ~ScratchArena();
+
+  void  *Allocate(const SIZE_T bytes);  // 16 byte aligned
+  void   Release();
+
+  SIZE_T GetBytesInUse() const;
+  SIZE_T GetBytesReserved() const;
+};
+
+
+//
+// On-disk format versions
+//
+// Version 0 images predate the format word.  Their metadata is the
+// original 28 bytes: node type, key size, value size, block size,
+// root, free list and number of keys, all 32 bits, with no high water
+// mark, and their pointers are 32 bits wide.  Their free blocks are a
+// chain from the superblock rather than a freemap.  Later versions
+// store BTREE_FORMAT_MAGIC|version right after the node type, where a
+// version 0 image has its key size, and use 64 bit block numbers.
+// Nodes are always written back in the format they were read in.
+//
+// Version 2 is version 1 with a key prefix array at the end of each
+// interior node and leaf.  Version 3 is version 2 with the bytes all
+// keys of a node have in common stored once at the start of the node,
+// and only the rest of each key in its slot.  Version 4 is version 3
+// with interior nodes that keep each separator at its own length, and
+// separators cut down to what tells the two sides apart.  Version 5
+// is version 4 with leaves laid out the same way, so that keys and
+// values can each be any length up to the sizes the index declares.
+// Version 6 is version 4 (not 5) with leaves that keep all their keys
+// together and all their values after them.  Version 7 is version 4
+// with leaves that keep keys of up to 8 bytes as integers, each as its
+// difference from the smallest, in as few bits as the largest takes.
+// These are optional: an index is made in them only if asked, and
+// is otherwise made in BTREE_FORMAT_DEFAULT.  BTREE_FORMAT_CURRENT is
+// the newest version that can be read.
+//
+#define BTREE_FORMAT_MAGIC 0xb7ee0000
+#define BTREE_FORMAT_V0 0
+#define BTREE_FORMAT_V1 1
+#define BTREE_FORMAT_V2 2
+#define BTREE_FORMAT_V3 3
+#define BTREE_FORMAT_V4 4
+#define BTREE_FORMAT_V5 5
+#define BTREE_FORMAT_V6 6
+#define BTREE_FORMAT_V7 7
+#define BTREE_FORMAT_CURRENT BTREE_FORMAT_V7
+
+// Marks the superblock of a StaticBTreeIndex (see btree_static.h),
+// whose nodes are laid out at compile time.  It is above every
+// version, so BTreeIndex will not attach to one.
+#define BTREE_FORMAT_STATIC 0x100
+
+// Byte offsets and lengths within a version 4 interior node or a
+// version 5 leaf, which limits those indexes to blocks of 64K
+typedef unsigned short SLOTOFF_T;
+#define BTREE_SLOTTED_MAX_BLOCKSIZE 65536
+#define BTREE_FORMAT_DEFAULT BTREE_FORMAT_V1
+
 struct NodeMetadata {
   int nodetype;
+  SIZE_T format;  // BTREE_FORMAT_MAGIC|version
   SIZE_T keysize; 
   SIZE_T valuesize;
   SIZE_T blocksize;
-  SIZE_T rootnode; //meaningful only for superblock
-  SIZE_T freelist; //meaningful only for superblock or a free block
   SIZE_T numkeys;
-
+  BLOCKNUM_T rootnode; //meaningful only for superblock
+  BLOCKNUM_T freemap; //meaningful only for superblock or a freemap block (next freemap block), or in version 0 a free block (next free block)
+  BLOCKNUM_T highwater; //meaningful only for superblock, blocks from here on have never been used; not stored in version 0
+
+  SIZE_T GetFormatVersion() const;
+  SIZE_T GetHeaderSize() const;  // bytes of metadata at the start of the block
+  SIZE_T GetPtrSize() const;     // bytes per pointer
+  SIZE_T GetPrefixSize() const;  // bytes per key prefix, 0 if none
+  bool   HasCommonPrefix() const;  // nodes keep the bytes their keys share once
+  bool   HasShortSeparators() const;  // interior nodes keep separators at their own length
+  bool   HasVariableRecords() const;  // leaves keep keys and values at their own lengths
+  bool   HasSplitLeaves() const;  // leaves keep their keys apart from their values
+  bool   HasPackedLeaves() const;  // leaves keep their keys as packed integers
   SIZE_T GetNumDataBytes() const;
-  SIZE_T GetNumSlotsAsInterior() const;
-  SIZE_T GetNumSlotsAsLeaf() const;
+  // Bytes ahead of the first slot when a node keeps common bytes of
+  // its keys once
+  SIZE_T GetSlotsOffset(const SIZE_T common=0) const;
+  // Slot counts are smallest with nothing in common
+  SIZE_T GetNumSlotsAsInterior(const SIZE_T common=0) const;
+  SIZE_T GetNumSlotsAsLeaf(const SIZE_T common=0) const;
 
   ostream &Print(ostream &rhs) const;
 			  
@@ -55,7 +181,91 @@ inline ostream & operator<< (ostream &os, const NodeMetadata &node) { return nod
 //
 // PTR* KEY VALUE KEY VALUE KEY VALUE
 //
-// *Here this pointer is not used
+// *Here this pointer links to the next leaf in key order, 0 after
+// the last.  Leaves written before there were links have 0 here.
+//
+// In version 2 both are followed, at the end of the block, by
+//
+// PREFIX PREFIX PREFIX ...
+//
+// with one slot per key slot.  The prefix of each key (see
+// keycompare.h) is kept in step with the key by SetKey and the
+// calls below that move keys, so anything that changes keys has to
+// go through them.  The slot counts allow for the prefixes.
+//
+// In version 3 the slots are preceded, at the start of the block, by
+//
+// LENGTH COMMON
+//
+// where COMMON is the first LENGTH bytes of every key in the node.
+// The slots hold just the rest of each key, and the key prefixes are
+// made from that.  The common bytes are set while the node is empty
+// (SetCommonPrefix) and do not change after, so every key put in the
+// node has to start with them.  The btree takes them from the keys on
+// either side of the node in its parent, which bound every key that
+// can reach it.  Shorter slots let a node hold more keys.
+//
+// In version 4 an interior node, after its common bytes, is
+//
+// HEAPBYTES PTR ENTRY ENTRY ENTRY ... PREFIX PREFIX ... free ... KEYS
+//
+// with ENTRY = PTR OFFSET LENGTH.  Entry i has the pointer after key i,
+// and where in the node the rest of key i starts and how long it is.
+// The keys are packed at the end of the block, last added lowest, and
+// HEAPBYTES is how many bytes they take.  The prefixes directly follow
+// the entries, so both move when a key is inserted.  Separators can be
+// any length up to the key size.  A leaf split sends up only as much
+// of the first key on the right as sorts it after the last key on the
+// left.  A node's slot count is the keys it holds plus the full length
+// keys it still has room for.
+//
+// In version 5 a leaf, after its common bytes, is
+//
+// HEAPBYTES PTR* ENTRY ENTRY ENTRY ... PREFIX PREFIX ... free ... RECORDS
+//
+// with ENTRY = KEYOFFSET KEYLENGTH VALOFFSET VALLENGTH, and the key and
+// value bytes packed at the end of the block like the separators
+// above.  HEAPBYTES is the free space pointer.  A value rewritten at a
+// new length, or a key replaced, takes new space, and leaves its old
+// bytes behind until the node is compacted, which packs the bytes still
+// in use against the end of the block again.  Keys longer than the key
+// size, or values longer than the value size, are not taken.  Nodes of
+// entries of their own sizes split where their bytes balance rather
+// than where their keys do.
+//
+// In version 6 a leaf, after its common bytes, is
+//
+// PTR* KEY KEY KEY ... VALUE VALUE VALUE ... PREFIX PREFIX ...
+//
+// with room for as many keys as the node has slots, so the values start
+// at the same place however many keys there are.  A search reads only
+// the prefixes and the keys, which are packed together, and not the
+// values between them.
+//
+// In version 7 a leaf, after its common bytes (always none), is
+//
+// PTR* BASE WIDTH DELTA DELTA DELTA ... free ... VALUE VALUE VALUE
+//
+// Each key, of 8 bytes at most, is taken as a big endian integer, so
+// that integers order keys as their bytes do, and stored as DELTA, its
+// difference from BASE, in WIDTH bits (see keycompare.h).  BASE is
+// the smallest key and WIDTH the bits the largest difference takes.  A
+// key that does not fit that makes the node repack every key with a
+// new BASE and WIDTH.  The values are packed against the end of the
+// block, the last one last.  There are no prefixes.  A search unpacks
+// only the deltas it looks at, and keys next to each other take a few
+// bits each, so a leaf of dense integer keys holds many times the keys
+// of the other formats when the values are small.  Every key must be
+// the key size long.  A node's slot count is the keys it holds plus
+// those of its current width it still has room for.
+//
+// Freemap:
+//
+// WORD WORD WORD ...
+//
+// A chain of freemap blocks holds the free space bitmap of the index,
+// one bit per block, in 64 bit words.  The superblock points to
+// the first one.
 
 
 struct BTreeNode {
@@ -66,38 +276,141 @@ struct BTreeNode {
   // interior => array of keys
   // leaf => array of key/value pairs
 
+  // If set, data comes from here and is not freed by the node, and
+  // the arena's block is used to read and write the node
+  ScratchArena *arena;
+
+  // If set, the node is pinned on this buffer cache frame (see Pin)
+  // and data points into the frame itself
+  BufferCache  *pincache;
+  Block        *frame;
+  BLOCKNUM_T    frameblock;
+  bool          framedirty;
+
 
   BTreeNode();
+  explicit BTreeNode(ScratchArena *arena);
   //
   // Note: This destructor is INTENTIONALLY left non-virtual
   //       This class must NOT have a vtable pointer
   //         because we will serialize it directly to disk
   //
   ~BTreeNode();
-  BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T block_size);
+  BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T block_size,
+	    SIZE_T format_version=BTREE_FORMAT_DEFAULT, ScratchArena *arena=0);
   BTreeNode(const BTreeNode &rhs);
+  BTreeNode(BTreeNode &&rhs);
+  // Assigning a node of the same shape reuses the data buffer
   BTreeNode & operator=(const BTreeNode &rhs);
+  BTreeNode & operator=(BTreeNode &&rhs);
   
-  ERROR_T Serialize(BufferCache *b, const SIZE_T block) const;
-  ERROR_T Unserialize(BufferCache *b, const SIZE_T block);
+  ERROR_T Serialize(BufferCache *b, const BLOCKNUM_T block) const;
+  // Reuses data if the node read has the same shape.  The second form
+  // reads the block through raw, which keeps its buffer across calls.
+  ERROR_T Unserialize(BufferCache *b, const BLOCKNUM_T block);
+  ERROR_T Unserialize(BufferCache *b, const BLOCKNUM_T block, Block &raw);
+
+  // Works on the block where it sits in the buffer cache instead of on
+  // a copy.  Pin pins the block's frame and points data into it, so
+  // reading the node touches only the bytes looked at.  Changes through
+  // the Set and Resolve calls go straight to the frame; MarkDirty after
+  // making any (to info too).  Unpin puts info back in the frame and
+  // releases it, dirty if it was marked.  Pinning another block,
+  // Unserialize, assignment and the destructor all unpin first.
+  ERROR_T Pin(BufferCache *b, const BLOCKNUM_T block);
+  void    MarkDirty() { framedirty=true; }
+  ERROR_T Unpin();
 
   char *ResolveKey(const SIZE_T offset) const; // Gives a pointer to the ith key  (interior or leaf)
   char *ResolvePtr(const SIZE_T offset) const; // Gives a pointer to the ith pointer (interior)
   char *ResolveVal(const SIZE_T offset) const; // Gives a pointer to the ith value (leaf)
   char *ResolveKeyVal(const SIZE_T offset) const ; // Gives a pointer to the ith keyvalue pair (leaf)
+  char *ResolvePrefix(const SIZE_T offset) const; // Gives a pointer to the ith key prefix, 0 if none
+  // Gives a pointer to the bytes every key in the node starts with,
+  // and how many there are (interior or leaf, version 3)
+  char  *ResolveCommonPrefix() const;
+  SIZE_T GetCommonPrefixLength() const;
+  // Makes the empty node keep the first length bytes of k once
+  ERROR_T SetCommonPrefix(const KeyView &k, const SIZE_T length);
 
   ERROR_T GetKey(const SIZE_T offset, KEY_T &k) const ; // Gives the ith key  (interior or leaf)
-  ERROR_T GetPtr(const SIZE_T offset, SIZE_T &p) const ;   // Gives the ith pointer (interior)
+  ERROR_T GetKey(const SIZE_T offset, KeyView &k) const ; // Points k at the ith key, no copy, if it is stored whole
+  ERROR_T GetPtr(const SIZE_T offset, BLOCKNUM_T &p) const ;   // Gives the ith pointer (interior)
   ERROR_T GetVal(const SIZE_T offset, VALUE_T &v) const ; // Gives  the ith value (leaf)
   ERROR_T GetKeyVal(const SIZE_T offset, KeyValuePair &p) const; // Gives  the ith key value pair (leaf)
 
+  // Binary searches of the keys (interior or leaf).  LowerBound gives
+  // the offset of the first key no smaller than k, UpperBound of the
+  // first key larger than k, and both give numkeys if there is none.
+  SIZE_T LowerBound(const KeyView &k) const;
+  SIZE_T UpperBound(const KeyView &k) const;
+  // <0, 0, >0 as the ith key is less than, equal to, or greater than k
+  int    CompareKey(const SIZE_T offset, const KeyView &k) const;
+
+  // Keys the node has room for.  A version 3 node has more the more
+  // bytes its keys have in common.
+  SIZE_T GetNumSlots() const;
+  // Whether the node has no slot left, after compacting it if that
+  // makes room (so MarkDirty a pinned node after)
+  bool   IsFull();
+  // Bytes the ith key takes in the node with its value (leaf) or
+  // pointer (interior), its directory entry and its prefix
+  SIZE_T GetSlotBytes(const SIZE_T offset) const;
+
 
   ERROR_T SetKey(const SIZE_T offset, const KEY_T &k); // Writesthe ith key  (interior or leaf)
-  ERROR_T SetPtr(const SIZE_T offset, const SIZE_T &p);   // Writes the ith pointer (interior)
+  ERROR_T SetKey(const SIZE_T offset, const KeyView &k); // Same, from a view
+  ERROR_T SetPtr(const SIZE_T offset, const BLOCKNUM_T &p);   // Writes the ith pointer (interior)
   ERROR_T SetVal(const SIZE_T offset, const VALUE_T &v); // Writes the ith value (leaf)
   ERROR_T SetKeyVal(const SIZE_T offset, const KeyValuePair &p); // Writes the ith key value pair (leaf)
 
+  // Moving keys around.  These keep the prefixes in step.
+  // Opens a gap at offset and puts the pair in it (leaf)
+  ERROR_T InsertKeyVal(const SIZE_T offset, const KeyView &k, const VALUE_T &v);
+  // Opens a gap at offset and puts the key in it, with the pointer to
+  // its right at offset+1 (interior)
+  ERROR_T InsertKeyPtr(const SIZE_T offset, const KeyView &k, const BLOCKNUM_T &p);
+  // Makes this node hold count keys of src from first on, with their
+  // values (leaf) or the pointers on either side of them (interior).
+  // The two nodes must have the same type and format, and the keys
+  // must start with this node's common bytes.
+  ERROR_T CopySlots(const BTreeNode &src, const SIZE_T first, const SIZE_T count);
+
   ostream &Print(ostream &rhs) const;
+
+private:
+  void AllocData();
+  void FreeData();
+  void ClearFrame();
+  SIZE_T SearchKeys(const KeyView &k, const int limit) const;
+  SIZE_T SearchKeyRange(const KeyView &k, const int limit, SIZE_T base, SIZE_T n) const;
+  ERROR_T CopySlotsRekeyed(const BTreeNode &src, const SIZE_T first, const SIZE_T count);
+  char  *ResolveSlots() const;
+  SIZE_T GetStoredKeySize() const;
+  SIZE_T GetStoredKeyLength(const SIZE_T offset) const;
+  SIZE_T GetStoredValLength(const SIZE_T offset) const;
+  // The directory of a version 4 interior node or version 5 leaf
+  bool   IsSlotted() const;
+  SIZE_T GetEntrySize() const;
+  char  *ResolveEntry(const SIZE_T offset) const;
+  char  *ResolveKeyField(const SIZE_T offset) const;  // OFFSET LENGTH of the key
+  char  *ResolveValField(const SIZE_T offset) const;  // OFFSET LENGTH of the value
+  SIZE_T GetHeapBytes() const;
+  void   SetHeapBytes(const SIZE_T n);
+  SIZE_T GetFreeBytes() const;
+  char  *AllocateBytes(const SIZE_T n);
+  void   Compact();
+  ERROR_T OpenEntry(const SIZE_T offset, const SIZE_T bytes);
+  // The keys of a version 7 leaf
+  bool   IsPacked() const;
+  unsigned long long GetPackedBase() const;
+  SIZE_T GetPackedWidth() const;
+  BYTE_T *ResolvePackedDeltas() const;
+  SIZE_T GetPackedSlots(const SIZE_T width) const;
+  unsigned long long GetPackedKey(const SIZE_T offset) const;
+  ERROR_T RepackKeys(const vector<unsigned long long> &keys);
+  ERROR_T ReadHeader(const BYTE_T *header);
+  void WriteHeader(BYTE_T *header) const;
 };
 
 
@@ -4,17 +4,30 @@
 
 void usage() 
 {
-  cerr << "usage: btree_init filestem cachesize keysize valuesize\n";
+  cerr << "usage: btree_init filestem cachesize keysize valuesize [format [keytype]]\n";
+  cerr << "       format is the on-disk format version, "<<BTREE_FORMAT_DEFAULT<<" by default;\n";
+  cerr << "       "<<BTREE_FORMAT_V2<<" keeps an array of key prefixes in each node, and\n";
+  cerr << "       "<<BTREE_FORMAT_V3<<" also keeps the bytes a node's keys share just once, and\n";
+  cerr << "       "<<BTREE_FORMAT_V4<<" also cuts separators down to the bytes that tell keys apart, and\n";
+  cerr << "       "<<BTREE_FORMAT_V5<<" also keeps keys and values of any length up to keysize and valuesize;\n";
+  cerr << "       "<<BTREE_FORMAT_V6<<" is "<<BTREE_FORMAT_V4<<" with the keys of each leaf kept apart from its values\n";
+  cerr << "       "<<BTREE_FORMAT_V7<<" is "<<BTREE_FORMAT_V4<<" with keys of keysize (up to 8) bytes kept in each leaf as\n";
+  cerr << "       integers, packed as their differences from the smallest\n";
+  cerr << "       keytype is what the keys are made of, fields separated by commas, each\n";
+  cerr << "       u32, i32, u64, i64 (integers) or strN (a string of up to N bytes), e.g.\n";
+  cerr << "       u32,str12; keysize is then its size or 0, and keys are given to the\n";
+  cerr << "       other tools as their values separated by commas\n";
 }
 
 
 int main(int argc, char **argv)
 {
   char *filestem;
-  SIZE_T cachesize, keysize, valuesize;
-  SIZE_T superblocknum;
+  SIZE_T cachesize, keysize, valuesize, format;
+  KeyType keytype;
+  BLOCKNUM_T superblocknum;
 
-  if (argc!=5) { 
+  if (argc<5 || argc>7) { 
     usage();
     return -1;
   }
@@ -23,10 +36,25 @@ int main(int argc, char **argv)
   cachesize=atoi(argv[2]);
   keysize=atoi(argv[3]);
   valuesize=atoi(argv[4]);
+  format=argc>=6 ? atoi(argv[5]) : BTREE_FORMAT_DEFAULT;
+
+  if (format<BTREE_FORMAT_V1 || format>BTREE_FORMAT_CURRENT) { 
+    usage();
+    return -1;
+  }
+
+  if (argc==7) {
+    if (keytype.Parse(argv[6])!=ERROR_NOERROR ||
+	(keysize!=0 && keysize!=keytype.GetKeySize())) {
+      usage();
+      return -1;
+    }
+    keysize=keytype.GetKeySize();
+  }
 
   DiskSystem disk(filestem);
   BufferCache cache(&disk,cachesize);
-  BTreeIndex btree(keysize,valuesize,&cache);
+  BTreeIndex btree(keysize,valuesize,&cache,true,format,keytype);
   
   ERROR_T rc;
 
@@ -59,6 +87,7 @@ int main(int argc, char **argv)
     cerr << endl;
     
     cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+    disk.PrintStats(cerr);
 
     return 0;
   }
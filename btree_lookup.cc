@@ -11,7 +11,7 @@ int main(int argc, char **argv)
 {
   char *filestem;
   SIZE_T cachesize;
-  SIZE_T superblocknum;
+  BLOCKNUM_T superblocknum;
   char *key;
 
   if (argc!=4) { 
@@ -41,7 +41,8 @@ int main(int argc, char **argv)
   } else {
     cerr << "Index attached!"<<endl;
     VALUE_T val;
-    if ((rc=btree.Lookup(KEY_T(key),val))!=ERROR_NOERROR) { 
+    KEY_T k;
+    if ((rc=btree.MakeKey(key,k)) || (rc=btree.Lookup(k,val))!=ERROR_NOERROR) { 
       cerr <<"Lookup failed: error "<<rc<<endl;
     } else {
       cerr <<"Lookup succeeded\n";
@@ -66,6 +67,7 @@ int main(int argc, char **argv)
     cerr << endl;
     
     cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+    disk.PrintStats(cerr);
 
     return 0;
   }
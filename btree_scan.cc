@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include "btree.h"
+
+void usage() 
+{
+  cerr << "usage: btree_scan filestem cachesize fromkey count\n";
+  cerr << "       prints up to count (key,value) pairs in key order, from the\n";
+  cerr << "       first key no smaller than fromkey\n";
+}
+
+
+int main(int argc, char **argv)
+{
+  char *filestem;
+  SIZE_T cachesize;
+  BLOCKNUM_T superblocknum;
+  char *key;
+  SIZE_T count;
+
+  if (argc!=5) { 
+    usage();
+    return -1;
+  }
+
+  filestem=argv[1];
+  cachesize=atoi(argv[2]);
+  key=argv[3];
+  count=atoi(argv[4]);
+
+  DiskSystem disk(filestem);
+  BufferCache cache(&disk,cachesize);
+  BTreeIndex btree(0,0,&cache);
+  
+  ERROR_T rc;
+
+
+  if ((rc=cache.Attach())!=ERROR_NOERROR) { 
+    cerr << "Can't attach buffer cache due to error"<<rc<<endl;
+    return -1;
+  }
+
+  if ((rc=btree.Attach(0))!=ERROR_NOERROR) { 
+    cerr << "Can't attach to index  due to error "<<rc<<endl;
+    return -1;
+  } else {
+    cerr << "Index attached!"<<endl;
+    BTreeCursor cursor;
+    KEY_T k;
+    VALUE_T val;
+    SIZE_T n=0;
+    if ((rc=btree.MakeKey(key,k))==ERROR_NOERROR) {
+      rc=btree.Seek(k,cursor);
+    }
+    for (; rc==ERROR_NOERROR && !cursor.AtEnd() && n<count; rc=btree.Next(cursor), n++) { 
+      cursor.GetKey(k);
+      cursor.GetVal(val);
+      cout << "(" << btree.KeyToString(k) << ",";
+      cout.write((const char *)val.data,val.length);
+      cout << ")\n";
+    }
+    if (rc!=ERROR_NOERROR) { 
+      cerr <<"Scan failed: error "<<rc<<endl;
+    } else {
+      cerr <<"Scan succeeded, "<<n<<" pairs\n";
+    }
+    if ((rc=btree.Detach(superblocknum))!=ERROR_NOERROR) { 
+      cerr <<"Can't detach from index due to error "<<rc<<endl;
+      return -1;
+    }
+    if ((rc=cache.Detach())!=ERROR_NOERROR) { 
+      cerr <<"Can't detach from cache due to error "<<rc<<endl;
+      return -1;
+    }
+    cerr << "Performance statistics:\n";
+    
+    cerr << "numallocs       = "<<cache.GetNumAllocs()<<endl;
+    cerr << "numdeallocs     = "<<cache.GetNumDeallocs()<<endl;
+    cerr << "numreads        = "<<cache.GetNumReads()<<endl;
+    cerr << "numdiskreads    = "<<cache.GetNumDiskReads()<<endl;
+    cerr << "numwrites       = "<<cache.GetNumWrites()<<endl;
+    cerr << "numdiskwrites   = "<<cache.GetNumDiskWrites()<<endl;
+    cerr << endl;
+    
+    cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+    disk.PrintStats(cerr);
+
+    return 0;
+  }
+}
+  
+
+  
@@ -11,7 +11,7 @@ int main(int argc, char **argv)
 {
   char *filestem;
   SIZE_T cachesize;
-  SIZE_T superblocknum;
+  BLOCKNUM_T superblocknum;
 
   if (argc!=3) { 
     usage();
@@ -59,6 +59,7 @@ int main(int argc, char **argv)
     cerr << endl;
     
     cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+    disk.PrintStats(cerr);
 
     return 0;
   }
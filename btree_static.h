@@ -0,0 +1,687 @@
+#ifndef _btree_static
+#define _btree_static
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include <assert.h>
+#include <string.h>
+
+#include "global.h"
+#include "block.h"
+#include "buffercache.h"
+#include "btree_ds.h"
+
+using namespace std;
+
+//
+// A btree whose key type, value type, and block size are template
+// parameters instead of sizes read from the superblock.  Every offset
+// and slot count in a node is then a compile time constant, keys are
+// compared with the key type's own operator< (a native comparison for
+// an integer), and the search of a node is unrolled into a fixed
+// sequence of steps for its capacity.  It runs over the same buffer
+// cache and disks as BTreeIndex, but has a layout of its own and is not
+// interchangeable with it.
+//
+// Keys and values must be trivially copyable, as they are copied in
+// and out of blocks as bytes.  FixedKey below is a key of a fixed
+// number of bytes that sorts as its bytes do.
+//
+
+
+//
+// A key of N bytes, ordered as memcmp orders them.  The comparison
+// reads eight bytes at a time as big endian words, and as N is known
+// the loop is unrolled.
+//
+template <SIZE_T N>
+struct FixedKey {
+  BYTE_T bytes[N];
+
+  int Compare(const FixedKey &rhs) const {
+    SIZE_T i;
+    for (i=0;i+8<=N;i+=8) {
+      unsigned long long a, b;
+      memcpy(&a,bytes+i,8);
+      memcpy(&b,rhs.bytes+i,8);
+      if (a!=b) {
+	return __builtin_bswap64(a)<__builtin_bswap64(b) ? -1 : 1;
+      }
+    }
+    for (;i<N;i++) {
+      if (bytes[i]!=rhs.bytes[i]) {
+	return bytes[i]<rhs.bytes[i] ? -1 : 1;
+      }
+    }
+    return 0;
+  }
+
+  bool operator<(const FixedKey &rhs) const { return Compare(rhs)<0; }
+  bool operator==(const FixedKey &rhs) const { return Compare(rhs)==0; }
+};
+
+
+//
+// Lower bound over a node of LEN slots, of which the first numkeys are
+// in use: the offset of the first key no smaller than key.  Each step
+// halves the range without a branch, and the slots past numkeys count
+// as larger than anything, so the number of steps depends only on LEN
+// and the recursion flattens into straight line code.
+//
+template <SIZE_T LEN>
+struct StaticLowerBound {
+  template <typename KEY, typename LESS>
+  static inline SIZE_T Search(const KEY *keys, const SIZE_T numkeys,
+			      const KEY &key, const LESS &less, const SIZE_T base=0)
+  {
+    const SIZE_T probe=base+LEN/2;
+    const bool right=(probe<numkeys) & less(keys[probe],key);
+    return StaticLowerBound<LEN-LEN/2>::Search(keys,numkeys,key,less,right ? probe : base);
+  }
+};
+
+template <>
+struct StaticLowerBound<1> {
+  template <typename KEY, typename LESS>
+  static inline SIZE_T Search(const KEY *keys, const SIZE_T numkeys,
+			      const KEY &key, const LESS &less, const SIZE_T base=0)
+  {
+    return base + ((base<numkeys) & less(keys[base],key));
+  }
+};
+
+
+//
+// A node over the bytes of a block, usually a pinned cache frame.
+//
+// Interior node:
+//
+// HEADER KEY KEY ... KEY PTR PTR ... PTR
+//
+// with INTERIORSLOTS keys and one more pointer.  Pointer i leads to
+// the keys no larger than key i, and the last to the rest.
+//
+// Leaf:
+//
+// HEADER KEY KEY ... KEY VALUE VALUE ... VALUE
+//
+// with LEAFSLOTS of each, and the link to the next leaf in key order
+// (0 after the last) in the header.  Keys are kept apart from values,
+// as in format 6, so a search reads only keys.
+//
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS=std::less<KEY> >
+struct StaticBTreeNode {
+  struct Header {
+    int        nodetype;  // BTREE_INTERIOR_NODE or BTREE_LEAF_NODE
+    SIZE_T     numkeys;
+    BLOCKNUM_T link;      // next leaf, in a leaf
+  };
+
+  static constexpr SIZE_T RoundUp(const SIZE_T n, const SIZE_T align) {
+    return (n+align-1)/align*align;
+  }
+
+  static constexpr SIZE_T HEADERSIZE = RoundUp(sizeof(Header),alignof(KEY));
+
+  static constexpr SIZE_T LEAFSLOTS =
+    (BLOCKSIZE-HEADERSIZE-alignof(VALUE))/(sizeof(KEY)+sizeof(VALUE));
+  static constexpr SIZE_T LEAFVALUES =
+    RoundUp(HEADERSIZE+LEAFSLOTS*sizeof(KEY),alignof(VALUE));
+
+  static constexpr SIZE_T INTERIORSLOTS =
+    (BLOCKSIZE-HEADERSIZE-sizeof(BLOCKNUM_T)-alignof(BLOCKNUM_T))/(sizeof(KEY)+sizeof(BLOCKNUM_T));
+  static constexpr SIZE_T INTERIORPTRS =
+    RoundUp(HEADERSIZE+INTERIORSLOTS*sizeof(KEY),alignof(BLOCKNUM_T));
+
+  static_assert(std::is_trivially_copyable<KEY>::value &&
+		std::is_trivially_copyable<VALUE>::value,
+		"keys and values are copied as bytes");
+  static_assert(LEAFSLOTS>=2 && INTERIORSLOTS>=3,
+		"the block is too small for the key and value");
+  static_assert(LEAFVALUES+LEAFSLOTS*sizeof(VALUE)<=BLOCKSIZE &&
+		INTERIORPTRS+(INTERIORSLOTS+1)*sizeof(BLOCKNUM_T)<=BLOCKSIZE,
+		"slot counts overrun the block");
+
+  BYTE_T *data;
+
+  explicit StaticBTreeNode(BYTE_T *d) : data(d) {}
+
+  Header     &Head() const { return *(Header *)data; }
+  KEY        *Keys() const { return (KEY *)(data+HEADERSIZE); }
+  VALUE      *Vals() const { return (VALUE *)(data+LEAFVALUES); }
+  BLOCKNUM_T *Ptrs() const { return (BLOCKNUM_T *)(data+INTERIORPTRS); }
+
+  bool   IsLeaf() const { return Head().nodetype==BTREE_LEAF_NODE; }
+  SIZE_T GetNumKeys() const { return Head().numkeys; }
+  bool   IsFull() const { return Head().numkeys==(IsLeaf() ? LEAFSLOTS : INTERIORSLOTS); }
+
+  void Init(const int nodetype) {
+    memset(data,0,BLOCKSIZE);
+    Head().nodetype=nodetype;
+  }
+
+  SIZE_T LowerBound(const KEY &key, const LESS &less=LESS()) const {
+    if (IsLeaf()) {
+      return StaticLowerBound<LEAFSLOTS>::Search(Keys(),Head().numkeys,key,less);
+    } else {
+      return StaticLowerBound<INTERIORSLOTS>::Search(Keys(),Head().numkeys,key,less);
+    }
+  }
+
+  // Opens slot offset of a leaf that is not full
+  void InsertPair(const SIZE_T offset, const KEY &key, const VALUE &value) {
+    SIZE_T n=Head().numkeys;
+    memmove(Keys()+offset+1,Keys()+offset,(n-offset)*sizeof(KEY));
+    memmove(Vals()+offset+1,Vals()+offset,(n-offset)*sizeof(VALUE));
+    Keys()[offset]=key;
+    Vals()[offset]=value;
+    Head().numkeys=n+1;
+  }
+
+  // Puts key at offset of an interior node that is not full, with
+  // right, the node of the keys after it, as the pointer after it
+  void InsertSeparator(const SIZE_T offset, const KEY &key, const BLOCKNUM_T right) {
+    SIZE_T n=Head().numkeys;
+    memmove(Keys()+offset+1,Keys()+offset,(n-offset)*sizeof(KEY));
+    memmove(Ptrs()+offset+2,Ptrs()+offset+1,(n-offset)*sizeof(BLOCKNUM_T));
+    Keys()[offset]=key;
+    Ptrs()[offset+1]=right;
+    Head().numkeys=n+1;
+  }
+};
+
+
+//
+// A cache frame kept pinned until Unpin, or until the StaticPin goes
+// out of scope, so that an error return does not leave it pinned.
+//
+class StaticPin {
+private:
+  BufferCache *cache;
+  BLOCKNUM_T   block;
+  Block       *frame;
+  bool         dirty;
+
+  StaticPin(const StaticPin &rhs);
+  StaticPin & operator=(const StaticPin &rhs);
+
+public:
+  StaticPin() : cache(0), block(0), frame(0), dirty(false) {}
+  ~StaticPin() { Unpin(); }
+
+  ERROR_T Pin(BufferCache *c, const BLOCKNUM_T b) {
+    ERROR_T rc;
+    if ((rc=Unpin())) {
+      return rc;
+    }
+    if ((rc=c->PinBlock(b,frame))) {
+      frame=0;
+      return rc;
+    }
+    cache=c;
+    block=b;
+    dirty=false;
+    return ERROR_NOERROR;
+  }
+
+  ERROR_T Unpin() {
+    if (!frame) {
+      return ERROR_NOERROR;
+    }
+    frame=0;
+    return cache->UnpinBlock(block,dirty);
+  }
+
+  void Swap(StaticPin &rhs) {
+    std::swap(cache,rhs.cache);
+    std::swap(block,rhs.block);
+    std::swap(frame,rhs.frame);
+    std::swap(dirty,rhs.dirty);
+  }
+
+  BYTE_T    *Data() const { return frame->data; }
+  BLOCKNUM_T GetBlock() const { return block; }
+  void       MarkDirty() { dirty=true; }
+};
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS=std::less<KEY> >
+class StaticBTreeIndex {
+public:
+  typedef StaticBTreeNode<KEY,VALUE,BLOCKSIZE,LESS> Node;
+
+private:
+  BufferCache  *buffercache;
+  BLOCKNUM_T    superblock_index;
+  NodeMetadata  superblock;
+  LESS          less;
+
+  StaticBTreeIndex(const StaticBTreeIndex &rhs);
+  StaticBTreeIndex & operator=(const StaticBTreeIndex &rhs);
+
+protected:
+  bool    Equal(const KEY &a, const KEY &b) const { return !less(a,b) && !less(b,a); }
+
+  // Blocks are handed out from the high water mark.  Nothing is ever
+  // freed, since splits keep the left half where it was and there are
+  // no deletes.
+  ERROR_T AllocateNode(BLOCKNUM_T &n);
+
+  ERROR_T WriteSuperblock();
+
+  // Splits child, the full node at pointer offset of parent, moving
+  // its upper half to a new node after it
+  ERROR_T SplitChild(Node &parent, const SIZE_T offset, StaticPin &child);
+
+  // Pins the leaf key belongs in
+  ERROR_T FindLeaf(const KEY &key, StaticPin &leaf);
+
+  ERROR_T SanityHelper(const BLOCKNUM_T block, const KEY *low, const KEY *high,
+		       const SIZE_T depth, SIZE_T &leafdepth, BLOCKNUM_T &nextleaf);
+
+public:
+  explicit StaticBTreeIndex(BufferCache *cache)
+    : buffercache(cache), superblock_index(0) { memset(&superblock,0,sizeof(superblock)); }
+
+  // As for BTreeIndex.  The disk has to have blocks of BLOCKSIZE
+  // bytes, and an existing index the same key and value sizes.
+  ERROR_T Attach(const BLOCKNUM_T initblock, const bool create=false);
+  ERROR_T Detach(BLOCKNUM_T &initblock);
+
+  // return ERROR_CONFLICT if the key already exists
+  ERROR_T Insert(const KEY &key, const VALUE &value);
+  // return ERROR_NONEXISTENT if the key doesn't exist
+  ERROR_T Update(const KEY &key, const VALUE &value);
+  ERROR_T Lookup(const KEY &key, VALUE &value);
+  ERROR_T Delete(const KEY &key) { return ERROR_UNIMPL; }
+
+  // Appends up to count pairs, from the first key no smaller than key
+  // on, following the leaf links
+  ERROR_T Scan(const KEY &key, const SIZE_T count, vector<KEY> &keys, vector<VALUE> &values);
+
+  // Keys in order within and across nodes and along the leaf links,
+  // and every leaf at the same depth
+  ERROR_T SanityCheck();
+
+  BLOCKNUM_T GetRootNode() const { return superblock.rootnode; }
+  BLOCKNUM_T GetNumBlocksUsed() const { return superblock.highwater-superblock_index; }
+};
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::AllocateNode(BLOCKNUM_T &n)
+{
+  if (superblock.highwater>=buffercache->GetNumBlocks()) {
+    return ERROR_NOSPACE;
+  }
+  n=superblock.highwater++;
+  return buffercache->NotifyAllocateBlock(n);
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::WriteSuperblock()
+{
+  StaticPin s;
+  ERROR_T rc;
+
+  if ((rc=s.Pin(buffercache,superblock_index))) {
+    return rc;
+  }
+  memset(s.Data(),0,BLOCKSIZE);
+  memcpy(s.Data(),&superblock,sizeof(superblock));
+  s.MarkDirty();
+  return s.Unpin();
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::Attach(const BLOCKNUM_T initblock, const bool create)
+{
+  ERROR_T rc;
+
+  if (buffercache->GetBlockSize()!=BLOCKSIZE) {
+    return ERROR_SIZE;
+  }
+
+  superblock_index=initblock;
+
+  if (create) {
+    // superblock, then the root, which starts as an empty leaf
+    memset(&superblock,0,sizeof(superblock));
+    superblock.nodetype=BTREE_SUPERBLOCK;
+    superblock.format=BTREE_FORMAT_MAGIC|BTREE_FORMAT_STATIC;
+    superblock.keysize=sizeof(KEY);
+    superblock.valuesize=sizeof(VALUE);
+    superblock.blocksize=BLOCKSIZE;
+    superblock.rootnode=initblock+1;
+    superblock.highwater=initblock+2;
+
+    if (superblock.highwater>buffercache->GetNumBlocks()) {
+      return ERROR_NOSPACE;
+    }
+
+    buffercache->NotifyAllocateBlock(initblock);
+    buffercache->NotifyAllocateBlock(initblock+1);
+
+    StaticPin r;
+    if ((rc=r.Pin(buffercache,superblock.rootnode))) {
+      return rc;
+    }
+    Node(r.Data()).Init(BTREE_LEAF_NODE);
+    r.MarkDirty();
+    if ((rc=r.Unpin())) {
+      return rc;
+    }
+    return WriteSuperblock();
+  }
+
+  StaticPin s;
+  if ((rc=s.Pin(buffercache,superblock_index))) {
+    return rc;
+  }
+  memcpy(&superblock,s.Data(),sizeof(superblock));
+
+  if (superblock.nodetype!=BTREE_SUPERBLOCK ||
+      superblock.format!=(BTREE_FORMAT_MAGIC|BTREE_FORMAT_STATIC) ||
+      superblock.keysize!=sizeof(KEY) ||
+      superblock.valuesize!=sizeof(VALUE) ||
+      superblock.blocksize!=BLOCKSIZE) {
+    return ERROR_NOTANINDEX;
+  }
+  return s.Unpin();
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::Detach(BLOCKNUM_T &initblock)
+{
+  initblock=superblock_index;
+  return WriteSuperblock();
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::SplitChild(Node &parent, const SIZE_T offset, StaticPin &child)
+{
+  BLOCKNUM_T rightblock;
+  StaticPin r;
+  ERROR_T rc;
+
+  if ((rc=AllocateNode(rightblock)) || (rc=r.Pin(buffercache,rightblock))) {
+    return rc;
+  }
+
+  Node left(child.Data()), right(r.Data());
+  SIZE_T n=left.GetNumKeys();
+  SIZE_T mid=n/2;
+  KEY separator;
+
+  if (left.IsLeaf()) {
+    // The separator is the last key that stays on the left
+    right.Init(BTREE_LEAF_NODE);
+    memcpy(right.Keys(),left.Keys()+mid,(n-mid)*sizeof(KEY));
+    memcpy(right.Vals(),left.Vals()+mid,(n-mid)*sizeof(VALUE));
+    right.Head().numkeys=n-mid;
+    right.Head().link=left.Head().link;
+    left.Head().numkeys=mid;
+    left.Head().link=rightblock;
+    separator=left.Keys()[mid-1];
+  } else {
+    // The middle key moves up and is kept in neither half
+    right.Init(BTREE_INTERIOR_NODE);
+    memcpy(right.Keys(),left.Keys()+mid+1,(n-mid-1)*sizeof(KEY));
+    memcpy(right.Ptrs(),left.Ptrs()+mid+1,(n-mid)*sizeof(BLOCKNUM_T));
+    right.Head().numkeys=n-mid-1;
+    left.Head().numkeys=mid;
+    separator=left.Keys()[mid];
+  }
+
+  parent.InsertSeparator(offset,separator,rightblock);
+  child.MarkDirty();
+  r.MarkDirty();
+  return r.Unpin();
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::Insert(const KEY &key, const VALUE &value)
+{
+  StaticPin p, c;
+  ERROR_T rc;
+
+  if ((rc=p.Pin(buffercache,superblock.rootnode))) {
+    return rc;
+  }
+
+  // Full nodes are split on the way down, so there is always room in
+  // the parent for the separator of a split.  A full root gets a new
+  // root above it first.
+  if (Node(p.Data()).IsFull()) {
+    BLOCKNUM_T newroot;
+    if ((rc=AllocateNode(newroot)) || (rc=c.Pin(buffercache,newroot))) {
+      return rc;
+    }
+    Node root(c.Data());
+    root.Init(BTREE_INTERIOR_NODE);
+    root.Ptrs()[0]=superblock.rootnode;
+    c.MarkDirty();
+    if ((rc=SplitChild(root,0,p))) {
+      return rc;
+    }
+    superblock.rootnode=newroot;
+    p.Swap(c);
+    if ((rc=c.Unpin())) {
+      return rc;
+    }
+  }
+
+  while (1) {
+    Node node(p.Data());
+    SIZE_T offset=node.LowerBound(key,less);
+
+    if (node.IsLeaf()) {
+      if (offset<node.GetNumKeys() && Equal(node.Keys()[offset],key)) {
+	return ERROR_CONFLICT;
+      }
+      node.InsertPair(offset,key,value);
+      p.MarkDirty();
+      return p.Unpin();
+    }
+
+    if ((rc=c.Pin(buffercache,node.Ptrs()[offset]))) {
+      return rc;
+    }
+    if (Node(c.Data()).IsFull()) {
+      if ((rc=SplitChild(node,offset,c))) {
+	return rc;
+      }
+      p.MarkDirty();
+      if (less(node.Keys()[offset],key)) {
+	if ((rc=c.Pin(buffercache,node.Ptrs()[offset+1]))) {
+	  return rc;
+	}
+      }
+    }
+    p.Swap(c);
+  }
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::FindLeaf(const KEY &key, StaticPin &leaf)
+{
+  ERROR_T rc;
+
+  if ((rc=leaf.Pin(buffercache,superblock.rootnode))) {
+    return rc;
+  }
+  while (!Node(leaf.Data()).IsLeaf()) {
+    Node node(leaf.Data());
+    if ((rc=leaf.Pin(buffercache,node.Ptrs()[node.LowerBound(key,less)]))) {
+      return rc;
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::Lookup(const KEY &key, VALUE &value)
+{
+  StaticPin leaf;
+  ERROR_T rc;
+
+  if ((rc=FindLeaf(key,leaf))) {
+    return rc;
+  }
+  Node node(leaf.Data());
+  SIZE_T offset=node.LowerBound(key,less);
+  if (offset<node.GetNumKeys() && Equal(node.Keys()[offset],key)) {
+    value=node.Vals()[offset];
+    return leaf.Unpin();
+  }
+  return ERROR_NONEXISTENT;
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::Update(const KEY &key, const VALUE &value)
+{
+  StaticPin leaf;
+  ERROR_T rc;
+
+  if ((rc=FindLeaf(key,leaf))) {
+    return rc;
+  }
+  Node node(leaf.Data());
+  SIZE_T offset=node.LowerBound(key,less);
+  if (offset<node.GetNumKeys() && Equal(node.Keys()[offset],key)) {
+    node.Vals()[offset]=value;
+    leaf.MarkDirty();
+    return leaf.Unpin();
+  }
+  return ERROR_NONEXISTENT;
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::Scan(const KEY &key, const SIZE_T count,
+							  vector<KEY> &keys, vector<VALUE> &values)
+{
+  StaticPin leaf;
+  ERROR_T rc;
+  SIZE_T left=count;
+
+  if ((rc=FindLeaf(key,leaf))) {
+    return rc;
+  }
+  SIZE_T offset=Node(leaf.Data()).LowerBound(key,less);
+
+  while (left>0) {
+    Node node(leaf.Data());
+    for (;offset<node.GetNumKeys() && left>0;offset++, left--) {
+      keys.push_back(node.Keys()[offset]);
+      values.push_back(node.Vals()[offset]);
+    }
+    if (left==0 || node.Head().link==0) {
+      break;
+    }
+    if ((rc=leaf.Pin(buffercache,node.Head().link))) {
+      return rc;
+    }
+    offset=0;
+  }
+  return leaf.Unpin();
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::SanityHelper(const BLOCKNUM_T block,
+								  const KEY *low, const KEY *high,
+								  const SIZE_T depth, SIZE_T &leafdepth,
+								  BLOCKNUM_T &nextleaf)
+{
+  StaticPin p;
+  ERROR_T rc;
+
+  if ((rc=p.Pin(buffercache,block))) {
+    return rc;
+  }
+  Node node(p.Data());
+  SIZE_T n=node.GetNumKeys();
+  const KEY *keys=node.Keys();
+
+  if (node.Head().nodetype!=BTREE_LEAF_NODE && node.Head().nodetype!=BTREE_INTERIOR_NODE) {
+    cerr << "StaticBTreeIndex: block "<<block<<" is not a node\n";
+    return ERROR_INSANE;
+  }
+  if (n>(node.IsLeaf() ? Node::LEAFSLOTS : Node::INTERIORSLOTS)) {
+    cerr << "StaticBTreeIndex: node "<<block<<" has "<<n<<" keys\n";
+    return ERROR_INSANE;
+  }
+
+  // Keys in a subtree are above low and no larger than high
+  for (SIZE_T i=0;i<n;i++) {
+    if ((i>0 && !less(keys[i-1],keys[i])) ||
+	(i==0 && low && !less(*low,keys[i])) ||
+	(high && less(*high,keys[i]))) {
+      cerr << "StaticBTreeIndex: node "<<block<<" has key "<<i<<" out of order\n";
+      return ERROR_INSANE;
+    }
+  }
+
+  if (node.IsLeaf()) {
+    // The leaves are met in key order, so each must be the one the
+    // leaf before links to
+    if (leafdepth==0) {
+      leafdepth=depth;
+    } else if (leafdepth!=depth) {
+      cerr << "StaticBTreeIndex: leaf "<<block<<" is at depth "<<depth<<", not "<<leafdepth<<"\n";
+      return ERROR_INSANE;
+    } else if (nextleaf!=block) {
+      cerr << "StaticBTreeIndex: leaf "<<block<<" is not linked from the leaf before\n";
+      return ERROR_INSANE;
+    }
+    nextleaf=node.Head().link;
+    return ERROR_NOERROR;
+  }
+
+  if (n==0) {
+    cerr << "StaticBTreeIndex: interior node "<<block<<" has no keys\n";
+    return ERROR_INSANE;
+  }
+
+  for (SIZE_T i=0;i<=n;i++) {
+    if ((rc=SanityHelper(node.Ptrs()[i],
+			 i>0 ? &keys[i-1] : low,
+			 i<n ? &keys[i] : high,
+			 depth+1,leafdepth,nextleaf))) {
+      return rc;
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+
+template <typename KEY, typename VALUE, SIZE_T BLOCKSIZE, typename LESS>
+ERROR_T StaticBTreeIndex<KEY,VALUE,BLOCKSIZE,LESS>::SanityCheck()
+{
+  SIZE_T leafdepth=0;
+  BLOCKNUM_T nextleaf=0;
+  ERROR_T rc;
+
+  if ((rc=SanityHelper(superblock.rootnode,0,0,1,leafdepth,nextleaf))) {
+    return rc;
+  }
+  if (nextleaf!=0) {
+    cerr << "StaticBTreeIndex: the last leaf links to "<<nextleaf<<"\n";
+    return ERROR_INSANE;
+  }
+  return ERROR_NOERROR;
+}
+
+
+#endif
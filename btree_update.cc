@@ -11,7 +11,7 @@ int main(int argc, char **argv)
 {
   char *filestem;
   SIZE_T cachesize;
-  SIZE_T superblocknum;
+  BLOCKNUM_T superblocknum;
   char *key, *value;
 
   if (argc!=5) { 
@@ -40,7 +40,8 @@ int main(int argc, char **argv)
     return -1;
   } else {
     cerr << "Index attached!"<<endl;
-    if ((rc=btree.Update(KEY_T(key),VALUE_T(value)))!=ERROR_NOERROR) { 
+    KEY_T k;
+    if ((rc=btree.MakeKey(key,k)) || (rc=btree.Update(k,VALUE_T(value)))!=ERROR_NOERROR) { 
       cerr <<"Can't update index due to error "<<rc<<endl;
     } else {
       cerr <<"Update succeeded\n";
@@ -64,6 +65,7 @@ int main(int argc, char **argv)
     cerr << endl;
     
     cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+    disk.PrintStats(cerr);
 
     return 0;
   }
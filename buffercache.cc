@@ -4,7 +4,7 @@ ERROR_T BufferCache::CheckDeleteOldest()
 {
   // In a real buffer cache, we would use a priority queue to make this O(1)
 
-  map<SIZE_T, Block, cache_compare_lessthan>::iterator oldestptr=blockmap.end();
+  map<BLOCKNUM_T, Block, cache_compare_lessthan>::iterator oldestptr=blockmap.end();
   double oldest = curtime+1;
 
   // Only delete if the cache is full
@@ -14,10 +14,12 @@ ERROR_T BufferCache::CheckDeleteOldest()
 
   // Find oldest
 
-  for (map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
+  // Pinned frames are in use in place and stay, even if that leaves
+  // the cache over size for a while
+  for (map<BLOCKNUM_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
 	 i!=blockmap.end();
 	 ++i) {
-       if ((*i).second.lastaccessed<oldest) { 
+       if ((*i).second.pins==0 && (*i).second.lastaccessed<oldest) { 
 	 oldestptr=i;
 	 oldest=(*i).second.lastaccessed;
        }
@@ -68,7 +70,7 @@ ERROR_T BufferCache::Detach()
 {
   // write out all of our data and then throw it away
 
-  for (map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
+  for (map<BLOCKNUM_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
 	 i!=blockmap.end();
 	 ++i) {
     if ((*i).second.dirty) { 
@@ -99,7 +101,7 @@ SIZE_T BufferCache::GetBlockSize() const
   return disk->GetBlockSize();
 }
 
-SIZE_T BufferCache::GetNumBlocks() const
+BLOCKNUM_T BufferCache::GetNumBlocks() const
 {
   return disk->GetNumBlocks();
 }
@@ -109,28 +111,28 @@ double BufferCache::GetCurrentTime() const
   return curtime;
 }
 
-ERROR_T BufferCache::NotifyAllocateBlock(const SIZE_T outblocknum)
+ERROR_T BufferCache::NotifyAllocateBlock(const BLOCKNUM_T outblocknum)
 {
   allocs++;
   return disk->NotifyAllocateBlocks(outblocknum,1);
 }
 
-ERROR_T BufferCache::NotifyDeallocateBlock(const SIZE_T inblocknum)
+ERROR_T BufferCache::NotifyDeallocateBlock(const BLOCKNUM_T inblocknum)
 {
   deallocs++;
   return disk->NotifyDeallocateBlocks(inblocknum,1);
 }
 
 
-bool  BufferCache::IsBlockAllocated(const SIZE_T inblocknum)
+bool  BufferCache::IsBlockAllocated(const BLOCKNUM_T inblocknum)
 {
   return disk->IsBlockAllocated(inblocknum);
 }
 
 
-ERROR_T BufferCache::ReadBlock(const SIZE_T inblocknum, Block &outblock) 
+ERROR_T BufferCache::ReadBlock(const BLOCKNUM_T inblocknum, Block &outblock) 
 {
-  map<SIZE_T, Block, cache_compare_lessthan>::iterator b;
+  map<BLOCKNUM_T, Block, cache_compare_lessthan>::iterator b;
 
   b = blockmap.find(inblocknum);
 
@@ -167,14 +169,15 @@ ERROR_T BufferCache::ReadBlock(const SIZE_T inblocknum, Block &outblock)
   }
 } 
  
-ERROR_T BufferCache::WriteBlock(const SIZE_T inblocknum, const Block &inblock)
+ERROR_T BufferCache::WriteBlock(const BLOCKNUM_T inblocknum, const Block &inblock)
 {
-  map<SIZE_T, Block, cache_compare_lessthan>::iterator b;
+  map<BLOCKNUM_T, Block, cache_compare_lessthan>::iterator b;
   
   b = blockmap.find(inblocknum);
 
   if (b!=blockmap.end()) {
-    // It's in  cache, so just replace the block
+    // It's in  cache, so just replace the block.  Assignment keeps the
+    // buffer (and its pins), so a pinned frame stays where it is.
     (*b).second=inblock;
     (*b).second.lastaccessed=curtime;
     (*b).second.dirty=true;
@@ -197,15 +200,67 @@ ERROR_T BufferCache::WriteBlock(const SIZE_T inblocknum, const Block &inblock)
   }
 }
   
-ERROR_T BufferCache::PrefetchBlock (const SIZE_T blocknum)
+ERROR_T BufferCache::PinBlock(const BLOCKNUM_T blocknum, Block *&frame)
+{
+  map<BLOCKNUM_T, Block, cache_compare_lessthan>::iterator b;
+
+  b = blockmap.find(blocknum);
+
+  if (b==blockmap.end()) {
+    // Not in cache, so read it straight into a new frame
+    CheckDeleteOldest();
+    if (!(disk->IsBlockAllocated(blocknum))) { 
+      if (PRINT_BUFFERCACHE_ALLOCATION_ERRORS) {
+	cerr << "BufferCache::PinBlock: Attempt to read unallocated block " << blocknum<<endl;
+      }
+    }
+    b = blockmap.insert(make_pair(blocknum,Block())).first;
+    double reqtime;
+    int rc = disk->Read(blocknum,
+			(*b).second,
+			reqtime);
+    curtime+=reqtime;
+    diskreads++;
+    if (rc!=ERROR_NOERROR) { 
+      blockmap.erase(b);
+      return rc;
+    }
+    (*b).second.dirty=false;
+  }
+  (*b).second.lastaccessed=curtime;
+  (*b).second.pins++;
+  reads++;
+  frame=&((*b).second);
+  return ERROR_NOERROR;
+}
+
+ERROR_T BufferCache::UnpinBlock(const BLOCKNUM_T blocknum, const bool dirty)
+{
+  map<BLOCKNUM_T, Block, cache_compare_lessthan>::iterator b;
+
+  b = blockmap.find(blocknum);
+
+  if (b==blockmap.end() || (*b).second.pins==0) { 
+    return ERROR_INSANE;
+  }
+  (*b).second.pins--;
+  if (dirty) { 
+    (*b).second.lastaccessed=curtime;
+    (*b).second.dirty=true;
+    writes++;
+  }
+  return ERROR_NOERROR;
+}
+  
+ERROR_T BufferCache::PrefetchBlock (const BLOCKNUM_T blocknum)
 {
   // Not implemented yet
   return ERROR_IMPLBUG;
 }
   
-ERROR_T BufferCache::FlushBlock(const SIZE_T blocknum)
+ERROR_T BufferCache::FlushBlock(const BLOCKNUM_T blocknum)
 {
-  map<SIZE_T, Block, cache_compare_lessthan>::iterator b;
+  map<BLOCKNUM_T, Block, cache_compare_lessthan>::iterator b;
   
   b = blockmap.find(blocknum);
 
@@ -223,8 +278,12 @@ ERROR_T BufferCache::FlushBlock(const SIZE_T blocknum)
       if (rc!=ERROR_NOERROR) { 
 	return rc;
       }
+      (*b).second.dirty=false;
+    }
+    // a pinned frame is written but stays where it is
+    if ((*b).second.pins==0) { 
+      blockmap.erase(b);
     }
-    blockmap.erase(b);
     return ERROR_NOERROR;
   }
 }
@@ -243,7 +302,7 @@ ostream & BufferCache::Print(ostream &os) const
      << ", blocks = {";
 
   
-  for (map<SIZE_T, Block, cache_compare_lessthan>::const_iterator b=blockmap.begin(); 
+  for (map<BLOCKNUM_T, Block, cache_compare_lessthan>::const_iterator b=blockmap.begin(); 
        b!=blockmap.end(); 
        ++b) {
     if (b!=blockmap.begin()) { 
@@ -11,7 +11,7 @@
 using namespace std;
 
 struct cache_compare_lessthan {
-  bool operator()(const SIZE_T s1, const SIZE_T s2) const {
+  bool operator()(const BLOCKNUM_T s1, const BLOCKNUM_T s2) const {
     return s1<s2;
   }
 };
@@ -26,7 +26,7 @@ class BufferCache {
  private:
   DiskSystem *disk;
   SIZE_T cachesize;
-  map<SIZE_T, Block, cache_compare_lessthan> blockmap;
+  map<BLOCKNUM_T, Block, cache_compare_lessthan> blockmap;
   double curtime;
   SIZE_T allocs, deallocs, reads, writes, diskreads, diskwrites;
  protected:
@@ -50,36 +50,44 @@ class BufferCache {
   // Number of bytes per block
   SIZE_T GetBlockSize() const;
   // Number of blocks in the underlying device
-  SIZE_T GetNumBlocks() const;
+  BLOCKNUM_T GetNumBlocks() const;
   // Current time in the simulation (starts at zero)
   double GetCurrentTime() const;
 
   // outblocknum is the number of the block that we just allocated
   // if the error return is nonzero
-  ERROR_T NotifyAllocateBlock(const SIZE_T outblocknum);
+  ERROR_T NotifyAllocateBlock(const BLOCKNUM_T outblocknum);
   // inblocknum is the block that we just deallocated
-  ERROR_T NotifyDeallocateBlock(const SIZE_T inblocknum);
+  ERROR_T NotifyDeallocateBlock(const BLOCKNUM_T inblocknum);
   // check to see if we think the block was allocated
-  bool  IsBlockAllocated(const SIZE_T inblocknum);
+  bool  IsBlockAllocated(const BLOCKNUM_T inblocknum);
   
   // returns one of ERROR_NOERROR  (zero)
   // ERROR_NOSUCHBLOCK or other nonzero error codes
-  ERROR_T ReadBlock(const SIZE_T inblocknum, Block &outblock);
+  ERROR_T ReadBlock(const BLOCKNUM_T inblocknum, Block &outblock);
   
   // returns one of ERROR_NOERROR  (zero)
   // ERROR_NOSUCHBLOCK
   // ERROR_WRONGSIZEBLOCK or other nonzero error codes
-  ERROR_T WriteBlock(const SIZE_T inblocknum, const Block &inblock);
+  ERROR_T WriteBlock(const BLOCKNUM_T inblocknum, const Block &inblock);
+
+  // Gives a pointer to the cached copy of the block itself, reading it
+  // in if need be, and pins it so that it is not evicted.  The frame
+  // can be read and changed in place until it is unpinned.  Unpin it
+  // with dirty=true if it was changed, which counts as a write.
+  // Pins nest.  Reads and writes of a pinned block go to the frame.
+  ERROR_T PinBlock(const BLOCKNUM_T blocknum, Block *&frame);
+  ERROR_T UnpinBlock(const BLOCKNUM_T blocknum, const bool dirty=false);
   
   // Request that a block be read into the cache
   // This returns immediately.
   // ERROR_NOFETCH means that there is no room currently
   // to prefetch the block and it was not prefetched.
-  ERROR_T PrefetchBlock (const SIZE_T blocknum);
+  ERROR_T PrefetchBlock (const BLOCKNUM_T blocknum);
   
   // Request that a block be flushed to disk
   // Note that this blocks until the block is finished.
-  ERROR_T FlushBlock(const SIZE_T blocknum);
+  ERROR_T FlushBlock(const BLOCKNUM_T blocknum);
   
  
   SIZE_T GetNumAllocs() const { return allocs; }
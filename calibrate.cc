@@ -0,0 +1,245 @@
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "disksystem.h"
+
+// Latencies below this are treated as free; DiskSystem insists on
+// positive latencies
+#define CALIBRATE_EPSILON 1e-6
+
+// Bytes read to measure the sequential transfer rate
+#define CALIBRATE_SEQ_BYTES (64*1024*1024)
+
+void usage()
+{
+  cerr << "usage: calibrate filestem device blocksize [blockspertrack [numblocks [samples]]]\n";
+  cerr << "       times preads against device (a file or block device) and makes the\n";
+  cerr << "       disk filestem with seek and rotation parameters fitted to them\n";
+  cerr << "       blockspertrack defaults to 64, numblocks to the size of device,\n";
+  cerr << "       and samples (per seek distance) to 200\n";
+}
+
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec*1000.0 + ts.tv_nsec/1000000.0;
+}
+
+
+// Time in milliseconds to read numblock blocks starting at block
+static double timedread(int fd, BYTE_T *buf, const SIZE_T blocksize,
+			const BLOCKNUM_T block, const SIZE_T numblock)
+{
+  double start=now();
+  ssize_t want=(ssize_t)numblock*blocksize;
+
+  if (pread(fd,buf,want,(off_t)(block*blocksize))!=want) {
+    cerr << "calibrate: read of block "<<block<<" failed\n";
+    exit(-1);
+  }
+  return now()-start;
+}
+
+
+static BLOCKNUM_T randblock(const BLOCKNUM_T lo, const BLOCKNUM_T n)
+{
+  return lo + (((BLOCKNUM_T)random()<<31) ^ random()) % n;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<4 || argc>7) {
+    usage();
+    exit(-1);
+  }
+
+  SIZE_T blocksize = atoi(argv[3]);
+  SIZE_T blockspertrack = argc>=5 ? atoi(argv[4]) : 64;
+  BLOCKNUM_T numblocks = argc>=6 ? strtoull(argv[5],0,0) : 0;
+  SIZE_T samples = argc>=7 ? atoi(argv[6]) : 200;
+
+  if (blocksize==0 || blockspertrack==0 || samples==0) {
+    usage();
+    exit(-1);
+  }
+
+  // Bypass the page cache where we can, otherwise we time memory
+  int fd = open(argv[2],O_RDONLY|O_DIRECT);
+  bool direct = fd>=0;
+
+  if (!direct) {
+    fd=open(argv[2],O_RDONLY);
+  }
+  if (fd<0) {
+    cerr << "calibrate: cannot open "<<argv[2]<<"\n";
+    exit(-1);
+  }
+  if (!direct) {
+    cerr << "calibrate: O_DIRECT unavailable, results may include the page cache\n";
+  }
+
+  struct stat st;
+  OFFSET_T devbytes=0;
+
+  if (fstat(fd,&st)==0) {
+    devbytes=st.st_size;
+  }
+#ifdef BLKGETSIZE64
+  if (S_ISBLK(st.st_mode)) {
+    ioctl(fd,BLKGETSIZE64,&devbytes);
+  }
+#endif
+
+  BLOCKNUM_T devblocks = devbytes/blocksize;
+
+  if (numblocks==0) {
+    numblocks=devblocks;
+  }
+  numblocks -= numblocks%blockspertrack;
+
+  BLOCKNUM_T numtracks = numblocks/blockspertrack;
+
+  if (numtracks<2 || devblocks<numblocks) {
+    cerr << "calibrate: "<<argv[2]<<" has only "<<devblocks<<" blocks, need at least two tracks\n";
+    exit(-1);
+  }
+
+  BYTE_T *buf;
+  SIZE_T buflen = blockspertrack*blocksize;
+
+  if (posix_memalign((void**)&buf,4096,buflen)) {
+    cerr << "calibrate: out of memory\n";
+    exit(-1);
+  }
+
+  srandom(time(0));
+
+  // Sequential transfer: whole tracks back to back.  A track takes one
+  // rotation to read.
+  BLOCKNUM_T seqtracks = CALIBRATE_SEQ_BYTES/buflen;
+  if (seqtracks<1) { seqtracks=1; }
+  if (seqtracks>numtracks) { seqtracks=numtracks; }
+
+  double seqtime=0;
+  for (BLOCKNUM_T t=0;t<seqtracks;t++) {
+    seqtime+=timedread(fd,buf,blocksize,t*blockspertrack,blockspertrack);
+  }
+  double blocktime = seqtime/(seqtracks*blockspertrack);
+
+  cerr << "sequential: "<<blocktime<<" ms per block\n";
+
+  // Single block reads a given number of tracks away from the last
+  // one, at a random sector.  The model charges a seek for the
+  // distance, half a rotation on average to reach the sector, and the
+  // transfer of the block.
+  vector<BLOCKNUM_T> distances;
+  vector<double> latencies;
+
+  for (BLOCKNUM_T d=1; d<numtracks; d*=2) {
+    double total=0;
+    for (SIZE_T i=0;i<samples;i++) {
+      BLOCKNUM_T t=randblock(0,numtracks-d);
+      timedread(fd,buf,blocksize,t*blockspertrack+randblock(0,blockspertrack),1);
+      total+=timedread(fd,buf,blocksize,(t+d)*blockspertrack+randblock(0,blockspertrack),1);
+    }
+    distances.push_back(d);
+    latencies.push_back(total/samples);
+    cerr << "seek "<<d<<" tracks: "<<total/samples<<" ms\n";
+  }
+
+  close(fd);
+  free(buf);
+
+  double averageseeklatency, trackseeklatency, rotationallatency;
+  double nearest=latencies.front(), farthest=latencies.back();
+
+  if (farthest < 1.5*nearest) {
+    // Flash: the cost does not depend on distance, only a fixed cost per
+    // request plus a cost per block.  With no seek, a random request waits
+    // half a rotation on average and a block takes 1/blockspertrack of
+    // one, so pick the rotation and track length that give those costs.
+    double fixed=0;
+    for (SIZE_T i=0;i<latencies.size();i++) {
+      fixed+=latencies[i];
+    }
+    fixed = fixed/latencies.size() - blocktime;
+    if (fixed<blocktime) {
+      fixed=blocktime;
+    }
+    averageseeklatency=CALIBRATE_EPSILON;
+    trackseeklatency=CALIBRATE_EPSILON;
+    rotationallatency=2*fixed;
+    blockspertrack=(SIZE_T)(rotationallatency/blocktime+0.5);
+    if (blockspertrack<1) {
+      blockspertrack=1;
+    }
+    numblocks -= numblocks%blockspertrack;
+    numtracks = numblocks/blockspertrack;
+    cerr << "latency does not depend on seek distance, using a flash model\n";
+  } else {
+    rotationallatency = blocktime*blockspertrack;
+
+    // What is left over after rotation and transfer is the seek
+    vector<double> seek;
+    for (SIZE_T i=0;i<latencies.size();i++) {
+      double s = latencies[i] - rotationallatency*(blockspertrack-1)/(2.0*blockspertrack)
+	- blocktime;
+      seek.push_back(s>0 ? s : 0);
+    }
+
+    trackseeklatency = seek.front();
+
+    // Long seeks cost averageseeklatency*distance/(numtracks/2); fit that
+    // line through the origin to the seeks past a sixteenth of the disk
+    double sxy=0, sxx=0;
+    for (SIZE_T i=0;i<distances.size();i++) {
+      if (distances[i]*16 >= numtracks || i+1==distances.size()) {
+	double x = 2.0*distances[i]/numtracks;
+	sxy+=x*seek[i];
+	sxx+=x*x;
+      }
+    }
+    averageseeklatency = sxy/sxx;
+
+    if (trackseeklatency<CALIBRATE_EPSILON) { trackseeklatency=CALIBRATE_EPSILON; }
+    if (averageseeklatency<CALIBRATE_EPSILON) { averageseeklatency=CALIBRATE_EPSILON; }
+  }
+  if (rotationallatency<CALIBRATE_EPSILON) { rotationallatency=CALIBRATE_EPSILON; }
+
+  cerr << "averageseeklatency = "<<averageseeklatency<<"\n";
+  cerr << "trackseeklatency   = "<<trackseeklatency<<"\n";
+  cerr << "rotationallatency  = "<<rotationallatency<<"\n";
+  cerr << "blockspertrack     = "<<blockspertrack<<"\n";
+
+  DiskSystem disk(argv[1],
+		  true,
+		  0,
+		  numblocks,
+		  blocksize,
+		  1,
+		  blockspertrack,
+		  numtracks,
+		  averageseeklatency,
+		  trackseeklatency,
+		  rotationallatency);
+
+  cerr << "Disk is as follows.\n" << disk << "\n";
+
+  cerr << "Done.\n";
+
+  return 0;
+}
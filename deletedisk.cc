@@ -20,6 +20,23 @@ int main(int argc, char *argv[])
   remove((string(argv[1])+".data").c_str());
   remove((string(argv[1])+".bitmap").c_str());
   remove((string(argv[1])+".config").c_str());
+  remove((string(argv[1])+".map").c_str());
+  remove((string(argv[1])+".log").c_str());
+  remove((string(argv[1])+".tiermap").c_str());
+
+  // members of a striped disk are "filestem.0", "filestem.1", ...
+  for (int i=0; ; i++) { 
+    char member[16];
+    sprintf(member,".%d",i);
+    string stem=string(argv[1])+member;
+    if (remove((stem+".config").c_str())) { 
+      break;
+    }
+    remove((stem+".data").c_str());
+    remove((stem+".bitmap").c_str());
+    remove((stem+".map").c_str());
+    remove((stem+".log").c_str());
+  }
 
   cerr << "Done.\n";
 
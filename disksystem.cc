@@ -1,3 +1,5 @@
+#define _FILE_OFFSET_BITS 64
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -10,12 +12,12 @@
 #include "disksystem.h"
 
 
-static SIZE_T mywrite(FILE *f, const SIZE_T off, const BYTE_T *buf, const int len)
+static size_t mywrite(FILE *f, const OFFSET_T off, const BYTE_T *buf, const size_t len)
 {
-  SIZE_T left=len;
-  SIZE_T sent;
+  size_t left=len;
+  size_t sent;
 
-  fseek(f,off,SEEK_SET);
+  fseeko(f,(off_t)off,SEEK_SET);
   while (left>0) {
     sent=fwrite(&(buf[len-left]),1,left,f);
     if (sent<0) {	
@@ -29,12 +31,12 @@ static SIZE_T mywrite(FILE *f, const SIZE_T off, const BYTE_T *buf, const int le
   return len-left;
 }
 
-static SIZE_T myread(FILE *f, const SIZE_T off, BYTE_T *buf, const int len, bool trunconeof=true)
+static size_t myread(FILE *f, const OFFSET_T off, BYTE_T *buf, const size_t len, bool trunconeof=true)
 {
-  SIZE_T left=len;
-  SIZE_T sent;
+  size_t left=len;
+  size_t sent;
 
-  fseek(f,off,SEEK_SET);
+  fseeko(f,(off_t)off,SEEK_SET);
   while (left>0) {
     sent=fread(&(buf[len-left]),1,left,f);
     if (sent<0) {	
@@ -71,18 +73,95 @@ static SIZE_T myread(FILE *f, const SIZE_T off, BYTE_T *buf, const int len, bool
 }
 
 
+//
+// Run length coding of a block (PackBits).  A control byte c<128 is
+// followed by c+1 literal bytes.  A control byte c>=128 is followed by
+// one byte that is repeated c-126 times.  B-tree blocks are mostly
+// zero padding and runs of repeated key bytes, which this handles well.
+//
+// Returns the compressed length, or 0 if it would exceed outmax.
+//
+static SIZE_T rle_compress(const BYTE_T *in, const SIZE_T len, BYTE_T *out, const SIZE_T outmax)
+{
+  SIZE_T i=0, o=0;
+
+  while (i<len) { 
+    SIZE_T run=1;
+    while (i+run<len && run<129 && in[i+run]==in[i]) { 
+      run++;
+    }
+    if (run>=2) { 
+      if (o+2>outmax) { 
+	return 0;
+      }
+      out[o++]=(BYTE_T)(run+126);
+      out[o++]=in[i];
+      i+=run;
+    } else {
+      // literals extend until the next run of at least 3
+      SIZE_T lit=1;
+      while (i+lit<len && lit<128 &&
+	     !(i+lit+2<len && in[i+lit]==in[i+lit+1] && in[i+lit]==in[i+lit+2])) { 
+	lit++;
+      }
+      if (o+1+lit>outmax) { 
+	return 0;
+      }
+      out[o++]=(BYTE_T)(lit-1);
+      memcpy(out+o,in+i,lit);
+      o+=lit;
+      i+=lit;
+    }
+  }
+  return o;
+}
+
+static bool rle_decompress(const BYTE_T *in, const SIZE_T inlen, BYTE_T *out, const SIZE_T len)
+{
+  SIZE_T i=0, o=0;
+
+  while (o<len) { 
+    if (i>=inlen) { 
+      return false;
+    }
+    BYTE_T c=in[i++];
+    if (c<128) { 
+      SIZE_T lit=c+1;
+      if (i+lit>inlen || o+lit>len) { 
+	return false;
+      }
+      memcpy(out+o,in+i,lit);
+      i+=lit;
+      o+=lit;
+    } else {
+      SIZE_T run=c-126;
+      if (i>=inlen || o+run>len) { 
+	return false;
+      }
+      memset(out+o,in[i++],run);
+      o+=run;
+    }
+  }
+  return true;
+}
+
+
 DiskSystem::DiskSystem(const string &filestem,
 		       const bool   create,
-		       const SIZE_T offset,
-		       const SIZE_T blcks,
+		       const OFFSET_T offset,
+		       const BLOCKNUM_T blcks,
 		       const SIZE_T blcksize,
 		       const SIZE_T heads,
 		       const SIZE_T blckspertrack,
-		       const SIZE_T tracks,
+		       const BLOCKNUM_T tracks,
 		       const double avgseek,
 		       const double trackseek,
-		       const double rotlat) :
-  bitmap(0),
+		       const double rotlat,
+		       const SIZE_T numdisks,
+		       const SIZE_T stripe,
+		       const SIZE_T sectsize,
+		       const SIZE_T segsize) :
+  configdirty(false),
   datafilefd(0),
   configfilefd(0),
   bitmapfilefd(0),
@@ -97,11 +176,35 @@ DiskSystem::DiskSystem(const string &filestem,
   last_sector(0),
   averageseeklatency(avgseek),
   trackseeklatency(trackseek),
-  rotationallatency(rotlat)
+  rotationallatency(rotlat),
+  stripeunit(stripe),
+  sectorsize(sectsize),
+  mapfilefd(0),
+  mapdirtylo(0),
+  mapdirtyhi(0),
+  storedblocks(0),
+  storedsectors(0),
+  logicalbytes(0),
+  physicalbytes(0),
+  segmentsize(segsize),
+  logblocks(0),
+  headsegment(0),
+  headused(0),
+  segmentssincecheckpoint(0),
+  cleanedsegments(0),
+  cleanedblocks(0),
+  cleaningtime(0),
+  tiered(false),
+  heataccesses(0),
+  clockhand(0)
 {
   if (create) { 
     // Only in this case are the parameters used:
-    InitFromInMemoryConfig();
+    if (numdisks>1) { 
+      InitStripedFromInMemoryConfig(numdisks);
+    } else {
+      InitFromInMemoryConfig();
+    }
   } else {
     InitFromConfigFile();
   }
@@ -109,12 +212,40 @@ DiskSystem::DiskSystem(const string &filestem,
 
 DiskSystem::~DiskSystem()
 {
-  WriteConfig();
+  if (IsTiered()) { 
+    WriteTierMap();
+    fclose(configfilefd);
+    delete members[0];
+    delete members[1];
+    members.clear();
+    return;
+  }
+  if (IsStriped()) { 
+    if (configdirty) { 
+      WriteStripedConfig();
+    }
+    fclose(configfilefd);
+    for (SIZE_T i=0;i<members.size();i++) { 
+      delete members[i];
+    }
+    members.clear();
+    return;
+  }
+  if (configdirty) { 
+    WriteConfig();
+  }
   WriteBitMap();
   fclose(configfilefd);
   fclose(bitmapfilefd);
   fclose(datafilefd);
-  delete [] bitmap;
+  FreeBitMap();
+  if (IsCompressed()) { 
+    WriteSlotMap();
+    fclose(mapfilefd);
+  }
+  if (IsLogStructured()) { 
+    WriteCheckpoint();
+  }
 }
 
 ERROR_T DiskSystem::SanityCheckConfig()
@@ -127,6 +258,14 @@ ERROR_T DiskSystem::SanityCheckConfig()
     cerr << "Geometry mismatch.\n";
     return ERROR_BADCONFIG;
   }
+  if (sectorsize && (blocksize%sectorsize || blocksize/sectorsize>65535)) { 
+    cerr << "Sector size must divide the block size.\n";
+    return ERROR_BADCONFIG;
+  }
+  if (segmentsize && (sectorsize || numblocks%segmentsize || numblocks/segmentsize<3)) { 
+    cerr << "A log structured disk needs at least 3 whole segments and no compression.\n";
+    return ERROR_BADCONFIG;
+  }
 
   return ERROR_NOERROR;
 }
@@ -136,13 +275,13 @@ ERROR_T DiskSystem::WriteConfig()
 {
   ftruncate(fileno(configfilefd),0);
   rewind(configfilefd);
-  fprintf(configfilefd,"# disksystem config file version 0.9\n");
+  fprintf(configfilefd,"# disksystem config file version 1.1\n");
   fprintf(configfilefd,"# filestem\n");
   fprintf(configfilefd,"%s\n",diskfilestem.c_str());
   fprintf(configfilefd,"# offset\n");
-  fprintf(configfilefd,"%u\n",offset);
+  fprintf(configfilefd,"%llu\n",offset);
   fprintf(configfilefd,"# numblocks\n");
-  fprintf(configfilefd,"%u\n",numblocks);
+  fprintf(configfilefd,"%llu\n",numblocks);
   fprintf(configfilefd,"# blocksize\n");
   fprintf(configfilefd,"%u\n",blocksize);
   fprintf(configfilefd,"# numheads\n");
@@ -150,14 +289,19 @@ ERROR_T DiskSystem::WriteConfig()
   fprintf(configfilefd,"# blockspertrack\n");
   fprintf(configfilefd,"%u\n",blockspertrack);
   fprintf(configfilefd,"# numtracks\n");
-  fprintf(configfilefd,"%u\n",numtracks);
+  fprintf(configfilefd,"%llu\n",numtracks);
   fprintf(configfilefd,"# averageseeklatency\n");
   fprintf(configfilefd,"%lf\n",averageseeklatency);
   fprintf(configfilefd,"# trackseeklatency\n");
   fprintf(configfilefd,"%lf\n",trackseeklatency);
   fprintf(configfilefd,"# rotationalatency\n");
   fprintf(configfilefd,"%lf\n",rotationallatency);
+  fprintf(configfilefd,"# compressed sectorsize (0 if uncompressed)\n");
+  fprintf(configfilefd,"%u\n",sectorsize);
+  fprintf(configfilefd,"# log segmentsize in blocks (0 if written in place)\n");
+  fprintf(configfilefd,"%u\n",segmentsize);
   fflush(configfilefd);
+  configdirty=false;
 
   return ERROR_NOERROR;
 }
@@ -170,6 +314,7 @@ ERROR_T DiskSystem::ReadConfig()
 
 #define GETNEXTVAL do { fgets(buf,80,configfilefd); } while (buf[0]=='#')  
 #define PARSEUNSIGNED(x) do { sscanf(buf,"%u",x); } while (0)
+#define PARSEUNSIGNED64(x) do { sscanf(buf,"%llu",x); } while (0)
 #define PARSEDOUBLE(x) do { sscanf(buf,"%lf",x); } while (0)
 
   rewind(configfilefd);
@@ -179,9 +324,9 @@ ERROR_T DiskSystem::ReadConfig()
   }
   diskfilestem = string(buf);
   GETNEXTVAL;
-  PARSEUNSIGNED(&offset);
+  PARSEUNSIGNED64(&offset);
   GETNEXTVAL;
-  PARSEUNSIGNED(&numblocks);
+  PARSEUNSIGNED64(&numblocks);
   GETNEXTVAL;
   PARSEUNSIGNED(&blocksize);
   GETNEXTVAL;
@@ -189,7 +334,7 @@ ERROR_T DiskSystem::ReadConfig()
   GETNEXTVAL;
   PARSEUNSIGNED(&blockspertrack);
   GETNEXTVAL;
-  PARSEUNSIGNED(&numtracks);
+  PARSEUNSIGNED64(&numtracks);
   GETNEXTVAL;
   PARSEDOUBLE(&averageseeklatency);
   GETNEXTVAL;
@@ -197,37 +342,101 @@ ERROR_T DiskSystem::ReadConfig()
   GETNEXTVAL;
   PARSEDOUBLE(&rotationallatency);
 
+  // Version 1.0 files end here, and the values after this are optional
+  SIZE_T *optional[] = { &sectorsize, &segmentsize };
+  SIZE_T numoptional=0;
+
+  sectorsize=0;
+  segmentsize=0;
+  while (numoptional<2 && fgets(buf,80,configfilefd)) { 
+    if (buf[0]!='#') { 
+      PARSEUNSIGNED(optional[numoptional++]);
+    }
+  }
+
   return ERROR_NOERROR;
 }
 
 
-ERROR_T DiskSystem::WriteBitMap()
+OFFSET_T DiskSystem::GetNumBitMapBytes() const
 {
-  rewind(bitmapfilefd);
-  
-  SIZE_T numbitmapbytes = numblocks / 8 + (numblocks%8 != 0); 
+  return numblocks / 8 + (numblocks%8 != 0); 
+}
 
-  if (mywrite(bitmapfilefd,0,bitmap,numbitmapbytes)!=numbitmapbytes) { 
-    cerr << "Can't write bitmap file\n";
+// The last chunk may be short
+SIZE_T DiskSystem::GetBitMapChunkBytes(const BLOCKNUM_T chunk) const
+{
+  OFFSET_T left = GetNumBitMapBytes() - chunk*DISKSYSTEM_BITMAP_CHUNK_BYTES;
+
+  return left < DISKSYSTEM_BITMAP_CHUNK_BYTES ? (SIZE_T)left : DISKSYSTEM_BITMAP_CHUNK_BYTES;
+}
+
+ERROR_T DiskSystem::ReadBitMapChunk(const BLOCKNUM_T chunk, BYTE_T *buf) const
+{
+  SIZE_T len = GetBitMapChunkBytes(chunk);
+
+  memset(buf,0,DISKSYSTEM_BITMAP_CHUNK_BYTES);
+
+  if (myread(bitmapfilefd,chunk*DISKSYSTEM_BITMAP_CHUNK_BYTES,buf,len,false)!=len) { 
+    cerr << "Can't read bitmap file\n";
     return ERROR_IMPLBUG;
   }
   return ERROR_NOERROR;
 }
 
-ERROR_T DiskSystem::ReadBitMap()
+BYTE_T * DiskSystem::GetBitMapChunk(const BLOCKNUM_T chunk)
 {
-  rewind(bitmapfilefd);
-  
-  SIZE_T numbitmapbytes = numblocks / 8 + (numblocks%8 != 0); 
+  if (!bitmapchunks[chunk]) { 
+    bitmapchunks[chunk] = new BYTE_T [DISKSYSTEM_BITMAP_CHUNK_BYTES];
+    ReadBitMapChunk(chunk,bitmapchunks[chunk]);
+  }
+  return bitmapchunks[chunk];
+}
+
+void DiskSystem::FreeBitMap()
+{
+  for (BLOCKNUM_T i=0;i<bitmapchunks.size();i++) { 
+    delete [] bitmapchunks[i];
+  }
+  bitmapchunks.clear();
+  bitmapdirty.clear();
+}
 
-  if (bitmap) { delete [] bitmap; } ;
+ERROR_T DiskSystem::WriteBitMap()
+{
+  for (BLOCKNUM_T i=0;i<bitmapchunks.size();i++) { 
+    if (bitmapdirty[i]) { 
+      SIZE_T len = GetBitMapChunkBytes(i);
+      if (mywrite(bitmapfilefd,i*DISKSYSTEM_BITMAP_CHUNK_BYTES,bitmapchunks[i],len)!=len) { 
+	cerr << "Can't write bitmap file\n";
+	return ERROR_IMPLBUG;
+      }
+      bitmapdirty[i]=false;
+    }
+  }
+  fflush(bitmapfilefd);
+  return ERROR_NOERROR;
+}
 
-  bitmap = new BYTE_T [numbitmapbytes];
+//
+// Nothing is read here - chunks are read as they are touched
+//
+ERROR_T DiskSystem::ReadBitMap()
+{
+  struct stat s;
+  OFFSET_T numbitmapbytes = GetNumBitMapBytes();
+  BLOCKNUM_T numchunks = numbitmapbytes/DISKSYSTEM_BITMAP_CHUNK_BYTES 
+    + (numbitmapbytes%DISKSYSTEM_BITMAP_CHUNK_BYTES != 0);
 
-  if (myread(bitmapfilefd,0,bitmap,numbitmapbytes,false)!=numbitmapbytes) { 
+  if (fstat(fileno(bitmapfilefd),&s) || (OFFSET_T)s.st_size<numbitmapbytes) { 
     cerr << "Can't read bitmap file\n";
     return ERROR_IMPLBUG;
   }
+
+  FreeBitMap();
+  bitmapchunks.assign(numchunks,(BYTE_T*)0);
+  bitmapdirty.assign(numchunks,false);
+
   return ERROR_NOERROR;
 }
 
@@ -245,6 +454,17 @@ ERROR_T DiskSystem::InitFromConfigFile()
     return ERROR_NOFILE;
   }
 
+  // A striped or tiered disk has only a config file; the data lives in the members
+  char header[80];
+
+  if (fgets(header,80,configfilefd) && strstr(header,"striped")) { 
+    return ReadStripedConfig();
+  }
+
+  if (strstr(header,"tiered")) { 
+    return ReadTieredConfig();
+  }
+
   int rc = ReadConfig();
   
   if (rc) { 
@@ -276,6 +496,14 @@ ERROR_T DiskSystem::InitFromConfigFile()
     return rc;
   }
 
+  if (IsCompressed()) { 
+    return InitSlotMap(false);
+  }
+
+  if (IsLogStructured()) { 
+    return InitLog(false);
+  }
+
   return ERROR_NOERROR;
 }
 
@@ -322,15 +550,8 @@ ERROR_T DiskSystem::InitFromInMemoryConfig()
   }
 
 
-  // allocate in-memory bitmap
-
-  SIZE_T numbitmapbytes = numblocks / 8 + (numblocks%8 != 0); 
-  
-  bitmap = new BYTE_T [numbitmapbytes];
-
-  memset(bitmap,0,numbitmapbytes);
-
-  // create the bitmap file and write out the bitmap
+  // create the bitmap file as a run of zeros and set up the
+  // in-memory bitmap, whose chunks will be read as needed
 
   if (bitmapfilefd) { fclose(bitmapfilefd); }
 
@@ -338,7 +559,12 @@ ERROR_T DiskSystem::InitFromInMemoryConfig()
     return ERROR_NOFILE;
   }
 
-  rc = WriteBitMap();
+  if (ftruncate(fileno(bitmapfilefd),GetNumBitMapBytes())) { 
+    cerr << "Can't write bitmap file\n";
+    return ERROR_IMPLBUG;
+  }
+
+  rc = ReadBitMap();
   
   if (rc) { 
     return rc;
@@ -362,218 +588,1694 @@ ERROR_T DiskSystem::InitFromInMemoryConfig()
     }
   }
 
+  // Extend the data file to cover the whole disk.  ftruncate leaves a
+  // hole, so this takes no time or space no matter how big the disk is,
+  // and unwritten blocks read back as zeros.
+  if (fstat(fileno(datafilefd),&s)==0 && 
+      (OFFSET_T)s.st_size < offset+numblocks*blocksize) { 
+    if (ftruncate(fileno(datafilefd),offset+numblocks*blocksize)) { 
+      return ERROR_NOSPACE;
+    }
+  }
+
+  if (IsCompressed()) { 
+    return InitSlotMap(true);
+  }
+
+  if (IsLogStructured()) { 
+    return InitLog(true);
+  }
+
   return ERROR_NOERROR;
 }
 
 
 
-    
 
 //
-// Note, this assumes disk is kept continously busy
-// or that time does not advance except during a disk op
+// Striped (RAID-0) composite disks
+//
+// Logical block b lives in stripe b/stripeunit.  Stripes are dealt
+// round robin to the members, so stripe s is stored on member
+// s%numdisks as that member's stripe s/numdisks.
 //
-double DiskSystem::ModelAccess(const SIZE_T offblock, const SIZE_T numblock) 
+void DiskSystem::MapStripe(const BLOCKNUM_T block, SIZE_T &member, BLOCKNUM_T &memberblock) const
 {
+  BLOCKNUM_T stripe = block / stripeunit;
 
-  SIZE_T req_trackstart = (offblock) / (numheads*blockspertrack);
-  SIZE_T req_sectorstart=  (offblock) % (numheads*blockspertrack);
-
-  SIZE_T req_trackend = (offblock+numblock-1) / (numheads*blockspertrack);
-  SIZE_T req_sectorend=  (offblock+numblock-1) % (numheads*blockspertrack);
-
-  SIZE_T trackhop = (SIZE_T) fabs((double)req_trackstart-(double)last_track);
-  double trackhopfrac = (double)trackhop/(double)numtracks;
-
-  // This is a simplistic model.  
-  double trackbytracktime = trackhop*trackseeklatency;
-  double longseektime = (trackhopfrac/(0.5))*averageseeklatency;
-  double timeinseek = trackbytracktime<longseektime ? trackbytracktime : longseektime;
-
-  // Now we are on the first track and we need to wait for the first
-  // sector to show up
-
-  SIZE_T sectorhop = (req_sectorstart >= last_sector) ? (req_sectorstart-last_sector) : (blockspertrack - (last_sector - req_sectorstart));
-  double sectorhopfrac = (double)sectorhop/(double)blockspertrack;
-  double timeinrotation=rotationallatency*sectorhopfrac;
-
-  // Now we've got to read numblockelements
-
-  // The number of side by side tracks we'll deal with:
-  SIZE_T numtrackbytrackhops = req_trackend-req_trackstart;
-  double timeintrackbytrackhops = numtrackbytrackhops*trackseeklatency;
-
-  // The total number of sectors read
-  double timeinreadsectors = rotationallatency*((double)numblock/(double)blockspertrack);
-
-  last_track=req_trackend;
-  last_sector=req_sectorend;
-
-  return timeinseek+timeinrotation+timeintrackbytrackhops+timeinreadsectors;
+  member = stripe % members.size();
+  memberblock = (stripe / members.size())*stripeunit + block % stripeunit;
 }
 
 
-ERROR_T DiskSystem::Read(const SIZE_T   inoffblock,
-			 const SIZE_T   numblock,
-			 vector<Block> &blocks,
-			 double        &reqtime)
+ERROR_T DiskSystem::WriteStripedConfig()
 {
-  reqtime=0;
-
-  if (inoffblock+numblock > numblocks) { 
-    cerr << "DiskSystem::Read: Attempt to read blocks "<<inoffblock<<" to "<<(inoffblock+numblock-1)<<", but maxmimum block is only "<<(numblocks-1)<<endl;
-    return ERROR_NOSPACE;
-  }
-
-  reqtime=ModelAccess(inoffblock,numblock);
-
-  for (SIZE_T i=0;i<numblock;i++) { 
-    Block b(blocksize);
-    if (!IsBlockAllocated(inoffblock+i)) { 
-      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
-	cerr <<"DiskSystem::Read: reading unallocated block "<<(i+inoffblock)<<endl;
-      }
-    }
-    if (myread(datafilefd,offset+(inoffblock+i)*blocksize,b.data,blocksize,true)!=blocksize) { 
-      cerr << "DiskSystem::Read: myread has failed"<<endl;
-      return ERROR_IMPLBUG;
-    }
-    blocks.push_back(b);
+  ftruncate(fileno(configfilefd),0);
+  rewind(configfilefd);
+  fprintf(configfilefd,"# striped disksystem config file version 1.0\n");
+  fprintf(configfilefd,"# filestem\n");
+  fprintf(configfilefd,"%s\n",diskfilestem.c_str());
+  fprintf(configfilefd,"# numdisks\n");
+  fprintf(configfilefd,"%u\n",(SIZE_T)members.size());
+  fprintf(configfilefd,"# stripeunit\n");
+  fprintf(configfilefd,"%u\n",stripeunit);
+  for (SIZE_T i=0;i<members.size();i++) { 
+    fprintf(configfilefd,"# member %u\n",i);
+    fprintf(configfilefd,"%s\n",members[i]->diskfilestem.c_str());
   }
+  fflush(configfilefd);
+  configdirty=false;
 
   return ERROR_NOERROR;
 }
 
-ERROR_T DiskSystem::Write(const SIZE_T   inoffblock,
-			  const SIZE_T   numblock,
-			  const vector<Block> &blocks,
-			  double        &reqtime)
+
+ERROR_T DiskSystem::ReadStripedConfig()
 {
-  reqtime=0;
+  char buf[80];
+  SIZE_T numdisks;
 
-  if (inoffblock+numblock > numblocks) { 
-    cerr << "DiskSystem::Write: Attempt to write blocks "<<inoffblock<<" to "<<(inoffblock+numblock-1)<<", but maxmimum block is only "<<(numblocks-1)<<endl;
-    return ERROR_NOSPACE;
+  rewind(configfilefd);
+  GETNEXTVAL;
+  if (buf[strlen(buf)-1]=='\n') { 
+    buf[strlen(buf)-1]=0;
   }
+  diskfilestem = string(buf);
+  GETNEXTVAL;
+  PARSEUNSIGNED(&numdisks);
+  GETNEXTVAL;
+  PARSEUNSIGNED(&stripeunit);
 
-  reqtime=ModelAccess(inoffblock,numblock);
+  if (numdisks<2 || stripeunit==0) { 
+    cerr << "Bad striped disk configuration.\n";
+    return ERROR_BADCONFIG;
+  }
 
-  for (SIZE_T i=0;i<numblock;i++) { 
-    if (!IsBlockAllocated(inoffblock+i)) { 
-      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
-	cerr <<"DiskSystem::Write: writing unallocated block "<<(i+inoffblock)<<endl;
-      }
+  numblocks=0;
+  for (SIZE_T i=0;i<numdisks;i++) { 
+    GETNEXTVAL;
+    if (buf[strlen(buf)-1]=='\n') { 
+      buf[strlen(buf)-1]=0;
     }
-    if (mywrite(datafilefd,offset+(inoffblock+i)*blocksize,blocks[i].data,blocksize)!=blocksize) {  
-      cerr << "DiskSystem::Write: mywrite has failed"<<endl;
-      return ERROR_IMPLBUG;
+    DiskSystem *m = new DiskSystem(string(buf));
+    members.push_back(m);
+    if (i==0) { 
+      blocksize=m->GetBlockSize();
+    }
+    if (m->GetBlockSize()!=blocksize || m->GetNumBlocks()%stripeunit!=0 ||
+	m->GetNumBlocks()!=members[0]->GetNumBlocks()) { 
+      cerr << "Striped disk members do not match.\n";
+      return ERROR_BADCONFIG;
     }
+    numblocks+=m->GetNumBlocks();
   }
 
+  sectorsize=members[0]->sectorsize;
+  segmentsize=members[0]->segmentsize;
+
   return ERROR_NOERROR;
 }
 
 
-ERROR_T DiskSystem::Read(const SIZE_T inoffblock, Block &blocks, double &reqtime)
+ERROR_T DiskSystem::InitStripedFromInMemoryConfig(const SIZE_T numdisks)
 {
-  vector<Block> bl;
+  string configname = diskfilestem + ".config";
 
-  ERROR_T rc = Read(inoffblock,1,bl,reqtime);
+  int rc=SanityCheckConfig();
 
-  if (rc!=ERROR_NOERROR) { 
+  if (rc) { 
     return rc;
   }
 
-  blocks = bl[0];
-
-  return ERROR_NOERROR;
-}
-
-ERROR_T DiskSystem::Write(const SIZE_T inoffblock, const Block &blocks, double &reqtime)
-{
-  vector<Block> bl;
-
-  bl.push_back(blocks);
+  if (stripeunit==0 || numblocks%stripeunit!=0) { 
+    cerr << "Member size must be a multiple of the stripe unit.\n";
+    return ERROR_BADCONFIG;
+  }
 
-  ERROR_T rc = Write(inoffblock,1,bl,reqtime);
+  struct stat s;
 
-  if (rc!=ERROR_NOERROR) { 
-    return rc;
+  if (stat(configname.c_str(),&s)!=-1) { 
+    cerr << "Configuration file exists for this name!\n";
+    return ERROR_BADCONFIG;
   }
 
-  return ERROR_NOERROR;
-}
+  for (SIZE_T i=0;i<numdisks;i++) { 
+    char suffix[16];
+    sprintf(suffix,".%u",i);
+    members.push_back(new DiskSystem(diskfilestem+suffix,
+				     true,
+				     offset,
+				     numblocks,
+				     blocksize,
+				     numheads,
+				     blockspertrack,
+				     numtracks,
+				     averageseeklatency,
+				     trackseeklatency,
+				     rotationallatency,
+				     1,
+				     1,
+				     sectorsize,
+				     segmentsize));
+  }
 
+  // a log structured member offers fewer blocks than its geometry
+  numblocks=0;
+  for (SIZE_T i=0;i<numdisks;i++) { 
+    if (members[i]->GetNumBlocks()%stripeunit!=0) { 
+      cerr << "Member size must be a multiple of the stripe unit.\n";
+      return ERROR_BADCONFIG;
+    }
+    numblocks+=members[i]->GetNumBlocks();
+  }
 
-SIZE_T DiskSystem::GetBlockSize() const
-{
-  return blocksize;
-}
+  if (configfilefd) { fclose(configfilefd); }
+  
+  if ((configfilefd = fopen(configname.c_str(),"w+"))==0) { 
+    return ERROR_NOFILE;
+  }
 
-SIZE_T DiskSystem::GetNumBlocks() const
-{
-  return numblocks;
+  return WriteStripedConfig();
 }
 
 
-
-#define GETBIT(x) ((bitmap[(x)/8] >> (7-((x)%8))) & 0x1)
-#define SETBIT(x) do { bitmap[(x)/8] |= 0x1 << (7-((x)%8)); } while (0)
-#define CLEARBIT(x) do { bitmap[(x)/8] &= ~(0x1 << (7-((x)%8))); } while (0)
-
-
-bool DiskSystem::IsBlockAllocated(const SIZE_T block)
+//
+// The members work in parallel, so a request costs as much as the
+// busiest member's share of it.  Each contiguous run within a stripe
+// unit is issued to its member as one request.
+//
+ERROR_T DiskSystem::StripedRead(const BLOCKNUM_T inoffblock,
+				const SIZE_T   numblock,
+				vector<Block> &blocks,
+				double        &reqtime)
 {
-  return GETBIT(block);
-}
+  vector<double> busy(members.size(),0);
+  SIZE_T i=0;
 
+  while (i<numblock) { 
+    SIZE_T member;
+    BLOCKNUM_T memberblock;
+    SIZE_T run = stripeunit - (inoffblock+i)%stripeunit;
+    double t;
 
-ERROR_T DiskSystem::NotifyAllocateBlocks(const SIZE_T offset, const SIZE_T innumblocks)
-{
-  if (offset+innumblocks > numblocks) { 
-    cerr << "Disksystem: NotifyAllocateBlocks: Attempt to allocate"<<offset<<" to "<<(offset+innumblocks-1)<<" but maximum block is "<<(numblocks-1)<<endl;
-    return ERROR_NOSUCHBLOCK;
+    if (run>numblock-i) { 
+      run=numblock-i;
+    }
+    MapStripe(inoffblock+i,member,memberblock);
+    ERROR_T rc = members[member]->Read(memberblock,run,blocks,t);
+    if (rc!=ERROR_NOERROR) { 
+      return rc;
+    }
+    busy[member]+=t;
+    i+=run;
   }
 
-
-  for (SIZE_T i=offset; i<(offset+innumblocks); i++) { 
-    if (IsBlockAllocated(i)) {
-      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
-	cerr << "Disksystem: NotifyAllocateBlocks: Block "<<i<<" is being allocated, but it's already allocated!"<<endl;
-      }
+  reqtime=0;
+  for (SIZE_T m=0;m<busy.size();m++) { 
+    if (busy[m]>reqtime) { 
+      reqtime=busy[m];
     }
-    SETBIT(i);
   }
-
   return ERROR_NOERROR;
 }
 
-ERROR_T DiskSystem::NotifyDeallocateBlocks(const SIZE_T offset,const SIZE_T innumblocks)
+
+ERROR_T DiskSystem::StripedWrite(const BLOCKNUM_T inoffblock,
+				 const SIZE_T   numblock,
+				 const vector<Block> &blocks,
+				 double        &reqtime)
 {
-  if (offset+innumblocks > numblocks) { 
-    cerr << "Disksystem: NotifyDeallocateBlocks: Attempt to deallocate"<<offset<<" to "<<(offset+innumblocks-1)<<" but maximum block is "<<(numblocks-1)<<endl;
-    return ERROR_NOSUCHBLOCK;
-  }
+  vector<double> busy(members.size(),0);
+  SIZE_T i=0;
 
+  while (i<numblock) { 
+    SIZE_T member;
+    BLOCKNUM_T memberblock;
+    SIZE_T run = stripeunit - (inoffblock+i)%stripeunit;
+    double t;
 
-  for (SIZE_T i=offset; i<(offset+innumblocks); i++) { 
-    if (!IsBlockAllocated(i)) {
-      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
-	cerr << "Disksystem: NotifyDeallocateBlocks: Block "<<i<<" is being deallocated, but it's already deallocated!"<<endl;
-      }
+    if (run>numblock-i) { 
+      run=numblock-i;
+    }
+    MapStripe(inoffblock+i,member,memberblock);
+    vector<Block> part(blocks.begin()+i,blocks.begin()+i+run);
+    ERROR_T rc = members[member]->Write(memberblock,run,part,t);
+    if (rc!=ERROR_NOERROR) { 
+      return rc;
     }
-    CLEARBIT(i);
+    busy[member]+=t;
+    i+=run;
   }
 
+  reqtime=0;
+  for (SIZE_T m=0;m<busy.size();m++) { 
+    if (busy[m]>reqtime) { 
+      reqtime=busy[m];
+    }
+  }
   return ERROR_NOERROR;
 }
 
 
-ostream & DiskSystem::Print(ostream &os) const
-{
-  os << "DiskSystem(diskfilestem="<<diskfilestem
-     << ", offset="<<offset
-     << ", numblocks="<<numblocks
+    
+
+//
+// Note, this assumes disk is kept continously busy
+// or that time does not advance except during a disk op
+//
+//
+// Compressed disks
+//
+// Block b is still stored at its usual place in the data file, but
+// only the first slotmap[b] sectors of it are written and read back.
+// A block that does not compress by at least a sector is stored as
+// is, using all of its sectors.
+//
+ERROR_T DiskSystem::InitSlotMap(const bool create)
+{
+  string mapname = diskfilestem + ".map";
+
+  if (mapfilefd) { fclose(mapfilefd); }
+
+  if ((mapfilefd = fopen(mapname.c_str(),create ? "w+" : "r+"))==0) { 
+    return ERROR_NOFILE;
+  }
+
+  slotmap.assign(numblocks,0);
+  mapdirtylo=numblocks;
+  mapdirtyhi=0;
+
+  if (create) { 
+    if (ftruncate(fileno(mapfilefd),numblocks*sizeof(unsigned short))) { 
+      cerr << "Can't write map file\n";
+      return ERROR_IMPLBUG;
+    }
+  } else {
+    size_t len=numblocks*sizeof(unsigned short);
+    if (myread(mapfilefd,0,(BYTE_T*)&slotmap[0],len,false)!=len) { 
+      cerr << "Can't read map file\n";
+      return ERROR_IMPLBUG;
+    }
+  }
+
+  storedblocks=0;
+  storedsectors=0;
+  for (BLOCKNUM_T i=0;i<numblocks;i++) { 
+    if (slotmap[i]) { 
+      storedblocks++;
+      storedsectors+=slotmap[i];
+    }
+  }
+
+  return ERROR_NOERROR;
+}
+
+// Only the range of entries that changed is written
+ERROR_T DiskSystem::WriteSlotMap()
+{
+  if (mapdirtylo<mapdirtyhi) { 
+    size_t len=(mapdirtyhi-mapdirtylo)*sizeof(unsigned short);
+    if (mywrite(mapfilefd,mapdirtylo*sizeof(unsigned short),(BYTE_T*)&slotmap[mapdirtylo],len)!=len) { 
+      cerr << "Can't write map file\n";
+      return ERROR_IMPLBUG;
+    }
+    fflush(mapfilefd);
+  }
+  mapdirtylo=numblocks;
+  mapdirtyhi=0;
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T DiskSystem::CompressedRead(const BLOCKNUM_T inoffblock,
+				   const SIZE_T   numblock,
+				   vector<Block> &blocks,
+				   double        &reqtime)
+{
+  BYTE_T *slot = new BYTE_T [blocksize];
+  BLOCKNUM_T xfersectors=0;
+
+  for (SIZE_T i=0;i<numblock;i++) { 
+    BLOCKNUM_T block=inoffblock+i;
+    SIZE_T len=slotmap[block]*sectorsize;
+    Block b(blocksize);
+
+    if (!IsBlockAllocated(block)) { 
+      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+	cerr <<"DiskSystem::Read: reading unallocated block "<<block<<endl;
+      }
+    }
+    if (len==0) { 
+      // never written
+      memset(b.data,0,blocksize);
+    } else if (myread(datafilefd,offset+block*blocksize,len==blocksize ? b.data : slot,len,true)!=len) { 
+      cerr << "DiskSystem::Read: myread has failed"<<endl;
+      delete [] slot;
+      return ERROR_IMPLBUG;
+    } else if (len<blocksize && !rle_decompress(slot,len,b.data,blocksize)) { 
+      cerr << "DiskSystem::Read: block "<<block<<" is corrupt"<<endl;
+      delete [] slot;
+      return ERROR_IMPLBUG;
+    }
+    xfersectors+=slotmap[block];
+    blocks.push_back(b);
+  }
+
+  delete [] slot;
+
+  logicalbytes+=(OFFSET_T)numblock*blocksize;
+  physicalbytes+=xfersectors*sectorsize;
+
+  reqtime=ModelAccess(inoffblock,numblock,(double)xfersectors/GetSectorsPerBlock());
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T DiskSystem::CompressedWrite(const BLOCKNUM_T inoffblock,
+				    const SIZE_T   numblock,
+				    const vector<Block> &blocks,
+				    double        &reqtime)
+{
+  BYTE_T *slot = new BYTE_T [blocksize];
+  BLOCKNUM_T xfersectors=0;
+
+  for (SIZE_T i=0;i<numblock;i++) { 
+    BLOCKNUM_T block=inoffblock+i;
+
+    if (!IsBlockAllocated(block)) { 
+      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+	cerr <<"DiskSystem::Write: writing unallocated block "<<block<<endl;
+      }
+    }
+
+    SIZE_T clen=rle_compress(blocks[i].data,blocksize,slot,blocksize-sectorsize);
+    SIZE_T sectors = clen ? (clen+sectorsize-1)/sectorsize : GetSectorsPerBlock();
+    const BYTE_T *src = clen ? slot : blocks[i].data;
+
+    if (mywrite(datafilefd,offset+block*blocksize,src,sectors*sectorsize)!=sectors*sectorsize) {  
+      cerr << "DiskSystem::Write: mywrite has failed"<<endl;
+      delete [] slot;
+      return ERROR_IMPLBUG;
+    }
+
+    if (slotmap[block]) { 
+      storedblocks--;
+      storedsectors-=slotmap[block];
+    }
+    slotmap[block]=sectors;
+    storedblocks++;
+    storedsectors+=sectors;
+    if (block<mapdirtylo) { mapdirtylo=block; }
+    if (block+1>mapdirtyhi) { mapdirtyhi=block+1; }
+
+    xfersectors+=sectors;
+  }
+
+  delete [] slot;
+
+  logicalbytes+=(OFFSET_T)numblock*blocksize;
+  physicalbytes+=xfersectors*sectorsize;
+
+  reqtime=ModelAccess(inoffblock,numblock,(double)xfersectors/GetSectorsPerBlock());
+
+  return ERROR_NOERROR;
+}
+
+
+//
+// Tiered disks
+//
+ERROR_T DiskSystem::CreateTiered(const string &filestem,
+				 const string &faststem,
+				 const string &slowstem)
+{
+  string configname = filestem + ".config";
+  struct stat s;
+  FILE *f;
+
+  if (stat(configname.c_str(),&s)!=-1) { 
+    cerr << "Configuration file exists for this name!\n";
+    return ERROR_BADCONFIG;
+  }
+  if ((f = fopen(configname.c_str(),"w"))==0) { 
+    return ERROR_NOFILE;
+  }
+  fprintf(f,"# tiered disksystem config file version 1.0\n");
+  fprintf(f,"# filestem\n");
+  fprintf(f,"%s\n",filestem.c_str());
+  fprintf(f,"# fast\n");
+  fprintf(f,"%s\n",faststem.c_str());
+  fprintf(f,"# slow\n");
+  fprintf(f,"%s\n",slowstem.c_str());
+  fclose(f);
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T DiskSystem::ReadTieredConfig()
+{
+  char buf[80];
+
+  rewind(configfilefd);
+  GETNEXTVAL;
+  if (buf[strlen(buf)-1]=='\n') { 
+    buf[strlen(buf)-1]=0;
+  }
+  diskfilestem = string(buf);
+
+  tiered=true;
+  for (SIZE_T i=0;i<2;i++) { 
+    GETNEXTVAL;
+    if (buf[strlen(buf)-1]=='\n') { 
+      buf[strlen(buf)-1]=0;
+    }
+    members.push_back(new DiskSystem(string(buf)));
+  }
+
+  blocksize=members[1]->GetBlockSize();
+  numblocks=members[1]->GetNumBlocks();
+
+  if (members[0]->GetBlockSize()!=blocksize) { 
+    cerr << "Tiered disk members do not match.\n";
+    return ERROR_BADCONFIG;
+  }
+
+  return ReadTierMap();
+}
+
+
+//
+// The tier map holds the number of fast slots and blocks, then the
+// owner of each slot, whether each slot is dirty, and the heat of
+// each block.  A tiered disk that has not been used yet has none.
+//
+ERROR_T DiskSystem::ReadTierMap()
+{
+  string mapname = diskfilestem + ".tiermap";
+  BLOCKNUM_T numslots=members[0]->GetNumBlocks();
+  BLOCKNUM_T header[2];
+  FILE *f;
+
+  tierslot.assign(numblocks,DISKSYSTEM_LOG_NOBLOCK);
+  slotowner.assign(numslots,DISKSYSTEM_LOG_NOBLOCK);
+  slotdirty.assign(numslots,false);
+  heat.assign(numblocks,0);
+
+  if ((f=fopen(mapname.c_str(),"r"))==0) { 
+    return ERROR_NOERROR;
+  }
+
+  vector<BYTE_T> dirty(numslots);
+
+  if (myread(f,0,(BYTE_T*)header,sizeof(header),false)!=sizeof(header) ||
+      header[0]!=numslots || header[1]!=numblocks ||
+      myread(f,sizeof(header),(BYTE_T*)&slotowner[0],numslots*sizeof(BLOCKNUM_T),false)!=numslots*sizeof(BLOCKNUM_T) ||
+      myread(f,sizeof(header)+numslots*sizeof(BLOCKNUM_T),&dirty[0],numslots,false)!=numslots ||
+      myread(f,sizeof(header)+numslots*(sizeof(BLOCKNUM_T)+1),(BYTE_T*)&heat[0],numblocks*sizeof(unsigned short),false)!=numblocks*sizeof(unsigned short)) { 
+    cerr << "Can't read tier map\n";
+    fclose(f);
+    return ERROR_BADCONFIG;
+  }
+  fclose(f);
+
+  for (BLOCKNUM_T i=0;i<numslots;i++) { 
+    slotdirty[i]=dirty[i];
+    if (slotowner[i]!=DISKSYSTEM_LOG_NOBLOCK) { 
+      tierslot[slotowner[i]]=i;
+    }
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T DiskSystem::WriteTierMap()
+{
+  string mapname = diskfilestem + ".tiermap";
+  BLOCKNUM_T numslots=slotowner.size();
+  BLOCKNUM_T header[2] = { numslots, numblocks };
+  vector<BYTE_T> dirty(numslots);
+  FILE *f;
+
+  for (BLOCKNUM_T i=0;i<numslots;i++) { 
+    dirty[i]=slotdirty[i];
+  }
+
+  if ((f=fopen(mapname.c_str(),"w"))==0) { 
+    return ERROR_NOFILE;
+  }
+  if (mywrite(f,0,(BYTE_T*)header,sizeof(header))!=sizeof(header) ||
+      mywrite(f,sizeof(header),(BYTE_T*)&slotowner[0],numslots*sizeof(BLOCKNUM_T))!=numslots*sizeof(BLOCKNUM_T) ||
+      mywrite(f,sizeof(header)+numslots*sizeof(BLOCKNUM_T),&dirty[0],numslots)!=numslots ||
+      mywrite(f,sizeof(header)+numslots*(sizeof(BLOCKNUM_T)+1),(BYTE_T*)&heat[0],numblocks*sizeof(unsigned short))!=numblocks*sizeof(unsigned short)) { 
+    cerr << "Can't write tier map\n";
+    fclose(f);
+    return ERROR_IMPLBUG;
+  }
+  fclose(f);
+  return ERROR_NOERROR;
+}
+
+
+void DiskSystem::MapTier(const BLOCKNUM_T block, SIZE_T &tier, BLOCKNUM_T &tierblock) const
+{
+  if (tierslot[block]!=DISKSYSTEM_LOG_NOBLOCK) { 
+    tier=0;
+    tierblock=tierslot[block];
+  } else {
+    tier=1;
+    tierblock=block;
+  }
+}
+
+
+//
+// Called after a request has touched block, with its current
+// contents.  If the block is now hot enough, it replaces the coldest
+// of the next few fast slots, which is written back to the slow tier
+// if it has changed there.
+//
+ERROR_T DiskSystem::TierAccessed(const BLOCKNUM_T block, const Block &data)
+{
+  ERROR_T rc;
+  double t;
+
+  if (heat[block]<65535) { 
+    heat[block]++;
+  }
+  if (++heataccesses>=numblocks) { 
+    for (BLOCKNUM_T i=0;i<numblocks;i++) { 
+      heat[i]>>=1;
+    }
+    heataccesses=0;
+  }
+
+  if (tierslot[block]!=DISKSYSTEM_LOG_NOBLOCK || heat[block]<DISKSYSTEM_TIER_PROMOTE_HEAT || slotowner.empty()) { 
+    return ERROR_NOERROR;
+  }
+
+  BLOCKNUM_T victim=clockhand;
+
+  for (SIZE_T i=0;i<DISKSYSTEM_TIER_SCAN && i<slotowner.size();i++) { 
+    BLOCKNUM_T slot=(clockhand+i)%slotowner.size();
+    if (slotowner[slot]==DISKSYSTEM_LOG_NOBLOCK) { 
+      victim=slot;
+      break;
+    }
+    if (heat[slotowner[slot]]<heat[slotowner[victim]]) { 
+      victim=slot;
+    }
+  }
+  clockhand=(victim+1)%slotowner.size();
+
+  BLOCKNUM_T old=slotowner[victim];
+
+  if (old!=DISKSYSTEM_LOG_NOBLOCK) { 
+    if (heat[old]>=heat[block]) { 
+      return ERROR_NOERROR;
+    }
+    if (slotdirty[victim]) { 
+      Block b;
+      if ((rc=members[0]->Read(victim,b,t))) { 
+	return rc;
+      }
+      tierstats[0].migrationtime+=t;
+      if ((rc=members[1]->Write(old,b,t))) { 
+	return rc;
+      }
+      tierstats[1].migrationtime+=t;
+    }
+    tierslot[old]=DISKSYSTEM_LOG_NOBLOCK;
+    tierstats[0].migratedout++;
+  } else {
+    members[0]->NotifyAllocateBlocks(victim,1);
+  }
+
+  if ((rc=members[0]->Write(victim,data,t))) { 
+    return rc;
+  }
+  tierstats[0].migrationtime+=t;
+  tierstats[0].migratedin++;
+
+  slotowner[victim]=block;
+  slotdirty[victim]=false;
+  tierslot[block]=victim;
+
+  return ERROR_NOERROR;
+}
+
+
+//
+// Both tiers work in parallel, so a request costs as much as the
+// busier tier's share of it.  Each run of blocks that is contiguous
+// on one tier is issued to it as one request.
+//
+ERROR_T DiskSystem::TieredRead(const BLOCKNUM_T inoffblock,
+			       const SIZE_T   numblock,
+			       vector<Block> &blocks,
+			       double        &reqtime)
+{
+  double busy[2] = { 0, 0 };
+  SIZE_T first=blocks.size();
+  SIZE_T i=0;
+  ERROR_T rc;
+
+  while (i<numblock) { 
+    SIZE_T tier, nexttier;
+    BLOCKNUM_T tierblock, nextblock;
+    SIZE_T run=1;
+    double t;
+
+    MapTier(inoffblock+i,tier,tierblock);
+    while (i+run<numblock) { 
+      MapTier(inoffblock+i+run,nexttier,nextblock);
+      if (nexttier!=tier || nextblock!=tierblock+run) { 
+	break;
+      }
+      run++;
+    }
+    if ((rc=members[tier]->Read(tierblock,run,blocks,t))) { 
+      return rc;
+    }
+    busy[tier]+=t;
+    tierstats[tier].reads+=run;
+    tierstats[tier].time+=t;
+    i+=run;
+  }
+
+  reqtime = busy[0]>busy[1] ? busy[0] : busy[1];
+
+  for (i=0;i<numblock;i++) { 
+    if ((rc=TierAccessed(inoffblock+i,blocks[first+i]))) { 
+      return rc;
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T DiskSystem::TieredWrite(const BLOCKNUM_T inoffblock,
+				const SIZE_T   numblock,
+				const vector<Block> &blocks,
+				double        &reqtime)
+{
+  double busy[2] = { 0, 0 };
+  SIZE_T i=0;
+  ERROR_T rc;
+
+  while (i<numblock) { 
+    SIZE_T tier, nexttier;
+    BLOCKNUM_T tierblock, nextblock;
+    SIZE_T run=1;
+    double t;
+
+    MapTier(inoffblock+i,tier,tierblock);
+    while (i+run<numblock) { 
+      MapTier(inoffblock+i+run,nexttier,nextblock);
+      if (nexttier!=tier || nextblock!=tierblock+run) { 
+	break;
+      }
+      run++;
+    }
+    vector<Block> part(blocks.begin()+i,blocks.begin()+i+run);
+    if ((rc=members[tier]->Write(tierblock,run,part,t))) { 
+      return rc;
+    }
+    if (tier==0) { 
+      for (SIZE_T j=0;j<run;j++) { 
+	slotdirty[tierblock+j]=true;
+      }
+    }
+    busy[tier]+=t;
+    tierstats[tier].writes+=run;
+    tierstats[tier].time+=t;
+    i+=run;
+  }
+
+  reqtime = busy[0]>busy[1] ? busy[0] : busy[1];
+
+  for (i=0;i<numblock;i++) { 
+    if ((rc=TierAccessed(inoffblock+i,blocks[i]))) { 
+      return rc;
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+
+double DiskSystem::GetCompressionRatio() const
+{
+  BLOCKNUM_T blocks=0, sectors=0;
+
+  if (IsStriped()) { 
+    for (SIZE_T i=0;i<members.size();i++) { 
+      blocks+=members[i]->storedblocks;
+      sectors+=members[i]->storedsectors;
+    }
+  } else {
+    blocks=storedblocks;
+    sectors=storedsectors;
+  }
+  if (!IsCompressed() || sectors==0) { 
+    return 1.0;
+  }
+  return (double)(blocks*GetSectorsPerBlock())/(double)sectors;
+}
+
+OFFSET_T DiskSystem::GetBytesSaved() const
+{
+  OFFSET_T saved=logicalbytes-physicalbytes;
+
+  for (SIZE_T i=0;i<members.size();i++) { 
+    saved+=members[i]->GetBytesSaved();
+  }
+  return saved;
+}
+
+
+//
+// Log structured disks
+//
+// Physical block p is in segment p/segmentsize.  Writes go to the
+// next unused block of the head segment, and when it fills, the head
+// moves to a free segment.  The cleaner keeps enough free space for
+// each write by picking the segment with the fewest live blocks and
+// appending them at the head.  Segments the head has left are kept in
+// lists by their live blocks, so the pick does not look at every
+// segment.
+//
+// The checkpoint file holds the head position followed by the remap
+// table.  It is written to a new file that is then renamed over the
+// old one.  A segment that the cleaner empties waits on the pending
+// list until a checkpoint has been written, so the blocks named by the
+// last checkpoint are never overwritten.  That is usually the periodic
+// one; see LogClean for when one is written early.
+//
+ERROR_T DiskSystem::InitLog(const bool create)
+{
+  BLOCKNUM_T numsegments=numblocks/segmentsize;
+  BLOCKNUM_T reserve=numsegments/8 > 2 ? numsegments/8 : 2;
+
+  logblocks=(numsegments-reserve)*segmentsize;
+
+  remap.assign(logblocks,DISKSYSTEM_LOG_NOBLOCK);
+  owner.assign(numblocks,DISKSYSTEM_LOG_NOBLOCK);
+  segmentlive.assign(numsegments,0);
+  segmentfree.assign(numsegments,false);
+  freesegments.clear();
+  pendingsegments.clear();
+  livebuckets.assign(segmentsize+1,DISKSYSTEM_LOG_NOBLOCK);
+  bucketnext.assign(numsegments,DISKSYSTEM_LOG_NOBLOCK);
+  bucketprev.assign(numsegments,DISKSYSTEM_LOG_NOBLOCK);
+  inbucket.assign(numsegments,false);
+  headsegment=0;
+  headused=0;
+
+  if (!create) { 
+    string logname = diskfilestem + ".log";
+    FILE *f;
+    BLOCKNUM_T header[3];
+
+    if ((f=fopen(logname.c_str(),"r"))==0) { 
+      return ERROR_NOFILE;
+    }
+    if (myread(f,0,(BYTE_T*)header,sizeof(header),false)!=sizeof(header) ||
+	header[2]!=logblocks ||
+	myread(f,sizeof(header),(BYTE_T*)&remap[0],logblocks*sizeof(BLOCKNUM_T),false)!=logblocks*sizeof(BLOCKNUM_T)) { 
+      cerr << "Can't read log checkpoint\n";
+      fclose(f);
+      return ERROR_BADCONFIG;
+    }
+    fclose(f);
+    headsegment=header[0];
+    headused=header[1];
+    for (BLOCKNUM_T i=0;i<logblocks;i++) { 
+      if (remap[i]!=DISKSYSTEM_LOG_NOBLOCK) { 
+	owner[remap[i]]=i;
+	segmentlive[remap[i]/segmentsize]++;
+      }
+    }
+  }
+
+  // Everything else without live blocks is free
+  for (BLOCKNUM_T i=numsegments;i>0;i--) { 
+    if (i-1!=headsegment && segmentlive[i-1]==0) { 
+      segmentfree[i-1]=true;
+      freesegments.insert(i-1);
+    } else if (i-1!=headsegment) { 
+      LogSeal(i-1);
+    }
+  }
+
+  segmentssincecheckpoint=0;
+
+  return create ? WriteCheckpoint() : ERROR_NOERROR;
+}
+
+
+// numblocks has grown by whole segments, which are free
+ERROR_T DiskSystem::LogGrow()
+{
+  BLOCKNUM_T oldsegments=segmentlive.size();
+  BLOCKNUM_T numsegments=numblocks/segmentsize;
+  BLOCKNUM_T reserve=numsegments/8 > 2 ? numsegments/8 : 2;
+
+  owner.resize(numblocks,DISKSYSTEM_LOG_NOBLOCK);
+  segmentlive.resize(numsegments,0);
+  segmentfree.resize(numsegments,true);
+  bucketnext.resize(numsegments,DISKSYSTEM_LOG_NOBLOCK);
+  bucketprev.resize(numsegments,DISKSYSTEM_LOG_NOBLOCK);
+  inbucket.resize(numsegments,false);
+  for (BLOCKNUM_T i=numsegments;i>oldsegments;i--) { 
+    freesegments.insert(i-1);
+  }
+
+  logblocks=(numsegments-reserve)*segmentsize;
+  remap.resize(logblocks,DISKSYSTEM_LOG_NOBLOCK);
+
+  return WriteCheckpoint();
+}
+
+
+ERROR_T DiskSystem::WriteCheckpoint()
+{
+  string logname = diskfilestem + ".log";
+  string newname = logname + ".new";
+  BLOCKNUM_T header[3] = { headsegment, headused, logblocks };
+  FILE *f;
+
+  // the blocks the checkpoint points to must be on disk first
+  fflush(datafilefd);
+
+  if ((f=fopen(newname.c_str(),"w"))==0) { 
+    return ERROR_NOFILE;
+  }
+  if (mywrite(f,0,(BYTE_T*)header,sizeof(header))!=sizeof(header) ||
+      mywrite(f,sizeof(header),(BYTE_T*)&remap[0],logblocks*sizeof(BLOCKNUM_T))!=logblocks*sizeof(BLOCKNUM_T)) { 
+    cerr << "Can't write log checkpoint\n";
+    fclose(f);
+    return ERROR_IMPLBUG;
+  }
+  fclose(f);
+  if (rename(newname.c_str(),logname.c_str())) { 
+    cerr << "Can't write log checkpoint\n";
+    return ERROR_IMPLBUG;
+  }
+  segmentssincecheckpoint=0;
+
+  // nothing refers to the cleaned segments any more
+  for (BLOCKNUM_T i=0;i<pendingsegments.size();i++) { 
+    segmentfree[pendingsegments[i]]=true;
+    freesegments.insert(pendingsegments[i]);
+  }
+  pendingsegments.clear();
+  return ERROR_NOERROR;
+}
+
+
+// Blocks that can be appended without cleaning
+BLOCKNUM_T DiskSystem::GetLogSpace() const
+{
+  return (segmentsize-headused) + freesegments.size()*segmentsize;
+}
+
+
+// The current copy of the block is no longer needed
+void DiskSystem::LogKill(const BLOCKNUM_T block)
+{
+  BLOCKNUM_T phys=remap[block];
+
+  if (phys!=DISKSYSTEM_LOG_NOBLOCK) { 
+    BLOCKNUM_T segment=phys/segmentsize;
+    bool sealed=inbucket[segment];
+
+    if (sealed) { 
+      LogUnseal(segment);
+    }
+    owner[phys]=DISKSYSTEM_LOG_NOBLOCK;
+    segmentlive[segment]--;
+    remap[block]=DISKSYSTEM_LOG_NOBLOCK;
+    if (sealed) { 
+      LogSeal(segment);
+    }
+  }
+}
+
+
+// Puts a segment the head has left in the list for its live blocks
+void DiskSystem::LogSeal(const BLOCKNUM_T segment)
+{
+  BLOCKNUM_T &first=livebuckets[segmentlive[segment]];
+
+  bucketprev[segment]=DISKSYSTEM_LOG_NOBLOCK;
+  bucketnext[segment]=first;
+  if (first!=DISKSYSTEM_LOG_NOBLOCK) { 
+    bucketprev[first]=segment;
+  }
+  first=segment;
+  inbucket[segment]=true;
+}
+
+
+void DiskSystem::LogUnseal(const BLOCKNUM_T segment)
+{
+  BLOCKNUM_T next=bucketnext[segment];
+  BLOCKNUM_T prev=bucketprev[segment];
+
+  if (prev!=DISKSYSTEM_LOG_NOBLOCK) { 
+    bucketnext[prev]=next;
+  } else {
+    livebuckets[segmentlive[segment]]=next;
+  }
+  if (next!=DISKSYSTEM_LOG_NOBLOCK) { 
+    bucketprev[next]=prev;
+  }
+  inbucket[segment]=false;
+}
+
+
+// The segment with the fewest live blocks, if any is not full.  This
+// looks at segmentsize lists at most, however big the disk is.
+BLOCKNUM_T DiskSystem::LogPickVictim() const
+{
+  for (SIZE_T live=0;live<segmentsize;live++) { 
+    if (livebuckets[live]!=DISKSYSTEM_LOG_NOBLOCK) { 
+      return livebuckets[live];
+    }
+  }
+  return DISKSYSTEM_LOG_NOBLOCK;
+}
+
+
+ERROR_T DiskSystem::LogAppend(const BLOCKNUM_T block, const BYTE_T *data, BLOCKNUM_T &phys)
+{
+  if (headused==segmentsize) { 
+    if (freesegments.empty() && !pendingsegments.empty()) { 
+      // the cleaned segments are needed before the periodic checkpoint
+      ERROR_T rc=WriteCheckpoint();
+      if (rc) { 
+	return rc;
+      }
+    }
+    if (freesegments.empty()) { 
+      return ERROR_NOSPACE;
+    }
+    LogSeal(headsegment);
+
+    // take the free segment nearest the arm, so the move is cheap
+    BLOCKNUM_T arm=last_track*numheads*blockspertrack/segmentsize;
+    set<BLOCKNUM_T>::iterator next=freesegments.lower_bound(arm);
+    if (next!=freesegments.begin()) { 
+      set<BLOCKNUM_T>::iterator prev=next;
+      --prev;
+      if (next==freesegments.end() || arm-*prev < *next-arm) { 
+	next=prev;
+      }
+    }
+    headsegment=*next;
+    freesegments.erase(next);
+    segmentfree[headsegment]=false;
+    headused=0;
+    if (++segmentssincecheckpoint>=DISKSYSTEM_LOG_CHECKPOINT_SEGMENTS) { 
+      ERROR_T rc=WriteCheckpoint();
+      if (rc) { 
+	return rc;
+      }
+    }
+  }
+
+  phys=headsegment*segmentsize+headused;
+
+  if (mywrite(datafilefd,offset+phys*blocksize,data,blocksize)!=blocksize) {  
+    cerr << "DiskSystem::Write: mywrite has failed"<<endl;
+    return ERROR_IMPLBUG;
+  }
+
+  LogKill(block);
+  remap[block]=phys;
+  owner[phys]=block;
+  segmentlive[headsegment]++;
+  headused++;
+
+  return ERROR_NOERROR;
+}
+
+
+//
+// Make room for needed blocks, plus a segment so that the cleaner
+// itself always has somewhere to copy to.  Cleaned segments wait for
+// the periodic checkpoint, unless DISKSYSTEM_LOG_PENDING_SEGMENTS of
+// them are waiting or there is nothing left to clean, in which case a
+// checkpoint is written now to free them.
+//
+ERROR_T DiskSystem::LogClean(const BLOCKNUM_T needed)
+{
+  BYTE_T *buf=0;
+  ERROR_T rc=ERROR_NOERROR;
+
+  while (GetLogSpace() < needed+segmentsize) { 
+    BLOCKNUM_T victim=LogPickVictim();
+
+    if (victim==DISKSYSTEM_LOG_NOBLOCK || 
+	pendingsegments.size()>=DISKSYSTEM_LOG_PENDING_SEGMENTS) { 
+      if (pendingsegments.empty()) { 
+	rc=ERROR_NOSPACE;
+	break;
+      }
+      rc=WriteCheckpoint();
+      if (rc) { 
+	break;
+      }
+      continue;
+    }
+    LogUnseal(victim);
+
+    if (!buf) { 
+      buf=new BYTE_T [blocksize];
+    }
+
+    // read the live blocks and append them at the head
+    SIZE_T live=segmentlive[victim];
+    BLOCKNUM_T runstart=0, runlen=0;
+
+    if (live>0) { 
+      cleaningtime+=ModelAccess(victim*segmentsize,segmentsize,live);
+    }
+    for (BLOCKNUM_T p=victim*segmentsize; p<(victim+1)*segmentsize && rc==ERROR_NOERROR; p++) { 
+      BLOCKNUM_T block=owner[p];
+      BLOCKNUM_T phys;
+      if (block==DISKSYSTEM_LOG_NOBLOCK) { 
+	continue;
+      }
+      if (myread(datafilefd,offset+p*blocksize,buf,blocksize,true)!=blocksize) { 
+	cerr << "DiskSystem::Read: myread has failed"<<endl;
+	rc=ERROR_IMPLBUG;
+	break;
+      }
+      rc=LogAppend(block,buf,phys);
+      if (rc==ERROR_NOERROR) { 
+	if (runlen>0 && phys!=runstart+runlen) { 
+	  cleaningtime+=ModelAccess(runstart,runlen,runlen);
+	  runlen=0;
+	}
+	if (runlen==0) { 
+	  runstart=phys;
+	}
+	runlen++;
+	cleanedblocks++;
+      }
+    }
+    if (runlen>0) { 
+      cleaningtime+=ModelAccess(runstart,runlen,runlen);
+    }
+    if (rc) { 
+      break;
+    }
+
+    // the last checkpoint may still point into the victim
+    pendingsegments.push_back(victim);
+    cleanedsegments++;
+  }
+
+  if (buf) { 
+    delete [] buf;
+  }
+  return rc;
+}
+
+
+ERROR_T DiskSystem::LogRead(const BLOCKNUM_T inoffblock,
+			    const SIZE_T   numblock,
+			    vector<Block> &blocks,
+			    double        &reqtime)
+{
+  BLOCKNUM_T runstart=0, runlen=0;
+
+  for (SIZE_T i=0;i<numblock;i++) { 
+    BLOCKNUM_T block=inoffblock+i;
+    BLOCKNUM_T phys=remap[block];
+    Block b(blocksize);
+
+    if (!IsBlockAllocated(block)) { 
+      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+	cerr <<"DiskSystem::Read: reading unallocated block "<<block<<endl;
+      }
+    }
+    if (phys==DISKSYSTEM_LOG_NOBLOCK) { 
+      // never written
+      memset(b.data,0,blocksize);
+    } else {
+      if (myread(datafilefd,offset+phys*blocksize,b.data,blocksize,true)!=blocksize) { 
+	cerr << "DiskSystem::Read: myread has failed"<<endl;
+	return ERROR_IMPLBUG;
+      }
+      // each physically contiguous run is one access
+      if (runlen>0 && phys!=runstart+runlen) { 
+	reqtime+=ModelAccess(runstart,runlen,runlen);
+	runlen=0;
+      }
+      if (runlen==0) { 
+	runstart=phys;
+      }
+      runlen++;
+    }
+    blocks.push_back(b);
+  }
+  if (runlen>0) { 
+    reqtime+=ModelAccess(runstart,runlen,runlen);
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T DiskSystem::LogWrite(const BLOCKNUM_T inoffblock,
+			     const SIZE_T   numblock,
+			     const vector<Block> &blocks,
+			     double        &reqtime)
+{
+  BLOCKNUM_T runstart=0, runlen=0;
+  ERROR_T rc;
+
+  rc=LogClean(numblock);
+
+  if (rc) { 
+    return rc;
+  }
+
+  for (SIZE_T i=0;i<numblock;i++) { 
+    BLOCKNUM_T block=inoffblock+i;
+    BLOCKNUM_T phys;
+
+    if (!IsBlockAllocated(block)) { 
+      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+	cerr <<"DiskSystem::Write: writing unallocated block "<<block<<endl;
+      }
+    }
+    rc=LogAppend(block,blocks[i].data,phys);
+    if (rc) { 
+      return rc;
+    }
+    if (runlen>0 && phys!=runstart+runlen) { 
+      reqtime+=ModelAccess(runstart,runlen,runlen);
+      runlen=0;
+    }
+    if (runlen==0) { 
+      runstart=phys;
+    }
+    runlen++;
+  }
+  if (runlen>0) { 
+    reqtime+=ModelAccess(runstart,runlen,runlen);
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+ostream & DiskSystem::PrintStats(ostream &os) const
+{
+  if (IsCompressed()) { 
+    os << "compressionratio= "<<GetCompressionRatio()<<endl;
+    os << "bytessaved      = "<<GetBytesSaved()<<endl;
+  }
+  if (IsLogStructured() && !IsStriped()) { 
+    os << "cleanedsegments = "<<cleanedsegments<<endl;
+    os << "cleanedblocks   = "<<cleanedblocks<<endl;
+    os << "cleaningtime    = "<<cleaningtime<<endl;
+  }
+  if (IsTiered()) { 
+    const char *name[2] = { "fast", "slow" };
+    for (SIZE_T i=0;i<2;i++) { 
+      os << name[i]<<"reads       = "<<tierstats[i].reads<<endl;
+      os << name[i]<<"writes      = "<<tierstats[i].writes<<endl;
+      os << name[i]<<"time        = "<<tierstats[i].time<<endl;
+      os << name[i]<<"migrtime    = "<<tierstats[i].migrationtime<<endl;
+    }
+    os << "promotions      = "<<tierstats[0].migratedin<<endl;
+    os << "demotions       = "<<tierstats[0].migratedout<<endl;
+  }
+  return os;
+}
+
+
+double DiskSystem::ModelAccess(const BLOCKNUM_T offblock, const SIZE_T numblock, const double xferblocks) 
+{
+
+  BLOCKNUM_T req_trackstart = (offblock) / (numheads*blockspertrack);
+  SIZE_T req_sectorstart=  (offblock) % (numheads*blockspertrack);
+
+  BLOCKNUM_T req_trackend = (offblock+numblock-1) / (numheads*blockspertrack);
+  SIZE_T req_sectorend=  (offblock+numblock-1) % (numheads*blockspertrack);
+
+  BLOCKNUM_T trackhop = (req_trackstart >= last_track) ? (req_trackstart-last_track) : (last_track-req_trackstart);
+  double trackhopfrac = (double)trackhop/(double)numtracks;
+
+  // This is a simplistic model.  
+  double trackbytracktime = trackhop*trackseeklatency;
+  double longseektime = (trackhopfrac/(0.5))*averageseeklatency;
+  double timeinseek = trackbytracktime<longseektime ? trackbytracktime : longseektime;
+
+  // Now we are on the first track and we need to wait for the first
+  // sector to show up
+
+  SIZE_T sectorhop = (req_sectorstart >= last_sector) ? (req_sectorstart-last_sector) : (blockspertrack - (last_sector - req_sectorstart));
+  double sectorhopfrac = (double)sectorhop/(double)blockspertrack;
+  double timeinrotation=rotationallatency*sectorhopfrac;
+
+  // Now we've got to read numblockelements
+
+  // The number of side by side tracks we'll deal with:
+  BLOCKNUM_T numtrackbytrackhops = req_trackend-req_trackstart;
+  double timeintrackbytrackhops = numtrackbytrackhops*trackseeklatency;
+
+  // The total number of sectors read
+  double timeinreadsectors = rotationallatency*(xferblocks/(double)blockspertrack);
+
+  last_track=req_trackend;
+  last_sector=req_sectorend;
+
+  return timeinseek+timeinrotation+timeintrackbytrackhops+timeinreadsectors;
+}
+
+
+ERROR_T DiskSystem::Read(const BLOCKNUM_T inoffblock,
+			 const SIZE_T   numblock,
+			 vector<Block> &blocks,
+			 double        &reqtime)
+{
+  reqtime=0;
+
+  if (inoffblock+numblock > GetNumBlocks()) { 
+    cerr << "DiskSystem::Read: Attempt to read blocks "<<inoffblock<<" to "<<(inoffblock+numblock-1)<<", but maxmimum block is only "<<(GetNumBlocks()-1)<<endl;
+    return ERROR_NOSPACE;
+  }
+
+  if (IsStriped()) { 
+    return StripedRead(inoffblock,numblock,blocks,reqtime);
+  }
+
+  if (IsTiered()) { 
+    return TieredRead(inoffblock,numblock,blocks,reqtime);
+  }
+
+  if (IsCompressed()) { 
+    return CompressedRead(inoffblock,numblock,blocks,reqtime);
+  }
+
+  if (IsLogStructured()) { 
+    return LogRead(inoffblock,numblock,blocks,reqtime);
+  }
+
+  reqtime=ModelAccess(inoffblock,numblock,numblock);
+
+  for (SIZE_T i=0;i<numblock;i++) { 
+    Block b(blocksize);
+    if (!IsBlockAllocated(inoffblock+i)) { 
+      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+	cerr <<"DiskSystem::Read: reading unallocated block "<<(i+inoffblock)<<endl;
+      }
+    }
+    if (myread(datafilefd,offset+(inoffblock+i)*blocksize,b.data,blocksize,true)!=blocksize) { 
+      cerr << "DiskSystem::Read: myread has failed"<<endl;
+      return ERROR_IMPLBUG;
+    }
+    blocks.push_back(b);
+  }
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T DiskSystem::Write(const BLOCKNUM_T inoffblock,
+			  const SIZE_T   numblock,
+			  const vector<Block> &blocks,
+			  double        &reqtime)
+{
+  reqtime=0;
+
+  if (inoffblock+numblock > GetNumBlocks()) { 
+    cerr << "DiskSystem::Write: Attempt to write blocks "<<inoffblock<<" to "<<(inoffblock+numblock-1)<<", but maxmimum block is only "<<(GetNumBlocks()-1)<<endl;
+    return ERROR_NOSPACE;
+  }
+
+  if (IsStriped()) { 
+    return StripedWrite(inoffblock,numblock,blocks,reqtime);
+  }
+
+  if (IsTiered()) { 
+    return TieredWrite(inoffblock,numblock,blocks,reqtime);
+  }
+
+  if (IsCompressed()) { 
+    return CompressedWrite(inoffblock,numblock,blocks,reqtime);
+  }
+
+  if (IsLogStructured()) { 
+    return LogWrite(inoffblock,numblock,blocks,reqtime);
+  }
+
+  reqtime=ModelAccess(inoffblock,numblock,numblock);
+
+  for (SIZE_T i=0;i<numblock;i++) { 
+    if (!IsBlockAllocated(inoffblock+i)) { 
+      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+	cerr <<"DiskSystem::Write: writing unallocated block "<<(i+inoffblock)<<endl;
+      }
+    }
+    if (mywrite(datafilefd,offset+(inoffblock+i)*blocksize,blocks[i].data,blocksize)!=blocksize) {  
+      cerr << "DiskSystem::Write: mywrite has failed"<<endl;
+      return ERROR_IMPLBUG;
+    }
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T DiskSystem::Read(const BLOCKNUM_T inoffblock, Block &blocks, double &reqtime)
+{
+  vector<Block> bl;
+
+  ERROR_T rc = Read(inoffblock,1,bl,reqtime);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+
+  blocks = bl[0];
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T DiskSystem::Write(const BLOCKNUM_T inoffblock, const Block &blocks, double &reqtime)
+{
+  vector<Block> bl;
+
+  bl.push_back(blocks);
+
+  ERROR_T rc = Write(inoffblock,1,bl,reqtime);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+SIZE_T DiskSystem::GetBlockSize() const
+{
+  return blocksize;
+}
+
+BLOCKNUM_T DiskSystem::GetNumBlocks() const
+{
+  if (IsTiered()) { 
+    return numblocks;
+  }
+  if (IsLogStructured() && !IsStriped()) { 
+    return logblocks;
+  }
+  return numblocks;
+}
+
+ERROR_T DiskSystem::Grow(const BLOCKNUM_T addblocks)
+{
+  ERROR_T rc;
+
+  if (IsTiered()) { 
+    if ((rc=members[1]->Grow(addblocks))) { 
+      return rc;
+    }
+    numblocks=members[1]->GetNumBlocks();
+    tierslot.resize(numblocks,DISKSYSTEM_LOG_NOBLOCK);
+    heat.resize(numblocks,0);
+    return ERROR_NOERROR;
+  }
+
+  if (IsStriped()) { 
+    // every member must keep a whole number of stripe units
+    if (addblocks%(members.size()*stripeunit)) { 
+      cerr << "Striped disks grow by a multiple of numdisks*stripeunit blocks.\n";
+      return ERROR_BADCONFIG;
+    }
+    numblocks=0;
+    for (SIZE_T i=0;i<members.size();i++) { 
+      if ((rc=members[i]->Grow(addblocks/members.size()))) { 
+	return rc;
+      }
+      numblocks+=members[i]->GetNumBlocks();
+    }
+    return ERROR_NOERROR;
+  }
+
+  if (addblocks==0 || addblocks%(numheads*blockspertrack) || 
+      (IsLogStructured() && addblocks%segmentsize)) { 
+    cerr << "Disks grow by whole tracks (and segments).\n";
+    return ERROR_BADCONFIG;
+  }
+
+  BLOCKNUM_T newblocks=numblocks+addblocks;
+  OFFSET_T newbitmapbytes=newblocks / 8 + (newblocks%8 != 0);
+  BLOCKNUM_T newchunks=newbitmapbytes/DISKSYSTEM_BITMAP_CHUNK_BYTES 
+    + (newbitmapbytes%DISKSYSTEM_BITMAP_CHUNK_BYTES != 0);
+  struct stat st;
+
+  // The new space in the data, bitmap, and map files is a hole that
+  // reads as zeros, so nothing is written
+  if (fstat(fileno(datafilefd),&st)==0 && 
+      (OFFSET_T)st.st_size < offset+newblocks*blocksize) { 
+    if (ftruncate(fileno(datafilefd),offset+newblocks*blocksize)) { 
+      return ERROR_NOSPACE;
+    }
+  }
+  if (ftruncate(fileno(bitmapfilefd),newbitmapbytes)) { 
+    cerr << "Can't write bitmap file\n";
+    return ERROR_IMPLBUG;
+  }
+  if (IsCompressed() && 
+      ftruncate(fileno(mapfilefd),newblocks*sizeof(unsigned short))) { 
+    cerr << "Can't write map file\n";
+    return ERROR_IMPLBUG;
+  }
+
+  // A chunk that is already in memory had zeros past the old end
+  bitmapchunks.resize(newchunks,(BYTE_T*)0);
+  bitmapdirty.resize(newchunks,false);
+
+  numtracks+=addblocks/(numheads*blockspertrack);
+  numblocks=newblocks;
+
+  if (IsCompressed()) { 
+    slotmap.resize(numblocks,0);
+  }
+
+  if (IsLogStructured() && (rc=LogGrow())) { 
+    return rc;
+  }
+
+  return WriteConfig();
+}
+
+
+SIZE_T DiskSystem::GetNumDisks() const
+{
+  return members.empty() ? 1 : members.size();
+}
+
+
+
+// Bit x of a chunk is the high order bit first within each byte, as
+// in the bitmap file
+#define GETBIT(bits,x) (((bits)[(x)/8] >> (7-((x)%8))) & 0x1)
+
+
+//
+// Set or clear bits offset..offset+num-1.  Whole bytes are filled at
+// once and only the bytes at either end of the run are masked.
+//
+void DiskSystem::SetBitMapRange(const BLOCKNUM_T offset, const BLOCKNUM_T num, const bool allocated)
+{
+  BLOCKNUM_T end=offset+num;
+  BLOCKNUM_T i=offset;
+
+  while (i<end) { 
+    BLOCKNUM_T chunk=i/DISKSYSTEM_BITMAP_CHUNK_BITS;
+    BLOCKNUM_T base=chunk*DISKSYSTEM_BITMAP_CHUNK_BITS;
+    BYTE_T *bits=GetBitMapChunk(chunk);
+    SIZE_T first=i-base;
+    SIZE_T last=(end-base < DISKSYSTEM_BITMAP_CHUNK_BITS) ? end-base : DISKSYSTEM_BITMAP_CHUNK_BITS;
+
+    while (first<last) { 
+      SIZE_T byte=first/8;
+      if (first%8==0 && last-first>=8) { 
+	SIZE_T n=(last-first)/8;
+	memset(bits+byte,allocated ? 0xff : 0x00,n);
+	first+=n*8;
+      } else {
+	SIZE_T lo=first%8;
+	SIZE_T hi=(last-byte*8 < 8) ? last-byte*8 : 8;
+	BYTE_T mask=(0xff>>lo) & ~(0xff>>hi);
+	if (allocated) { 
+	  bits[byte] |= mask;
+	} else {
+	  bits[byte] &= ~mask;
+	}
+	first=byte*8+hi;
+      }
+    }
+
+    bitmapdirty[chunk]=true;
+    i=base+last;
+  }
+}
+
+
+bool DiskSystem::IsBlockAllocated(const BLOCKNUM_T block)
+{
+  if (IsTiered()) { 
+    // the slow tier keeps the bitmap for the whole disk
+    return members[1]->IsBlockAllocated(block);
+  }
+  if (IsStriped()) { 
+    SIZE_T member;
+    BLOCKNUM_T memberblock;
+    MapStripe(block,member,memberblock);
+    return members[member]->IsBlockAllocated(memberblock);
+  }
+  return GETBIT(GetBitMapChunk(block/DISKSYSTEM_BITMAP_CHUNK_BITS),block%DISKSYSTEM_BITMAP_CHUNK_BITS);
+}
+
+
+ERROR_T DiskSystem::NotifyAllocateBlocks(const BLOCKNUM_T offset, const BLOCKNUM_T innumblocks)
+{
+  if (offset+innumblocks > GetNumBlocks()) { 
+    cerr << "Disksystem: NotifyAllocateBlocks: Attempt to allocate"<<offset<<" to "<<(offset+innumblocks-1)<<" but maximum block is "<<(GetNumBlocks()-1)<<endl;
+    return ERROR_NOSUCHBLOCK;
+  }
+
+  if (IsTiered()) { 
+    return members[1]->NotifyAllocateBlocks(offset,innumblocks);
+  }
+
+  if (IsStriped()) { 
+    for (BLOCKNUM_T i=offset; i<(offset+innumblocks); i++) { 
+      SIZE_T member;
+    BLOCKNUM_T memberblock;
+      MapStripe(i,member,memberblock);
+      ERROR_T rc = members[member]->NotifyAllocateBlocks(memberblock,1);
+      if (rc!=ERROR_NOERROR) { 
+	return rc;
+      }
+    }
+    return ERROR_NOERROR;
+  }
+
+  if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+    for (BLOCKNUM_T i=offset; i<(offset+innumblocks); i++) { 
+      if (IsBlockAllocated(i)) {
+	cerr << "Disksystem: NotifyAllocateBlocks: Block "<<i<<" is being allocated, but it's already allocated!"<<endl;
+      }
+    }
+  }
+
+  SetBitMapRange(offset,innumblocks,true);
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T DiskSystem::NotifyDeallocateBlocks(const BLOCKNUM_T offset,const BLOCKNUM_T innumblocks)
+{
+  if (offset+innumblocks > GetNumBlocks()) { 
+    cerr << "Disksystem: NotifyDeallocateBlocks: Attempt to deallocate"<<offset<<" to "<<(offset+innumblocks-1)<<" but maximum block is "<<(GetNumBlocks()-1)<<endl;
+    return ERROR_NOSUCHBLOCK;
+  }
+
+  if (IsTiered()) { 
+    // a freed block gives up its fast tier slot without being written back
+    for (BLOCKNUM_T i=offset; i<(offset+innumblocks); i++) { 
+      BLOCKNUM_T slot=tierslot[i];
+      if (slot!=DISKSYSTEM_LOG_NOBLOCK) { 
+	tierslot[i]=DISKSYSTEM_LOG_NOBLOCK;
+	slotowner[slot]=DISKSYSTEM_LOG_NOBLOCK;
+	slotdirty[slot]=false;
+	members[0]->NotifyDeallocateBlocks(slot,1);
+      }
+      heat[i]=0;
+    }
+    return members[1]->NotifyDeallocateBlocks(offset,innumblocks);
+  }
+
+  if (IsStriped()) { 
+    for (BLOCKNUM_T i=offset; i<(offset+innumblocks); i++) { 
+      SIZE_T member;
+    BLOCKNUM_T memberblock;
+      MapStripe(i,member,memberblock);
+      ERROR_T rc = members[member]->NotifyDeallocateBlocks(memberblock,1);
+      if (rc!=ERROR_NOERROR) { 
+	return rc;
+      }
+    }
+    return ERROR_NOERROR;
+  }
+
+  if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+    for (BLOCKNUM_T i=offset; i<(offset+innumblocks); i++) { 
+      if (!IsBlockAllocated(i)) {
+	cerr << "Disksystem: NotifyDeallocateBlocks: Block "<<i<<" is being deallocated, but it's already deallocated!"<<endl;
+      }
+    }
+  }
+
+  SetBitMapRange(offset,innumblocks,false);
+
+  // the cleaner need not copy blocks that are no longer in use
+  if (IsLogStructured()) { 
+    for (BLOCKNUM_T i=offset; i<(offset+innumblocks); i++) { 
+      LogKill(i);
+    }
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+ostream & DiskSystem::Print(ostream &os) const
+{
+  if (IsTiered()) { 
+    os << "DiskSystem(diskfilestem="<<diskfilestem
+       << ", tiered"
+       << ", numblocks="<<numblocks
+       << ", blocksize="<<blocksize
+       << ", fastslots="<<slotowner.size()
+       << ", fast="<<*members[0]
+       << ", slow="<<*members[1]
+       << ")";
+    return os;
+  }
+
+  if (IsStriped()) { 
+    os << "DiskSystem(diskfilestem="<<diskfilestem
+       << ", numdisks="<<members.size()
+       << ", stripeunit="<<stripeunit
+       << ", numblocks="<<numblocks
+       << ", blocksize="<<blocksize
+       << ", members=(";
+    for (SIZE_T i=0;i<members.size();i++) { 
+      if (i>0) { 
+	os << ", ";
+      }
+      os << *members[i];
+    }
+    os << "))";
+    return os;
+  }
+
+  os << "DiskSystem(diskfilestem="<<diskfilestem
+     << ", offset="<<offset
+     << ", numblocks="<<numblocks
      << ", blocksize="<<blocksize
      << ", numheads="<<numheads
      << ", blockspertrack="<<blockspertrack
@@ -582,17 +2284,61 @@ ostream & DiskSystem::Print(ostream &os) const
      << ", last_sector="<<last_sector
      << ", averageseeklatency="<<averageseeklatency
      << ", trackseeklatency="<<trackseeklatency
-     << ", rotationallatency="<<rotationallatency
-     << ", bitmap=";
+     << ", rotationallatency="<<rotationallatency;
+  if (IsCompressed()) { 
+    os << ", sectorsize="<<sectorsize
+       << ", compressionratio="<<GetCompressionRatio()
+       << ", bytessaved="<<GetBytesSaved();
+  }
+  if (IsLogStructured()) { 
+    os << ", segmentsize="<<segmentsize
+       << ", logblocks="<<logblocks
+       << ", headsegment="<<headsegment
+       << ", freesegments="<<freesegments.size()
+       << ", pendingsegments="<<pendingsegments.size()
+       << ", cleanedsegments="<<cleanedsegments
+       << ", cleanedblocks="<<cleanedblocks
+       << ", cleaningtime="<<cleaningtime;
+  }
+  os << ", bitmap=";
 
-  for (SIZE_T i=0;i<numblocks;i++) { 
-    if (GETBIT(i)) { 
-      os <<"*";
-    } else {
-      os <<".";
+  // Expand a byte at a time through a table of the 256 patterns.
+  // Chunks that have not been read are read into a scratch buffer.
+  static char patterns[256][8];
+  static bool havepatterns=false;
+
+  if (!havepatterns) { 
+    for (SIZE_T b=0;b<256;b++) { 
+      for (SIZE_T j=0;j<8;j++) { 
+	patterns[b][j] = ((b>>(7-j))&0x1) ? '*' : '.';
+      }
+    }
+    havepatterns=true;
+  }
+
+  BYTE_T *scratch = new BYTE_T [DISKSYSTEM_BITMAP_CHUNK_BYTES];
+  string line;
+
+  for (BLOCKNUM_T c=0;c<bitmapchunks.size();c++) { 
+    const BYTE_T *bits = bitmapchunks[c];
+    if (!bits) { 
+      ReadBitMapChunk(c,scratch);
+      bits = scratch;
+    }
+    BLOCKNUM_T base = c*DISKSYSTEM_BITMAP_CHUNK_BITS;
+    SIZE_T nbits = (numblocks-base < DISKSYSTEM_BITMAP_CHUNK_BITS) ? numblocks-base : DISKSYSTEM_BITMAP_CHUNK_BITS;
+    line.clear();
+    for (SIZE_T j=0;j<nbits/8;j++) { 
+      line.append(patterns[bits[j]],8);
     }
+    if (nbits%8) { 
+      line.append(patterns[bits[nbits/8]],nbits%8);
+    }
+    os << line;
   }
 
+  delete [] scratch;
+
   os <<")";
   return os;
 }
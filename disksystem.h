@@ -4,20 +4,81 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <set>
 
 #include "global.h"
 #include "block.h"
 
 using namespace std;
 
+// The allocation bitmap is read and written in chunks of this many bytes
+#define DISKSYSTEM_BITMAP_CHUNK_BYTES 4096
+#define DISKSYSTEM_BITMAP_CHUNK_BITS  (DISKSYSTEM_BITMAP_CHUNK_BYTES*8)
+
+// Log structured disks: a remap entry for a block that has no copy
+#define DISKSYSTEM_LOG_NOBLOCK ((BLOCKNUM_T)-1)
+// and how many segments the head may fill between checkpoints
+#define DISKSYSTEM_LOG_CHECKPOINT_SEGMENTS 16
+// and how many cleaned segments may wait for one before it is forced
+#define DISKSYSTEM_LOG_PENDING_SEGMENTS 8
+
+// Tiered disks: how many fast tier slots are looked at to find one to
+// give up, and how many recent accesses make a block worth promoting
+#define DISKSYSTEM_TIER_SCAN 8
+#define DISKSYSTEM_TIER_PROMOTE_HEAT 2
+
+struct TierStats {
+  BLOCKNUM_T reads, writes;            // blocks, on behalf of requests
+  double     time;                     // milliseconds, on behalf of requests
+  BLOCKNUM_T migratedin, migratedout;  // blocks
+  double     migrationtime;            // milliseconds, in the background
+
+  TierStats() : reads(0), writes(0), time(0), migratedin(0), migratedout(0), migrationtime(0) {}
+};
+
 // Models a single disk with a single outstanding request
 //
 // Includes storage allocator and free space bitmap to 
 // simplify project - REAL DISKS DO NOT HAVE ALLOCATORS OR BITMAPS
 //
+// A DiskSystem can also be a composite of member DiskSystems
+// (RAID-0 style).  Logical blocks are striped across the members in
+// units of stripeunit blocks.  Each member is an ordinary disk image with
+// its own config, bitmap, and head position, and a request that spans
+// several members is serviced by all of them at once.
+//
+// A disk can also store its blocks compressed.  Each block is
+// compressed on write and stored in as many sectors of its slot as it
+// needs, and a mapping table records the number of sectors used by
+// each block.  Only the sectors actually transferred are charged for.
+//
+// A disk can instead be log structured.  Every block write is
+// appended at the log head, and a remap table records where the
+// current copy of each block is.  The disk is divided into segments,
+// and a cleaner copies the live blocks out of the emptiest segments to
+// free them.  The cleaner runs in the background: its time is tracked
+// separately and not charged to requests.  The remap table is saved in
+// checkpoints, and a segment is only reused once a checkpoint no
+// longer refers to it.  Some of the disk is held back for the cleaner,
+// so fewer blocks are offered than the geometry provides.
+//
+// A tiered disk is a composite of a small fast disk and a large slow
+// one, each with its own latency model.  Block b is stored as block b
+// of the slow disk unless it is hot, in which case it has been moved
+// to a slot on the fast disk.  Heat is the number of recent accesses
+// to a block, halved every numblocks accesses.  Migration happens in
+// the background after a request, like the log cleaner.
+//
+// The bitmap is held as fixed size chunks that are read from the
+// bitmap file the first time they are touched.  Only chunks that have
+// changed are written back, and the config file is only rewritten
+// when the configuration has changed.
+//
 class DiskSystem {
  private:
-  BYTE_T *bitmap;
+  vector<BYTE_T *> bitmapchunks;  // 0 until the chunk is first touched
+  vector<bool>     bitmapdirty;
+  bool             configdirty;
   FILE*  datafilefd;
   FILE*  configfilefd;
   FILE*  bitmapfilefd;
@@ -27,13 +88,13 @@ class DiskSystem {
   //
 
   string diskfilestem;
-  SIZE_T offset;
-  SIZE_T numblocks;
+  OFFSET_T offset;
+  BLOCKNUM_T numblocks;
   SIZE_T blocksize;
   SIZE_T numheads;
   SIZE_T blockspertrack;
-  SIZE_T numtracks;
-  SIZE_T last_track;
+  BLOCKNUM_T numtracks;
+  BLOCKNUM_T last_track;
   SIZE_T last_sector;
     
 
@@ -41,8 +102,51 @@ class DiskSystem {
   double trackseeklatency;
   double rotationallatency;
 
+  // only used by striped disks
+  vector<DiskSystem *> members;
+  SIZE_T stripeunit;
+
+  // only used by compressed disks
+  SIZE_T sectorsize;               // 0 if blocks are stored uncompressed
+  FILE*  mapfilefd;
+  vector<unsigned short> slotmap;  // sectors used by each block, 0 if never written
+  BLOCKNUM_T mapdirtylo, mapdirtyhi;
+  BLOCKNUM_T storedblocks, storedsectors;
+  OFFSET_T logicalbytes, physicalbytes;  // transferred since startup
+
+  // only used by log structured disks
+  SIZE_T segmentsize;              // 0 if blocks are written in place
+  BLOCKNUM_T logblocks;            // blocks offered
+  vector<BLOCKNUM_T> remap;        // block to physical block
+  vector<BLOCKNUM_T> owner;        // physical block to block, if live
+  vector<SIZE_T> segmentlive;      // live blocks in each segment
+  vector<bool> segmentfree;
+  set<BLOCKNUM_T> freesegments;
+  vector<BLOCKNUM_T> pendingsegments;  // cleaned, free after the next checkpoint
+  // The segments the cleaner may pick, in lists by live blocks
+  vector<BLOCKNUM_T> livebuckets;  // first segment with each count
+  vector<BLOCKNUM_T> bucketnext, bucketprev;
+  vector<bool> inbucket;
+  BLOCKNUM_T headsegment;          // segment being filled
+  SIZE_T headused;                 // blocks of it filled so far
+  BLOCKNUM_T segmentssincecheckpoint;
+  BLOCKNUM_T cleanedsegments, cleanedblocks;
+  double cleaningtime;
+
+  // only used by tiered disks, where members[0] is fast and members[1] slow
+  bool tiered;
+  vector<BLOCKNUM_T> tierslot;     // block to fast tier slot
+  vector<BLOCKNUM_T> slotowner;    // fast tier slot to block
+  vector<bool> slotdirty;          // newer than the copy on the slow tier
+  vector<unsigned short> heat;
+  BLOCKNUM_T heataccesses;
+  BLOCKNUM_T clockhand;
+  TierStats tierstats[2];
+
  protected:
-  virtual double ModelAccess(const SIZE_T off, const SIZE_T num);
+  // xferblocks is the number of blocks' worth of sectors actually
+  // transferred, which is less than num for a compressed disk
+  virtual double ModelAccess(const BLOCKNUM_T off, const SIZE_T num, const double xferblocks);
 
   ERROR_T SanityCheckConfig();
   ERROR_T InitFromConfigFile();
@@ -51,23 +155,113 @@ class DiskSystem {
   ERROR_T WriteConfig();
   ERROR_T ReadBitMap();
   ERROR_T WriteBitMap();
+  OFFSET_T GetNumBitMapBytes() const;
+  SIZE_T  GetBitMapChunkBytes(const BLOCKNUM_T chunk) const;
+  ERROR_T ReadBitMapChunk(const BLOCKNUM_T chunk, BYTE_T *buf) const;
+  BYTE_T *GetBitMapChunk(const BLOCKNUM_T chunk);
+  void    SetBitMapRange(const BLOCKNUM_T offset, const BLOCKNUM_T num, const bool allocated);
+  void    FreeBitMap();
+
+  bool    IsStriped() const { return !members.empty() && !tiered; }
+  void    MapStripe(const BLOCKNUM_T block, SIZE_T &member, BLOCKNUM_T &memberblock) const;
+  ERROR_T InitStripedFromInMemoryConfig(const SIZE_T numdisks);
+  ERROR_T ReadStripedConfig();
+  ERROR_T WriteStripedConfig();
+  ERROR_T StripedRead(const BLOCKNUM_T inoffblock,
+		      const SIZE_T numblock,
+		      vector<Block> &blocks,
+		      double &reqtime);
+  ERROR_T StripedWrite(const BLOCKNUM_T inoffblock,
+		       const SIZE_T numblock,
+		       const vector<Block> &blocks,
+		       double &reqtime);
+
+  SIZE_T  GetSectorsPerBlock() const { return blocksize/sectorsize; }
+  ERROR_T InitSlotMap(const bool create);
+  ERROR_T WriteSlotMap();
+  ERROR_T CompressedRead(const BLOCKNUM_T inoffblock,
+			 const SIZE_T numblock,
+			 vector<Block> &blocks,
+			 double &reqtime);
+  ERROR_T CompressedWrite(const BLOCKNUM_T inoffblock,
+			  const SIZE_T numblock,
+			  const vector<Block> &blocks,
+			  double &reqtime);
+
+  bool    IsLogStructured() const { return segmentsize!=0; }
+  ERROR_T InitLog(const bool create);
+  ERROR_T WriteCheckpoint();
+  BLOCKNUM_T GetLogSpace() const;
+  ERROR_T LogAppend(const BLOCKNUM_T block, const BYTE_T *data, BLOCKNUM_T &phys);
+  ERROR_T LogClean(const BLOCKNUM_T needed);
+  void    LogKill(const BLOCKNUM_T block);
+  void    LogSeal(const BLOCKNUM_T segment);
+  void    LogUnseal(const BLOCKNUM_T segment);
+  BLOCKNUM_T LogPickVictim() const;
+  ERROR_T LogRead(const BLOCKNUM_T inoffblock,
+		  const SIZE_T numblock,
+		  vector<Block> &blocks,
+		  double &reqtime);
+  ERROR_T LogGrow();
+  ERROR_T LogWrite(const BLOCKNUM_T inoffblock,
+		   const SIZE_T numblock,
+		   const vector<Block> &blocks,
+		   double &reqtime);
+
+  bool    IsTiered() const { return tiered; }
+  ERROR_T ReadTieredConfig();
+  ERROR_T ReadTierMap();
+  ERROR_T WriteTierMap();
+  void    MapTier(const BLOCKNUM_T block, SIZE_T &tier, BLOCKNUM_T &tierblock) const;
+  ERROR_T TierAccessed(const BLOCKNUM_T block, const Block &data);
+  ERROR_T TieredRead(const BLOCKNUM_T inoffblock,
+		     const SIZE_T numblock,
+		     vector<Block> &blocks,
+		     double &reqtime);
+  ERROR_T TieredWrite(const BLOCKNUM_T inoffblock,
+		      const SIZE_T numblock,
+		      const vector<Block> &blocks,
+		      double &reqtime);
   
    
  public:
   // The data is stored in file "filestem.data"
   // The config is stored in file "filestem.config"
+  //
+  // If numdisks>1, a striped disk is created instead.  The geometry
+  // then describes each member, and the members are stored as
+  // "filestem.0", "filestem.1", ...  Only "filestem.config" is
+  // written for the striped disk itself.
+  //
+  // If sectorsize>0, blocks are stored compressed in units of
+  // sectorsize bytes, which must divide the block size.  The mapping
+  // table is stored in "filestem.map".
+  //
+  // If segmentsize>0, the disk is log structured with segments of
+  // segmentsize blocks.  The checkpoint is stored in "filestem.log".
 
   DiskSystem(const string &filestem,
 	     const bool create=false,
-	     const SIZE_T offset=0,
-	     const SIZE_T blocks=0,
+	     const OFFSET_T offset=0,
+	     const BLOCKNUM_T blocks=0,
 	     const SIZE_T blocksize=0,
 	     const SIZE_T heads=0,
 	     const SIZE_T blockspertrack=0,
-	     const SIZE_T tracks=0,
+	     const BLOCKNUM_T tracks=0,
 	     const double avgseek=0,
 	     const double trackseek=0,
-	     const double rotlat=0);
+	     const double rotlat=0,
+	     const SIZE_T numdisks=1,
+	     const SIZE_T stripeunit=1,
+	     const SIZE_T sectorsize=0,
+	     const SIZE_T segmentsize=0);
+  // A tiered disk is made from two existing disks.  This writes
+  // "filestem.config" for it; open it with DiskSystem(filestem).
+  // The placement of blocks is stored in "filestem.tiermap".
+  static ERROR_T CreateTiered(const string &filestem,
+			      const string &faststem,
+			      const string &slowstem);
+
   DiskSystem() { throw GenericException(); } 
   DiskSystem(const DiskSystem &rhs) { throw GenericException();}
   DiskSystem & operator=(const DiskSystem &rhs) { throw GenericException(); return *this;}
@@ -76,38 +270,58 @@ class DiskSystem {
 
   // Each returns the number of milliseconds the operation has taken
 
-  ERROR_T Read(const SIZE_T inoffblock,
+  ERROR_T Read(const BLOCKNUM_T inoffblock,
 	       const SIZE_T numblock,
 	       vector<Block> &blocks,
 	       double &reqtime);
 
-  ERROR_T Read(const SIZE_T inoffblock, 
+  ERROR_T Read(const BLOCKNUM_T inoffblock, 
 	       Block &blocks,
 	       double &reqtime);
 
-  ERROR_T Write(const SIZE_T inoffblock,
+  ERROR_T Write(const BLOCKNUM_T inoffblock,
 		const SIZE_T numblock,
 		const vector<Block> &blocks,
 		double &reqtime);
 
-  ERROR_T Write(const SIZE_T inoffblock, 
+  ERROR_T Write(const BLOCKNUM_T inoffblock, 
 		const Block &blocks,
 		double &reqtime);
 
   SIZE_T GetBlockSize() const;
-  SIZE_T GetNumBlocks() const;
+  BLOCKNUM_T GetNumBlocks() const;
+
+  // Adds addblocks blocks to the end of the disk, which may be in use.
+  // This must be a whole number of tracks (and of segments for a log
+  // structured disk).  A striped disk grows each member by an equal
+  // share, and a tiered disk grows its slow disk.  The cost is
+  // proportional to addblocks, not to the size of the disk.
+  ERROR_T Grow(const BLOCKNUM_T addblocks);
+  // 1 for an ordinary disk
+  SIZE_T GetNumDisks() const;
+
+  bool     IsCompressed() const { return sectorsize!=0; }
+  // For a compressed disk, the ratio of the size of the blocks stored
+  // to the space they occupy, and the number of bytes that did not
+  // need to be transferred since startup.  1 and 0 otherwise.
+  double   GetCompressionRatio() const;
+  OFFSET_T GetBytesSaved() const;
+
+  // Prints the statistics of whichever storage modes are in use,
+  // one "name = value" line each
+  ostream & PrintStats(ostream &os) const;
 
   //
   // These are notification functions that should be called when
   // a block is allocated or deallocated.  They keep the bitmap updated
   // so that we can sanity check blocks
   //
-  ERROR_T NotifyAllocateBlocks(const SIZE_T offset,
-			       const SIZE_T innumblocks);
-  ERROR_T NotifyDeallocateBlocks(const SIZE_T offset,
-				 const SIZE_T innumblocks);
+  ERROR_T NotifyAllocateBlocks(const BLOCKNUM_T offset,
+			       const BLOCKNUM_T innumblocks);
+  ERROR_T NotifyDeallocateBlocks(const BLOCKNUM_T offset,
+				 const BLOCKNUM_T innumblocks);
 
-  bool    IsBlockAllocated(const SIZE_T offset);
+  bool    IsBlockAllocated(const BLOCKNUM_T offset);
 
 
   ostream & Print(ostream &os) const;
@@ -16,7 +16,7 @@ int main(int argc, char *argv[])
     exit(-1);
   }
   SIZE_T cachesize=atoi(argv[2]);
-  SIZE_T blocknum=atoi(argv[3]);
+  BLOCKNUM_T blocknum=strtoull(argv[3],0,0);
   SIZE_T numblocks=atoi(argv[4]);
 
   DiskSystem disk(argv[1]);
@@ -24,7 +24,7 @@ int main(int argc, char *argv[])
 
   cache.Attach();
 
-  for (unsigned i=blocknum;i<(blocknum+numblocks);i++) { 
+  for (BLOCKNUM_T i=blocknum;i<(blocknum+numblocks);i++) { 
     ERROR_T rc=cache.NotifyDeallocateBlock(i);
     if (rc!=ERROR_NOERROR) { 
       cerr << "Error " << rc <<" occured when notifying cache of allocation of block "<< i << endl;
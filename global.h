@@ -5,6 +5,10 @@
 typedef unsigned char BYTE_T;
 typedef unsigned int SIZE_T;
 typedef int ERROR_T;
+// Block numbers and byte offsets on a disk are 64 bits wide so that
+// disk images can be larger than 4 GB
+typedef unsigned long long BLOCKNUM_T;
+typedef unsigned long long OFFSET_T;
 
 
 // Shared by all
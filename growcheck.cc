@@ -0,0 +1,170 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "btree.h"
+#include "benchutil.h"
+
+using namespace std;
+
+
+void usage()
+{
+  cerr << "usage: growcheck filestem [numblocks [addblocks]]\n";
+  cerr << "       in each node format, inserts 8 byte keys in random order into a\n";
+  cerr << "       btree on a disk of numblocks 256 byte blocks until it is full,\n";
+  cerr << "       grows the disk by addblocks while the btree is attached, and goes\n";
+  cerr << "       on inserting until it is full again.  Checks that a failed insert\n";
+  cerr << "       stores nothing, that every key acknowledged can be looked up and\n";
+  cerr << "       is scanned once, and that the btree is sane.  filestem is made and\n";
+  cerr << "       deleted for each format.  numblocks and addblocks default to 64.\n";
+  cerr << "       Exits nonzero if any check fails.\n";
+}
+
+
+static void MakeKey(const unsigned long long k, KEY_T &key)
+{
+  key.Resize(8,false);
+  for (SIZE_T j=0;j<8;j++) {
+    key.data[j]=(BYTE_T)(k>>(56-8*j));
+  }
+}
+
+
+// Inserts keys from next on until one fails for want of space, and
+// checks that it was not stored
+static bool Fill(BTreeIndex &btree, const vector<unsigned long long> &keys,
+		 SIZE_T &next, vector<SIZE_T> &acked)
+{
+  KEY_T key;
+  VALUE_T value;
+  ERROR_T rc;
+
+  for (; next<keys.size(); next++) {
+    MakeKey(keys[next],key);
+    value.Resize(8,false);
+    memcpy(value.data,&keys[next],8);
+    rc=btree.Insert(key,value);
+    if (rc==ERROR_NOSPACE) {
+      if (btree.Lookup(key,value)!=ERROR_NONEXISTENT) {
+	cerr << "growcheck: a key that did not fit was stored\n";
+	return false;
+      }
+      next++;
+      return true;
+    }
+    if (rc) {
+      cerr << "growcheck: insert failed, error "<<rc<<"\n";
+      return false;
+    }
+    acked.push_back(next);
+  }
+  return true;
+}
+
+
+// Every key acknowledged is there with its value, and a scan sees
+// just those keys
+static bool Check(BTreeIndex &btree, const vector<unsigned long long> &keys,
+		  const vector<SIZE_T> &acked)
+{
+  KEY_T key;
+  VALUE_T value;
+  ERROR_T rc;
+
+  if ((rc=btree.SanityCheck())) {
+    cerr << "growcheck: btree is not sane, error "<<rc<<"\n";
+    return false;
+  }
+  for (SIZE_T i=0;i<acked.size();i++) {
+    MakeKey(keys[acked[i]],key);
+    if ((rc=btree.Lookup(key,value)) || memcmp(value.data,&keys[acked[i]],8)) {
+      cerr << "growcheck: key "<<keys[acked[i]]<<" was lost, error "<<rc<<"\n";
+      return false;
+    }
+  }
+
+  BTreeCursor cursor;
+  SIZE_T scanned=0;
+
+  MakeKey(0,key);
+  for (rc=btree.Seek(key,cursor); rc==ERROR_NOERROR && !cursor.AtEnd(); rc=btree.Next(cursor)) {
+    scanned++;
+  }
+  if (rc || scanned!=acked.size()) {
+    cerr << "growcheck: scanned "<<scanned<<" keys of "<<acked.size()<<", error "<<rc<<"\n";
+    return false;
+  }
+  return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<2 || argc>4) {
+    usage();
+    exit(-1);
+  }
+
+  string stem(argv[1]);
+  SIZE_T numblocks = argc>=3 ? atoi(argv[2]) : 64;
+  SIZE_T addblocks = argc>=4 ? atoi(argv[3]) : 64;
+  SIZE_T keysize=8, valuesize=8, blocksize=256, blockspertrack=16;
+  bool ok=true;
+
+  if (numblocks<blockspertrack || numblocks%blockspertrack || addblocks%blockspertrack) {
+    usage();
+    exit(-1);
+  }
+
+  // far more keys than will fit, in random order
+  vector<unsigned long long> keys((numblocks+addblocks)*blocksize/(keysize+valuesize));
+  for (SIZE_T i=0;i<keys.size();i++) {
+    keys[i]=(i+1)*0x9e3779b97f4a7c15ull;
+  }
+
+  cout << setw(7) << "format" << setw(10) << "full at" << setw(10) << "then" << "\n";
+
+  for (SIZE_T format=BTREE_FORMAT_V1;format<=BTREE_FORMAT_CURRENT;format++) {
+    ERROR_T rc;
+    vector<SIZE_T> acked;
+    SIZE_T next=0, first;
+
+    deletedisk(stem);
+    {
+      DiskSystem disk(stem,true,0,numblocks,blocksize,1,blockspertrack,
+		      numblocks/blockspertrack,1,1,1);
+      BufferCache cache(&disk,16);
+      BTreeIndex btree(keysize,valuesize,&cache,true,format);
+
+      cache.Attach();
+      if ((rc=btree.Attach(0,true))) {
+	cerr << "growcheck: cannot make a btree, error "<<rc<<"\n";
+	return -1;
+      }
+
+      bool good = Fill(btree,keys,next,acked) && Check(btree,keys,acked);
+      first=acked.size();
+      if (good && (rc=disk.Grow(addblocks))) {
+	cerr << "growcheck: cannot grow the disk, error "<<rc<<"\n";
+	good=false;
+      }
+      good = good && Fill(btree,keys,next,acked) && Check(btree,keys,acked);
+
+      BLOCKNUM_T superblock;
+      btree.Detach(superblock);
+      cache.Detach();
+
+      cout << setw(7) << format << setw(10) << first << setw(10) << acked.size()
+	   << (good ? "" : "  FAILED") << "\n";
+      ok = ok && good;
+    }
+    deletedisk(stem);
+  }
+
+  return ok ? 0 : -1;
+}
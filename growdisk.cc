@@ -0,0 +1,37 @@
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+
+#include "disksystem.h"
+
+
+void usage() 
+{
+  cerr << "usage: growdisk filestem addblocks\n";
+  cerr << "       addblocks is a whole number of tracks (and segments)\n";
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc!=3) { 
+    usage();
+    exit(-1);
+  }
+
+  DiskSystem disk(argv[1]);
+
+  BLOCKNUM_T addblocks = strtoull(argv[2],0,0);
+
+  ERROR_T rc = disk.Grow(addblocks);
+
+  if (rc!=ERROR_NOERROR) { 
+    cerr << "Error "<< rc << " occured.\n";
+    return -1;
+  }
+
+  cerr << "Disk is as follows.\n" << disk << "\n";
+
+  cerr << "Done.\n";
+
+  return 0;
+}
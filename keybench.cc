@@ -0,0 +1,119 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "global.h"
+#include "keycompare.h"
+
+using namespace std;
+
+
+void usage() 
+{
+  cerr << "usage: keybench [comparisons]\n";
+  cerr << "       times the key comparison kernels against memcmp for a range of key sizes\n";
+}
+
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+
+static int CompareMemcmp(const BYTE_T *a, const BYTE_T *b, const SIZE_T n)
+{
+  return memcmp(a,b,n);
+}
+
+
+typedef int (*KEYCOMPARE_FN)(const BYTE_T *, const BYTE_T *, const SIZE_T);
+
+// Nanoseconds per comparison of a key against each of a set of keys
+// that share a prefix of random length with it, like the keys of a
+// node near the one searched for
+static double TimeKernel(KEYCOMPARE_FN f, const vector<BYTE_T *> &keys, 
+			 const SIZE_T keysize, const SIZE_T comparisons, int &sink)
+{
+  double start=now();
+  SIZE_T n=keys.size();
+
+  for (SIZE_T i=0;i<comparisons;i++) { 
+    sink+=f(keys[0],keys[1+i%(n-1)],keysize);
+  }
+  return (now()-start)/comparisons;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc>2) { 
+    usage();
+    exit(-1);
+  }
+
+  SIZE_T comparisons = argc==2 ? atoi(argv[1]) : 2000000;
+  SIZE_T sizes[] = {8, 16, 32, 64, 128, 256, 512, 1024, 4096};
+  KEYCOMPARE_FN kernels[] = {CompareMemcmp, CompareKeyBytesScalar, CompareKeyBytesSSE2, 
+			     CompareKeyBytesAVX2, CompareKeyBytes};
+  const char *names[] = {"memcmp", "scalar", "sse2", "avx2", "dispatch"};
+  SIZE_T numkernels = sizeof(kernels)/sizeof(kernels[0]);
+  int sink=0;
+
+  srandom(1);
+
+  cout << "dispatch uses "<<GetKeyCompareKernel()<<"\n";
+  cout << "ns per comparison\n";
+  cout << setw(8) << "keysize";
+  for (SIZE_T k=0;k<numkernels;k++) { 
+    cout << setw(10) << names[k];
+  }
+  cout << "\n";
+
+  for (SIZE_T s=0;s<sizeof(sizes)/sizeof(sizes[0]);s++) { 
+    SIZE_T keysize=sizes[s];
+    vector<BYTE_T *> keys;
+
+    // 64 keys that agree with the first up to a random byte, which is
+    // most often in the last quarter of the key
+    for (SIZE_T i=0;i<64;i++) { 
+      BYTE_T *k=new BYTE_T [keysize];
+      if (i==0) { 
+	for (SIZE_T j=0;j<keysize;j++) { 
+	  k[j]=random();
+	}
+      } else {
+	memcpy(k,keys[0],keysize);
+	SIZE_T d = i%4 ? keysize-1-random()%(keysize/4+1) : random()%keysize;
+	k[d]^=1+random()%255;
+      }
+      keys.push_back(k);
+    }
+
+    cout << setw(8) << keysize;
+    for (SIZE_T k=0;k<numkernels;k++) { 
+      // check against memcmp before timing
+      for (SIZE_T i=1;i<keys.size();i++) { 
+	int x=kernels[k](keys[0],keys[i],keysize), y=memcmp(keys[0],keys[i],keysize);
+	if ((x<0)!=(y<0) || (x==0)!=(y==0)) { 
+	  cerr << names[k] << " disagrees with memcmp at keysize "<<keysize<<"\n";
+	  return -1;
+	}
+      }
+      cout << setw(10) << fixed << setprecision(2) 
+	   << TimeKernel(kernels[k],keys,keysize,comparisons,sink);
+    }
+    cout << "\n";
+
+    for (SIZE_T i=0;i<keys.size();i++) { 
+      delete [] keys[i];
+    }
+  }
+
+  return sink==0x7fffffff;
+}
@@ -0,0 +1,401 @@
+#include <string.h>
+
+#include "keycompare.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KEYCOMPARE_X86 1
+#include <immintrin.h>
+#endif
+
+
+// Word at a time.  Loads are unaligned memcpys, which the compiler
+// turns into plain moves.  A differing word is byte swapped so that
+// comparing it as an integer orders it like its bytes.
+int CompareKeyBytesScalar(const BYTE_T *a, const BYTE_T *b, const SIZE_T n)
+{
+  SIZE_T i=0;
+
+  for (;i+8<=n;i+=8) { 
+    unsigned long long x, y;
+    memcpy(&x,a+i,8);
+    memcpy(&y,b+i,8);
+    if (x!=y) { 
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+      x=__builtin_bswap64(x);
+      y=__builtin_bswap64(y);
+#endif
+      return x<y ? -1 : 1;
+    }
+  }
+  for (;i<n;i++) { 
+    if (a[i]!=b[i]) { 
+      return (int)a[i]-(int)b[i];
+    }
+  }
+  return 0;
+}
+
+
+KEYPREFIX_T MakeKeyPrefix(const BYTE_T *key, const SIZE_T n)
+{
+  KEYPREFIX_T p=0;
+
+  for (SIZE_T i=0;i<sizeof(p);i++) { 
+    p = (p<<8) | (i<n ? key[i] : 0);
+  }
+  return p;
+}
+
+
+SIZE_T CountPrefixesBelowScalar(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q)
+{
+  SIZE_T count=0;
+
+  for (SIZE_T i=0;i<n;i++) { 
+    KEYPREFIX_T x;
+    memcpy(&x,p+i*sizeof(x),sizeof(x));
+    count += x<q;
+  }
+  return count;
+}
+
+
+SIZE_T GetDeltaWidth(const unsigned long long d)
+{
+  SIZE_T width = d ? 64-__builtin_clzll(d) : 0;
+
+  // wider than one load can bring in with its shift
+  return width>57 ? 64 : width;
+}
+
+
+SIZE_T GetPackedBytes(const SIZE_T n, const SIZE_T width)
+{
+  return (n*width+7)/8;
+}
+
+
+static inline unsigned long long PackedMask(const SIZE_T width)
+{
+  return width>=64 ? ~0ull : (1ull<<width)-1;
+}
+
+
+// The integer's bits start at bit i*width, which is within the first
+// byte loaded, and it ends within the 8 bytes
+unsigned long long GetPackedDelta(const BYTE_T *p, const SIZE_T width, const SIZE_T i)
+{
+  SIZE_T bit=i*width;
+  unsigned long long x;
+
+  memcpy(&x,p+bit/8,sizeof(x));
+#if __BYTE_ORDER__!=__ORDER_LITTLE_ENDIAN__
+  x=__builtin_bswap64(x);
+#endif
+  return (x>>(bit%8)) & PackedMask(width);
+}
+
+
+void PutPackedDelta(BYTE_T *p, const SIZE_T width, const SIZE_T i, const unsigned long long d)
+{
+  SIZE_T bit=i*width;
+  unsigned long long mask=PackedMask(width)<<(bit%8);
+  unsigned long long x;
+
+  memcpy(&x,p+bit/8,sizeof(x));
+#if __BYTE_ORDER__!=__ORDER_LITTLE_ENDIAN__
+  x=__builtin_bswap64(x);
+#endif
+  x = (x&~mask) | ((d<<(bit%8))&mask);
+#if __BYTE_ORDER__!=__ORDER_LITTLE_ENDIAN__
+  x=__builtin_bswap64(x);
+#endif
+  memcpy(p+bit/8,&x,sizeof(x));
+}
+
+
+SIZE_T CountPackedBelowScalar(const BYTE_T *p, const SIZE_T width, const SIZE_T i, const SIZE_T n,
+			      const unsigned long long q)
+{
+  SIZE_T count=0;
+
+  for (SIZE_T j=i;j<i+n;j++) { 
+    count += GetPackedDelta(p,width,j)<q;
+  }
+  return count;
+}
+
+
+#ifdef KEYCOMPARE_X86
+
+// x86 only compares signed integers, so both sides are offset by 2^31
+// to compare them as unsigned.  A lane that compares true is -1, so
+// subtracting the compare counts it.
+#define PREFIX_BIAS 0x80000000u
+
+SIZE_T CountPrefixesBelowSSE2(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q)
+{
+  __m128i bias=_mm_set1_epi32((int)PREFIX_BIAS);
+  __m128i qv=_mm_set1_epi32((int)(q^PREFIX_BIAS));
+  __m128i acc=_mm_setzero_si128();
+  SIZE_T i=0;
+
+  for (;i+4<=n;i+=4) { 
+    __m128i x=_mm_xor_si128(_mm_loadu_si128((const __m128i *)(p+i*sizeof(KEYPREFIX_T))),bias);
+    acc=_mm_sub_epi32(acc,_mm_cmpgt_epi32(qv,x));
+  }
+  acc=_mm_add_epi32(acc,_mm_shuffle_epi32(acc,_MM_SHUFFLE(1,0,3,2)));
+  acc=_mm_add_epi32(acc,_mm_shuffle_epi32(acc,_MM_SHUFFLE(2,3,0,1)));
+  return (SIZE_T)_mm_cvtsi128_si32(acc) + CountPrefixesBelowScalar(p+i*sizeof(KEYPREFIX_T),n-i,q);
+}
+
+
+__attribute__((target("avx2")))
+SIZE_T CountPrefixesBelowAVX2(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q)
+{
+  __m256i bias=_mm256_set1_epi32((int)PREFIX_BIAS);
+  __m256i qv=_mm256_set1_epi32((int)(q^PREFIX_BIAS));
+  __m256i acc=_mm256_setzero_si256();
+  SIZE_T i=0;
+
+  for (;i+8<=n;i+=8) { 
+    __m256i x=_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p+i*sizeof(KEYPREFIX_T))),bias);
+    acc=_mm256_sub_epi32(acc,_mm256_cmpgt_epi32(qv,x));
+  }
+  __m128i sum=_mm_add_epi32(_mm256_castsi256_si128(acc),_mm256_extracti128_si256(acc,1));
+  sum=_mm_add_epi32(sum,_mm_shuffle_epi32(sum,_MM_SHUFFLE(1,0,3,2)));
+  sum=_mm_add_epi32(sum,_mm_shuffle_epi32(sum,_MM_SHUFFLE(2,3,0,1)));
+  SIZE_T count=(SIZE_T)_mm_cvtsi128_si32(sum);
+  // The compiler does not always clear the upper halves before the
+  // call, and the SSE2 code after it then stalls on the transition
+  _mm256_zeroupper();
+  return count + CountPrefixesBelowSSE2(p+i*sizeof(KEYPREFIX_T),n-i,q);
+}
+
+
+// Each lane loads the 8 bytes its integer starts in and shifts it down
+// by where in the first byte it starts.  Both sides are offset by 2^63
+// to compare them as unsigned, as with the prefixes.
+__attribute__((target("avx2")))
+SIZE_T CountPackedBelowAVX2(const BYTE_T *p, const SIZE_T width, const SIZE_T i, const SIZE_T n,
+			    const unsigned long long q)
+{
+  __m256i bias=_mm256_set1_epi64x((long long)0x8000000000000000ull);
+  __m256i qv=_mm256_set1_epi64x((long long)(q^0x8000000000000000ull));
+  __m256i mask=_mm256_set1_epi64x((long long)PackedMask(width));
+  __m256i seven=_mm256_set1_epi64x(7);
+  __m256i bits=_mm256_set_epi64x((long long)((i+3)*width),(long long)((i+2)*width),
+				 (long long)((i+1)*width),(long long)(i*width));
+  __m256i step=_mm256_set1_epi64x((long long)(4*width));
+  SIZE_T count=0;
+  SIZE_T j=0;
+
+  for (;j+4<=n;j+=4) { 
+    __m256i x=_mm256_i64gather_epi64((const long long *)p,_mm256_srli_epi64(bits,3),1);
+    x=_mm256_and_si256(_mm256_srlv_epi64(x,_mm256_and_si256(bits,seven)),mask);
+    __m256i lt=_mm256_cmpgt_epi64(qv,_mm256_xor_si256(x,bias));
+    count+=__builtin_popcount((unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+    bits=_mm256_add_epi64(bits,step);
+  }
+  _mm256_zeroupper();
+  return count + CountPackedBelowScalar(p,width,i+j,n-j,q);
+}
+
+
+// A movemask of a byte equality compare has a bit clear for each
+// byte that differs; the lowest one is the first difference.
+int CompareKeyBytesSSE2(const BYTE_T *a, const BYTE_T *b, const SIZE_T n)
+{
+  SIZE_T i=0;
+
+  for (;i+16<=n;i+=16) { 
+    __m128i x=_mm_loadu_si128((const __m128i *)(a+i));
+    __m128i y=_mm_loadu_si128((const __m128i *)(b+i));
+    unsigned mask=(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x,y));
+    if (mask!=0xffff) { 
+      SIZE_T j=i+__builtin_ctz(~mask);
+      return (int)a[j]-(int)b[j];
+    }
+  }
+  return CompareKeyBytesScalar(a+i,b+i,n-i);
+}
+
+
+__attribute__((target("avx2")))
+int CompareKeyBytesAVX2(const BYTE_T *a, const BYTE_T *b, const SIZE_T n)
+{
+  SIZE_T i=0;
+
+  // Long keys: test 128 bytes per step with one branch, and only
+  // look for the differing byte once a step has one
+  for (;i+128<=n;i+=128) { 
+    __m256i e0=_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a+i)),
+				 _mm256_loadu_si256((const __m256i *)(b+i)));
+    __m256i e1=_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a+i+32)),
+				 _mm256_loadu_si256((const __m256i *)(b+i+32)));
+    __m256i e2=_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a+i+64)),
+				 _mm256_loadu_si256((const __m256i *)(b+i+64)));
+    __m256i e3=_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a+i+96)),
+				 _mm256_loadu_si256((const __m256i *)(b+i+96)));
+    __m256i all=_mm256_and_si256(_mm256_and_si256(e0,e1),_mm256_and_si256(e2,e3));
+    if ((unsigned)_mm256_movemask_epi8(all)!=0xffffffff) { 
+      unsigned long long lo = (unsigned)_mm256_movemask_epi8(e0) 
+	| ((unsigned long long)(unsigned)_mm256_movemask_epi8(e1)<<32);
+      unsigned long long hi = (unsigned)_mm256_movemask_epi8(e2) 
+	| ((unsigned long long)(unsigned)_mm256_movemask_epi8(e3)<<32);
+      SIZE_T j = i + (~lo ? __builtin_ctzll(~lo) : 64+__builtin_ctzll(~hi));
+      return (int)a[j]-(int)b[j];
+    }
+  }
+
+  for (;i+32<=n;i+=32) { 
+    __m256i x=_mm256_loadu_si256((const __m256i *)(a+i));
+    __m256i y=_mm256_loadu_si256((const __m256i *)(b+i));
+    unsigned mask=(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x,y));
+    if (mask!=0xffffffff) { 
+      SIZE_T j=i+__builtin_ctz(~mask);
+      return (int)a[j]-(int)b[j];
+    }
+  }
+  return CompareKeyBytesSSE2(a+i,b+i,n-i);
+}
+
+#else
+
+int CompareKeyBytesSSE2(const BYTE_T *a, const BYTE_T *b, const SIZE_T n)
+{
+  return CompareKeyBytesScalar(a,b,n);
+}
+
+int CompareKeyBytesAVX2(const BYTE_T *a, const BYTE_T *b, const SIZE_T n)
+{
+  return CompareKeyBytesScalar(a,b,n);
+}
+
+SIZE_T CountPrefixesBelowSSE2(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q)
+{
+  return CountPrefixesBelowScalar(p,n,q);
+}
+
+SIZE_T CountPrefixesBelowAVX2(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q)
+{
+  return CountPrefixesBelowScalar(p,n,q);
+}
+
+SIZE_T CountPackedBelowAVX2(const BYTE_T *p, const SIZE_T width, const SIZE_T i, const SIZE_T n,
+			    const unsigned long long q)
+{
+  return CountPackedBelowScalar(p,width,i,n,q);
+}
+
+#endif
+
+
+typedef int (*KEYCOMPARE_FN)(const BYTE_T *, const BYTE_T *, const SIZE_T);
+typedef SIZE_T (*PREFIXCOUNT_FN)(const BYTE_T *, const SIZE_T, const KEYPREFIX_T);
+typedef SIZE_T (*PACKEDCOUNT_FN)(const BYTE_T *, const SIZE_T, const SIZE_T, const SIZE_T,
+				 const unsigned long long);
+
+static KEYCOMPARE_FN keycompare=0;
+static PREFIXCOUNT_FN prefixcount=0;
+static PACKEDCOUNT_FN packedcount=0;
+static const char *keycomparename="scalar";
+
+static void ChooseKeyCompare()
+{
+  keycompare=CompareKeyBytesScalar;
+  prefixcount=CountPrefixesBelowScalar;
+  packedcount=CountPackedBelowScalar;
+  keycomparename="scalar";
+#ifdef KEYCOMPARE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) { 
+    keycompare=CompareKeyBytesAVX2;
+    prefixcount=CountPrefixesBelowAVX2;
+    packedcount=CountPackedBelowAVX2;
+    keycomparename="avx2";
+  } else if (__builtin_cpu_supports("sse2")) { 
+    keycompare=CompareKeyBytesSSE2;
+    prefixcount=CountPrefixesBelowSSE2;
+    keycomparename="sse2";
+  }
+#endif
+}
+
+
+int CompareKeyBytes(const BYTE_T *a, const BYTE_T *b, const SIZE_T n)
+{
+  // A couple of words are done before a vector kernel gets going
+  if (n<=16) { 
+    return CompareKeyBytesScalar(a,b,n);
+  }
+  if (!keycompare) { 
+    ChooseKeyCompare();
+  }
+  return keycompare(a,b,n);
+}
+
+
+SIZE_T CountPrefixesBelow(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q)
+{
+  if (!prefixcount) { 
+    ChooseKeyCompare();
+  }
+  return prefixcount(p,n,q);
+}
+
+
+// The prefixes are dense, so halving the range touches few cache
+// lines.  It stops at a window the vector count does in a step or two.
+// Everything before base is less than q and everything from base+n on
+// is not, so the answer is base plus the count in the window.
+#define PREFIX_WINDOW 16
+
+SIZE_T SearchPrefixes(const BYTE_T *p, const SIZE_T num, const KEYPREFIX_T q)
+{
+  SIZE_T base=0, n=num;
+
+  while (n>PREFIX_WINDOW) { 
+    SIZE_T half=n/2;
+    KEYPREFIX_T x;
+    memcpy(&x,p+(base+half)*sizeof(x),sizeof(x));
+    base = x<q ? base+half : base;
+    n-=half;
+  }
+
+  return base + CountPrefixesBelow(p+base*sizeof(KEYPREFIX_T),n,q);
+}
+
+
+SIZE_T CountPackedBelow(const BYTE_T *p, const SIZE_T width, const SIZE_T i, const SIZE_T n,
+			const unsigned long long q)
+{
+  if (!packedcount) { 
+    ChooseKeyCompare();
+  }
+  return packedcount(p,width,i,n,q);
+}
+
+
+// As SearchPrefixes, with each integer unpacked on the way down
+SIZE_T SearchPacked(const BYTE_T *p, const SIZE_T width, const SIZE_T num, const unsigned long long q)
+{
+  SIZE_T base=0, n=num;
+
+  while (n>PREFIX_WINDOW) { 
+    SIZE_T half=n/2;
+    base = GetPackedDelta(p,width,base+half)<q ? base+half : base;
+    n-=half;
+  }
+
+  return base + CountPackedBelow(p,width,base,n,q);
+}
+
+
+const char *GetKeyCompareKernel()
+{
+  if (!keycompare) { 
+    ChooseKeyCompare();
+  }
+  return keycomparename;
+}
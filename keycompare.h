@@ -0,0 +1,90 @@
+#ifndef _keycompare
+#define _keycompare
+
+#include "global.h"
+
+//
+// Key comparison kernels
+//
+// Each compares n bytes and returns <0, 0, or >0 as memcmp does, by
+// finding the first byte that differs.  The scalar kernel works a
+// machine word at a time and runs anywhere.  The SSE2 and AVX2 kernels
+// compare 16 and 32 bytes per step; on machines without them (or
+// compilers that can't target them) they fall back to the scalar one.
+//
+// CompareKeyBytes uses the best kernel the running CPU supports,
+// chosen the first time it is called.
+//
+int CompareKeyBytesScalar(const BYTE_T *a, const BYTE_T *b, const SIZE_T n);
+int CompareKeyBytesSSE2(const BYTE_T *a, const BYTE_T *b, const SIZE_T n);
+int CompareKeyBytesAVX2(const BYTE_T *a, const BYTE_T *b, const SIZE_T n);
+
+int CompareKeyBytes(const BYTE_T *a, const BYTE_T *b, const SIZE_T n);
+
+// "avx2", "sse2", or "scalar"
+const char *GetKeyCompareKernel();
+
+
+//
+// Key prefixes
+//
+// A prefix is the first bytes of a key as a big endian integer, zero
+// padded, so that comparing prefixes orders keys as their bytes do,
+// except where prefixes tie.  Nodes can keep a dense array of them to
+// search before touching the keys themselves.
+//
+typedef unsigned int KEYPREFIX_T;
+
+KEYPREFIX_T MakeKeyPrefix(const BYTE_T *key, const SIZE_T n);
+
+// Number of the n prefixes at p (which need not be aligned) that are
+// less than q.  The vector kernels compare 4 and 8 at a time.
+SIZE_T CountPrefixesBelowScalar(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q);
+SIZE_T CountPrefixesBelowSSE2(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q);
+SIZE_T CountPrefixesBelowAVX2(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q);
+
+SIZE_T CountPrefixesBelow(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q);
+
+// Offset of the first of the n sorted prefixes at p that is no less
+// than q, n if there is none
+SIZE_T SearchPrefixes(const BYTE_T *p, const SIZE_T n, const KEYPREFIX_T q);
+
+
+//
+// Packed deltas
+//
+// An array of n unsigned integers of width bits each, 0 to 57 or 64,
+// packed one after another from the lowest bit of the first byte up
+// (in the order of the bytes of a little endian machine word).  Each
+// is read with one unaligned 8 byte load, so the array must be
+// followed by 8 bytes that can be read.  Nodes can keep sorted keys as
+// their differences from the smallest key this way, in a fraction of
+// the bytes of the keys themselves.
+//
+#define PACKED_MAX_WIDTH 64
+
+// Bits needed for d; widths 58 to 63 are rounded up to 64
+SIZE_T GetDeltaWidth(const unsigned long long d);
+// Bytes of n integers of width bits, without the 8 after them
+SIZE_T GetPackedBytes(const SIZE_T n, const SIZE_T width);
+
+unsigned long long GetPackedDelta(const BYTE_T *p, const SIZE_T width, const SIZE_T i);
+void PutPackedDelta(BYTE_T *p, const SIZE_T width, const SIZE_T i, const unsigned long long d);
+
+// Number of the n integers from the ith on that are less than q.  The
+// AVX2 kernel unpacks 4 at a time with a gather and variable shifts;
+// there is no SSE2 kernel, as SSE2 has neither those nor 64 bit
+// compares, so CPUs without AVX2 use the scalar one.
+SIZE_T CountPackedBelowScalar(const BYTE_T *p, const SIZE_T width, const SIZE_T i, const SIZE_T n,
+			      const unsigned long long q);
+SIZE_T CountPackedBelowAVX2(const BYTE_T *p, const SIZE_T width, const SIZE_T i, const SIZE_T n,
+			    const unsigned long long q);
+
+SIZE_T CountPackedBelow(const BYTE_T *p, const SIZE_T width, const SIZE_T i, const SIZE_T n,
+			const unsigned long long q);
+
+// Offset of the first of the n sorted integers at p that is no less
+// than q, n if there is none
+SIZE_T SearchPacked(const BYTE_T *p, const SIZE_T width, const SIZE_T n, const unsigned long long q);
+
+#endif
@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sstream>
+#include "keytype.h"
+
+
+ERROR_T KeyType::Parse(const string &spec)
+{
+  vector<KeyField> parsed;
+  size_t start=0;
+
+  while (1) {
+    size_t end=spec.find(',',start);
+    string name=spec.substr(start,end==string::npos ? string::npos : end-start);
+    KeyField f;
+
+    if (name=="u32") {
+      f.type=KEY_FIELD_UINT32; f.length=4;
+    } else if (name=="i32") {
+      f.type=KEY_FIELD_INT32; f.length=4;
+    } else if (name=="u64") {
+      f.type=KEY_FIELD_UINT64; f.length=8;
+    } else if (name=="i64") {
+      f.type=KEY_FIELD_INT64; f.length=8;
+    } else if (name.compare(0,3,"str")==0 && name.length()>3 &&
+	       name.find_first_not_of("0123456789",3)==string::npos) {
+      f.type=KEY_FIELD_STRING;
+      f.length=atoi(name.c_str()+3);
+      if (f.length==0 || f.length>65535) {
+	return ERROR_BADCONFIG;
+      }
+    } else {
+      return ERROR_BADCONFIG;
+    }
+    parsed.push_back(f);
+
+    if (end==string::npos) {
+      break;
+    }
+    start=end+1;
+  }
+
+  fields=parsed;
+  return ERROR_NOERROR;
+}
+
+
+SIZE_T KeyType::GetKeySize() const
+{
+  SIZE_T size=0;
+
+  for (SIZE_T i=0;i<fields.size();i++) {
+    size+=fields[i].length;
+  }
+  return size;
+}
+
+
+static void PutBigEndian(BYTE_T *p, unsigned long long v, const SIZE_T n)
+{
+  for (SIZE_T i=n;i>0;i--) {
+    p[i-1]=(BYTE_T)v;
+    v>>=8;
+  }
+}
+
+
+static unsigned long long GetBigEndian(const BYTE_T *p, const SIZE_T n)
+{
+  unsigned long long v=0;
+
+  for (SIZE_T i=0;i<n;i++) {
+    v=(v<<8)|p[i];
+  }
+  return v;
+}
+
+
+// The whole of text as an integer, or false
+static bool ParseSigned(const string &text, long long &v)
+{
+  char *end;
+
+  errno=0;
+  v=strtoll(text.c_str(),&end,10);
+  return !text.empty() && *end==0 && errno==0;
+}
+
+
+static bool ParseUnsigned(const string &text, unsigned long long &v)
+{
+  char *end;
+
+  // strtoull would take a minus sign and wrap around
+  if (text.empty() || text.find('-')!=string::npos) {
+    return false;
+  }
+  errno=0;
+  v=strtoull(text.c_str(),&end,10);
+  return *end==0 && errno==0;
+}
+
+
+ERROR_T KeyType::Encode(const string &text, KEY_T &key) const
+{
+  size_t start=0;
+  SIZE_T offset=0;
+  ERROR_T rc;
+
+  if ((rc=key.Resize(GetKeySize(),false))) {
+    return rc;
+  }
+  memset(key.data,0,key.length);
+
+  for (SIZE_T i=0;i<fields.size();i++) {
+    const KeyField &f=fields[i];
+    size_t end = i+1<fields.size() ? text.find(',',start) : text.length();
+    long long s;
+    unsigned long long u;
+
+    if (end==string::npos) {
+      return ERROR_SIZE;
+    }
+    string value=text.substr(start,end-start);
+
+    switch (f.type) {
+    case KEY_FIELD_UINT32:
+      if (!ParseUnsigned(value,u) || u>0xffffffffull) {
+	return ERROR_SIZE;
+      }
+      PutBigEndian(key.data+offset,u,4);
+      break;
+    case KEY_FIELD_UINT64:
+      if (!ParseUnsigned(value,u)) {
+	return ERROR_SIZE;
+      }
+      PutBigEndian(key.data+offset,u,8);
+      break;
+    case KEY_FIELD_INT32:
+      if (!ParseSigned(value,s) || s<-0x80000000ll || s>0x7fffffffll) {
+	return ERROR_SIZE;
+      }
+      PutBigEndian(key.data+offset,((unsigned long long)s)^0x80000000ull,4);
+      break;
+    case KEY_FIELD_INT64:
+      if (!ParseSigned(value,s)) {
+	return ERROR_SIZE;
+      }
+      PutBigEndian(key.data+offset,((unsigned long long)s)^0x8000000000000000ull,8);
+      break;
+    case KEY_FIELD_STRING:
+      if (value.length()>f.length) {
+	return ERROR_SIZE;
+      }
+      memcpy(key.data+offset,value.data(),value.length());
+      break;
+    default:
+      return ERROR_IMPLBUG;
+    }
+
+    offset+=f.length;
+    start=end+1;
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T KeyType::Decode(const KEY_T &key, string &text) const
+{
+  ostringstream os;
+  SIZE_T offset=0;
+
+  // A separator cut short (format 4 and up) reads as if padded with
+  // zeros, which is the smallest key it could stand for
+  vector<BYTE_T> bytes(GetKeySize(),0);
+  memcpy(&bytes[0],key.data,key.length<bytes.size() ? key.length : bytes.size());
+
+  for (SIZE_T i=0;i<fields.size();i++) {
+    const KeyField &f=fields[i];
+    const BYTE_T *p=&bytes[offset];
+    SIZE_T n;
+
+    if (i>0) {
+      os << ",";
+    }
+    switch (f.type) {
+    case KEY_FIELD_UINT32:
+    case KEY_FIELD_UINT64:
+      os << GetBigEndian(p,f.length);
+      break;
+    case KEY_FIELD_INT32:
+      os << (int)(unsigned)(GetBigEndian(p,4)^0x80000000ull);
+      break;
+    case KEY_FIELD_INT64:
+      os << (long long)(GetBigEndian(p,8)^0x8000000000000000ull);
+      break;
+    case KEY_FIELD_STRING:
+      // without the zeros it was padded with
+      for (n=f.length;n>0 && p[n-1]==0;n--) {
+      }
+      os.write((const char *)p,n);
+      break;
+    default:
+      return ERROR_IMPLBUG;
+    }
+    offset+=f.length;
+  }
+
+  text=os.str();
+  return ERROR_NOERROR;
+}
+
+
+void KeyType::Store(BYTE_T *p) const
+{
+  for (SIZE_T i=0;i<fields.size();i++) {
+    SIZE_T word=(fields[i].type<<24)|fields[i].length;
+    memcpy(p+i*sizeof(word),&word,sizeof(word));
+  }
+}
+
+
+ERROR_T KeyType::Load(const BYTE_T *p, const SIZE_T numfields)
+{
+  vector<KeyField> loaded;
+
+  for (SIZE_T i=0;i<numfields;i++) {
+    SIZE_T word;
+    KeyField f;
+
+    memcpy(&word,p+i*sizeof(word),sizeof(word));
+    f.type=word>>24;
+    f.length=word&0xffffff;
+
+    switch (f.type) {
+    case KEY_FIELD_UINT32:
+    case KEY_FIELD_INT32:
+      if (f.length!=4) { return ERROR_NOTANINDEX; }
+      break;
+    case KEY_FIELD_UINT64:
+    case KEY_FIELD_INT64:
+      if (f.length!=8) { return ERROR_NOTANINDEX; }
+      break;
+    case KEY_FIELD_STRING:
+      if (f.length==0 || f.length>65535) { return ERROR_NOTANINDEX; }
+      break;
+    default:
+      return ERROR_NOTANINDEX;
+    }
+    loaded.push_back(f);
+  }
+
+  fields=loaded;
+  return ERROR_NOERROR;
+}
+
+
+ostream & KeyType::Print(ostream &os) const
+{
+  if (fields.empty()) {
+    return os << "bytes";
+  }
+  for (SIZE_T i=0;i<fields.size();i++) {
+    if (i>0) {
+      os << ",";
+    }
+    switch (fields[i].type) {
+    case KEY_FIELD_UINT32: os << "u32"; break;
+    case KEY_FIELD_INT32:  os << "i32"; break;
+    case KEY_FIELD_UINT64: os << "u64"; break;
+    case KEY_FIELD_INT64:  os << "i64"; break;
+    case KEY_FIELD_STRING: os << "str" << fields[i].length; break;
+    default:               os << "?"; break;
+    }
+  }
+  return os;
+}
@@ -0,0 +1,89 @@
+#ifndef _keytype
+#define _keytype
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "global.h"
+#include "block.h"
+
+using namespace std;
+
+typedef Block Buffer;
+typedef Buffer KeyOrValue;
+typedef KeyOrValue KEY_T;
+
+//
+// Typed keys
+//
+// An index can declare what its keys are made of: a tuple of one or
+// more fields, each an unsigned or signed 32 or 64 bit integer or a
+// string of up to a fixed number of bytes.  Each field is stored in a
+// fixed number of bytes, encoded so that comparing the bytes with
+// memcmp orders keys as their values are ordered:
+//
+//   u32, u64   big endian
+//   i32, i64   big endian with the sign bit flipped, so negative
+//              numbers come before positive ones
+//   strN       the string's bytes, padded with zeros to N bytes, so a
+//              string comes before the ones it is a prefix of
+//
+// and a tuple is its fields one after another, so it sorts by its
+// first field, then by its second, and so on.  Nothing in the index
+// has to know the types: every node format and search works on the
+// encoded keys as they are, and a key type only fixes how keys are
+// turned from and into text.  Integers become much shorter keys than
+// their zero padded decimal strings, and the first four bytes of a key
+// (its prefix, see keycompare.h) then usually decide a comparison.
+//
+// A key type is written as its fields separated by commas, e.g.
+// "u32,str12,i64", and a key as its field values separated by commas,
+// e.g. "7,alice,-3".  The last field of a key takes the rest of the
+// text, commas and all.  An untyped index (no fields) takes keys as
+// raw bytes, as before.
+//
+#define KEY_FIELD_UINT32 1
+#define KEY_FIELD_INT32  2
+#define KEY_FIELD_UINT64 3
+#define KEY_FIELD_INT64  4
+#define KEY_FIELD_STRING 5
+
+struct KeyField {
+  SIZE_T type;
+  SIZE_T length;  // bytes in the key
+};
+
+
+class KeyType {
+private:
+  vector<KeyField> fields;
+
+public:
+  KeyType() {}
+
+  // return ERROR_BADCONFIG if spec is not a key type
+  ERROR_T Parse(const string &spec);
+
+  bool   IsTyped() const { return !fields.empty(); }
+  SIZE_T GetNumFields() const { return fields.size(); }
+  const KeyField &GetField(const SIZE_T i) const { return fields[i]; }
+  SIZE_T GetKeySize() const;
+
+  // return ERROR_SIZE if text does not have the right fields or a
+  // value does not fit its field
+  ERROR_T Encode(const string &text, KEY_T &key) const;
+  // Missing bytes at the end of key are taken to be zeros
+  ERROR_T Decode(const KEY_T &key, string &text) const;
+
+  // In a superblock: one word per field
+  SIZE_T  GetStoredSize() const { return fields.size()*sizeof(SIZE_T); }
+  void    Store(BYTE_T *p) const;
+  // return ERROR_NOTANINDEX if the words are not a key type
+  ERROR_T Load(const BYTE_T *p, const SIZE_T numfields);
+
+  ostream & Print(ostream &os) const;
+};
+
+inline ostream & operator<<(ostream &os, const KeyType &k) { return k.Print(os); }
+
+#endif
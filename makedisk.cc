@@ -6,27 +6,39 @@
 
 void usage() 
 {
-  cerr << "usage: makedisk filestem blocks blocksize heads blockspertrack tracks avgseek trackseek rotlat\n";
+  cerr << "usage: makedisk filestem blocks blocksize heads blockspertrack tracks avgseek trackseek rotlat [numdisks stripeunit [sectorsize [segmentsize]]]\n";
+  cerr << "       with numdisks>1, the geometry describes each member of a striped disk\n";
+  cerr << "       with sectorsize>0, blocks are stored compressed in units of sectorsize bytes\n";
+  cerr << "       with segmentsize>0, the disk is log structured with segments of segmentsize blocks\n";
 }
 
 int main(int argc, char *argv[])
 {
-  if (argc<10) { 
+  if (argc!=10 && (argc<12 || argc>14)) { 
     usage();
     exit(-1);
   }
 
+  SIZE_T numdisks = argc>=12 ? atoi(argv[10]) : 1;
+  SIZE_T stripeunit = argc>=12 ? atoi(argv[11]) : 1;
+  SIZE_T sectorsize = argc>=13 ? atoi(argv[12]) : 0;
+  SIZE_T segmentsize = argc==14 ? atoi(argv[13]) : 0;
+
   DiskSystem disk(argv[1],
 		  true,
 		  0,
-		  atoi(argv[2]),
+		  strtoull(argv[2],0,0),
 		  atoi(argv[3]),
 		  atoi(argv[4]),
 		  atoi(argv[5]),
-		  atoi(argv[6]),
+		  strtoull(argv[6],0,0),
 		  atof(argv[7]),
 		  atof(argv[8]),
-		  atof(argv[9]));
+		  atof(argv[9]),
+		  numdisks,
+		  stripeunit,
+		  sectorsize,
+		  segmentsize);
   
   
   cerr << "Disk is as follows.\n" << disk << "\n";
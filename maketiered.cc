@@ -0,0 +1,34 @@
+#include <string>
+#include <stdlib.h>
+
+#include "disksystem.h"
+
+
+void usage() 
+{
+  cerr << "usage: maketiered filestem faststem slowstem\n";
+  cerr << "       faststem and slowstem are existing disks made with makedisk\n";
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc!=4) { 
+    usage();
+    exit(-1);
+  }
+
+  ERROR_T rc = DiskSystem::CreateTiered(argv[1],argv[2],argv[3]);
+
+  if (rc!=ERROR_NOERROR) { 
+    cerr << "Error "<< rc << " occured.\n";
+    return -1;
+  }
+
+  DiskSystem disk(argv[1]);
+  
+  cerr << "Disk is as follows.\n" << disk << "\n";
+
+  cerr << "Done.\n";
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "btree.h"
+#include "benchutil.h"
+
+using namespace std;
+
+
+void usage()
+{
+  cerr << "usage: nodebench filestem [numkeys [lookups [format [valuesize]]]]\n";
+  cerr << "       times lookups in btrees of 8 byte keys and values at a range of\n";
+  cerr << "       block sizes (fanouts), and binary against linear search of one node.\n";
+  cerr << "       filestem is made and deleted for each block size.\n";
+  cerr << "       numkeys defaults to 20000, lookups to 200000, and format (the\n";
+  cerr << "       on-disk format version of the nodes) to "<<BTREE_FORMAT_DEFAULT<<", and\n";
+  cerr << "       valuesize to 8\n";
+}
+
+
+// The search the nodes did before, kept to compare against
+static SIZE_T LinearLowerBound(const BTreeNode &node, const KeyView &k)
+{
+  SIZE_T offset;
+
+  for (offset=0;offset<node.info.numkeys;offset++) {
+    if (node.CompareKey(offset,k)>=0) {
+      break;
+    }
+  }
+  return offset;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<2 || argc>6) {
+    usage();
+    exit(-1);
+  }
+
+  string stem(argv[1]);
+  SIZE_T numkeys = argc>=3 ? atoi(argv[2]) : 20000;
+  SIZE_T lookups = argc>=4 ? atoi(argv[3]) : 200000;
+  SIZE_T format = argc>=5 ? atoi(argv[4]) : BTREE_FORMAT_DEFAULT;
+  SIZE_T valuesize = argc>=6 ? atoi(argv[5]) : 8;
+  SIZE_T sizes[] = {512, 1024, 2048, 4096, 8192, 16384};
+  SIZE_T keysize=8, blockspertrack=64;
+  SIZE_T sink=0;
+  char buf[32];
+
+  if (numkeys==0 || lookups==0 || format<BTREE_FORMAT_V1 || format>BTREE_FORMAT_CURRENT ||
+      valuesize<8 || valuesize>4096) {
+    usage();
+    exit(-1);
+  }
+
+  srandom(1);
+
+  vector<KEY_T> keys;
+  for (SIZE_T i=0;i<numkeys;i++) {
+    snprintf(buf,sizeof(buf),"%08ld",random()%100000000);
+    keys.push_back(KEY_T(buf));
+  }
+
+  cout << numkeys << " keys in format "<<format<<" with "<<valuesize<<" byte values,\n";
+  cout << "CPU ns per lookup with every block cached,\n";
+  cout << "and per search of a full leaf\n";
+  cout << setw(10) << "blocksize" << setw(8) << "fanout" << setw(10) << "lookup"
+       << setw(10) << "linear" << setw(10) << "binary" << "\n";
+
+  for (SIZE_T s=0;s<sizeof(sizes)/sizeof(sizes[0]);s++) {
+    SIZE_T blocksize=sizes[s];
+    ERROR_T rc;
+
+    if (blocksize<4*(keysize+valuesize)) {
+      // too few keys to a leaf to be worth timing
+      continue;
+    }
+
+    // room for the tree with its nodes half full, and then some
+    BLOCKNUM_T numblocks = 4*numkeys*(keysize+valuesize)/blocksize + 4*blockspertrack;
+    numblocks -= numblocks%blockspertrack;
+
+    deletedisk(stem);
+
+    double lookupns;
+    {
+      DiskSystem disk(stem,true,0,numblocks,blocksize,1,blockspertrack,
+		      numblocks/blockspertrack,1,1,1);
+      BufferCache cache(&disk,numblocks);
+      BTreeIndex btree(keysize,valuesize,&cache,true,format);
+
+      cache.Attach();
+      if ((rc=btree.Attach(0,true))) {
+	cerr << "nodebench: cannot make a btree, error "<<rc<<"\n";
+	return -1;
+      }
+
+      for (SIZE_T i=0;i<numkeys;i++) {
+	VALUE_T value;
+	value.Resize(valuesize);
+	snprintf(buf,sizeof(buf),"%08ld",(long)i);
+	memcpy(value.data,buf,8);
+	rc=btree.Insert(keys[i],value);
+	if (rc && rc!=ERROR_INSANE) {  // ERROR_INSANE is a repeated key
+	  cerr << "nodebench: insert failed, error "<<rc<<"\n";
+	  return -1;
+	}
+      }
+
+      VALUE_T value;
+      double start=cpunow();
+      for (SIZE_T i=0;i<lookups;i++) {
+	if (btree.Lookup(keys[(i*7919)%numkeys],value)) {
+	  cerr << "nodebench: lookup failed\n";
+	  return -1;
+	}
+	sink+=value.data[7];
+      }
+      lookupns=(cpunow()-start)/lookups;
+
+      BLOCKNUM_T superblock;
+      btree.Detach(superblock);
+      cache.Detach();
+    }
+    deletedisk(stem);
+
+    // One leaf filled with keys spread evenly over the key space, and
+    // searched for keys that are and are not in it
+    BTreeNode leaf(BTREE_LEAF_NODE,keysize,valuesize,blocksize,format);
+    SIZE_T fanout=leaf.info.GetNumSlotsAsLeaf();
+    long spacing=100000000/(fanout+1);
+
+    leaf.info.numkeys=fanout;
+    for (SIZE_T i=0;i<fanout;i++) {
+      snprintf(buf,sizeof(buf),"%08ld",(long)(i+1)*spacing);
+      leaf.SetKey(i,KEY_T(buf));
+    }
+
+    vector<KEY_T> probes;
+    for (SIZE_T i=0;i<256;i++) {
+      long k = random()%(fanout+1)*spacing;
+      snprintf(buf,sizeof(buf),"%08ld",i%2 ? k : k+random()%spacing);
+      probes.push_back(KEY_T(buf));
+    }
+
+    for (SIZE_T i=0;i<probes.size();i++) {
+      if (leaf.LowerBound(probes[i])!=LinearLowerBound(leaf,probes[i])) {
+	cerr << "nodebench: binary and linear search disagree\n";
+	return -1;
+      }
+    }
+
+    double start=cpunow();
+    for (SIZE_T i=0;i<lookups;i++) {
+      sink+=LinearLowerBound(leaf,probes[i%probes.size()]);
+    }
+    double linearns=(cpunow()-start)/lookups;
+
+    start=cpunow();
+    for (SIZE_T i=0;i<lookups;i++) {
+      sink+=leaf.LowerBound(probes[i%probes.size()]);
+    }
+    double binaryns=(cpunow()-start)/lookups;
+
+    cout << setw(10) << blocksize << setw(8) << fanout
+	 << fixed << setprecision(1)
+	 << setw(10) << lookupns << setw(10) << linearns << setw(10) << binaryns << "\n";
+  }
+
+  return sink==0x7fffffff;
+}
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "btree.h"
+#include "benchutil.h"
+
+using namespace std;
+
+
+void usage()
+{
+  cerr << "usage: packbench filestem [numkeys [lookups [cachesize [gap]]]]\n";
+  cerr << "       builds the same btree in formats "<<BTREE_FORMAT_V1<<", "<<BTREE_FORMAT_V4<<", "
+       << BTREE_FORMAT_V6<<" and "<<BTREE_FORMAT_V7<<", of 8 byte integer\n";
+  cerr << "       keys (big endian, as a u64 key type makes them) and 8 byte values, once\n";
+  cerr << "       with dense keys, IDs gap apart from a large starting ID, and once with\n";
+  cerr << "       keys spread over all 64 bit integers, both inserted in random order.\n";
+  cerr << "       Reports the height, the leaves and keys per leaf, the interior nodes,\n";
+  cerr << "       the disk reads to build it and to look keys up through a cache of\n";
+  cerr << "       cachesize blocks, and CPU time per lookup.  filestem is made and\n";
+  cerr << "       deleted for each.  numkeys defaults to 200000, lookups to 100000,\n";
+  cerr << "       cachesize to 64, gap to 1\n";
+}
+
+
+static void MakeKey(const unsigned long long k, KEY_T &key)
+{
+  key.Resize(8,false);
+  for (SIZE_T j=0;j<8;j++) {
+    key.data[j]=(BYTE_T)(k>>(56-8*j));
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<2 || argc>6) {
+    usage();
+    exit(-1);
+  }
+
+  string stem(argv[1]);
+  SIZE_T numkeys = argc>=3 ? atoi(argv[2]) : 200000;
+  SIZE_T lookups = argc>=4 ? atoi(argv[3]) : 100000;
+  SIZE_T cachesize = argc>=5 ? atoi(argv[4]) : 64;
+  SIZE_T gap = argc>=6 ? atoi(argv[5]) : 1;
+  SIZE_T keysize=8, valuesize=8, blocksize=4096, blockspertrack=64;
+  SIZE_T formats[] = {BTREE_FORMAT_V1, BTREE_FORMAT_V4, BTREE_FORMAT_V6, BTREE_FORMAT_V7};
+
+  if (numkeys==0 || lookups==0 || cachesize<8 || gap==0) {
+    usage();
+    exit(-1);
+  }
+
+  // every key once, in random order
+  vector<SIZE_T> order(numkeys);
+  for (SIZE_T i=0;i<numkeys;i++) {
+    order[i]=i;
+  }
+  srandom(1);
+  for (SIZE_T i=numkeys-1;i>0;i--) {
+    SIZE_T j=random()%(i+1);
+    SIZE_T t=order[i]; order[i]=order[j]; order[j]=t;
+  }
+
+  cout << numkeys << " keys of "<<keysize<<" bytes, "<<valuesize<<" byte values, "
+       << blocksize<<" byte blocks, " << cachesize << " block cache\n";
+  cout << "leaves and keys per leaf, interior nodes, disk reads to insert every key\n";
+  cout << "and to look up "<<lookups<<", and CPU ns per lookup\n";
+  cout << setw(7) << "keys" << setw(7) << "format" << setw(7) << "height"
+       << setw(8) << "leaves" << setw(7) << "keys" << setw(10) << "interior"
+       << setw(10) << "build" << setw(10) << "lookup" << setw(10) << "ns" << "\n";
+
+  for (int dense=1;dense>=0;dense--) {
+    for (SIZE_T f=0;f<sizeof(formats)/sizeof(formats[0]);f++) {
+      SIZE_T format=formats[f];
+      ERROR_T rc;
+      KEY_T key;
+      VALUE_T value;
+      TreeShape shape;
+      SIZE_T buildreads, lookupreads;
+      double lookupns;
+
+      // Dense keys start far from 0, so they share no leading zero
+      // bytes; spread keys are a permutation of the integers
+      vector<unsigned long long> keys(numkeys);
+      for (SIZE_T i=0;i<numkeys;i++) {
+	keys[i] = dense ? 4000000000000ull+i*gap : (i+1)*0x9e3779b97f4a7c15ull;
+      }
+
+      // room for the tree with its nodes half full, and then some
+      BLOCKNUM_T numblocks = 4*numkeys*(keysize+valuesize)/blocksize + 4*blockspertrack;
+      numblocks -= numblocks%blockspertrack;
+
+      deletedisk(stem);
+      {
+	DiskSystem disk(stem,true,0,numblocks,blocksize,1,blockspertrack,
+			numblocks/blockspertrack,1,1,1);
+	BufferCache cache(&disk,cachesize);
+	BTreeIndex btree(keysize,valuesize,&cache,true,format);
+
+	cache.Attach();
+	if ((rc=btree.Attach(0,true))) {
+	  cerr << "packbench: cannot make a btree, error "<<rc<<"\n";
+	  return -1;
+	}
+
+	SIZE_T start=cache.GetNumDiskReads();
+	for (SIZE_T i=0;i<numkeys;i++) {
+	  unsigned long long v=order[i];
+	  MakeKey(keys[order[i]],key);
+	  value.Resize(valuesize,false);
+	  memcpy(value.data,&v,valuesize);
+	  if ((rc=btree.Insert(key,value))) {
+	    cerr << "packbench: insert failed, error "<<rc<<"\n";
+	    return -1;
+	  }
+	}
+	buildreads=cache.GetNumDiskReads()-start;
+
+	start=cache.GetNumDiskReads();
+	double t0=cpunow();
+	for (SIZE_T i=0;i<lookups;i++) {
+	  MakeKey(keys[order[(i*7919)%numkeys]],key);
+	  if (btree.Lookup(key,value)) {
+	    cerr << "packbench: lookup failed\n";
+	    return -1;
+	  }
+	}
+	lookupns=(cpunow()-t0)/lookups;
+	lookupreads=cache.GetNumDiskReads()-start;
+
+	if ((rc=btree.SanityCheck())) {
+	  cerr << "packbench: btree is not sane, error "<<rc<<"\n";
+	  return -1;
+	}
+
+	BLOCKNUM_T superblock;
+	btree.Detach(superblock);
+
+	BTreeNode super;
+	if ((rc=super.Unserialize(&cache,0)) || (rc=WalkTree(&cache,super.info.rootnode,1,shape))) {
+	  cerr << "packbench: cannot walk the btree, error "<<rc<<"\n";
+	  return -1;
+	}
+	cache.Detach();
+      }
+      deletedisk(stem);
+
+      cout << setw(7) << (dense ? "dense" : "spread") << setw(7) << format << setw(7) << shape.height
+	   << fixed << setprecision(1)
+	   << setw(8) << shape.leaves
+	   << setw(7) << (double)shape.leafkeys/shape.leaves
+	   << setw(10) << shape.interiors
+	   << setw(10) << buildreads << setw(10) << lookupreads
+	   << setw(10) << lookupns << "\n";
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "btree.h"
+#include "benchutil.h"
+
+using namespace std;
+
+
+void usage()
+{
+  cerr << "usage: prefixbench filestem [numkeys [lookups [cachesize [keysize]]]]\n";
+  cerr << "       builds the same btree in each node format, of keys that share long\n";
+  cerr << "       prefixes (a tenant, a date, then a serial number, in 32 bytes, then\n";
+  cerr << "       filler up to keysize), and reports the slots and keys per node, the\n";
+  cerr << "       height, and the disk reads\n";
+  cerr << "       to build it and to look keys up through a cache of cachesize blocks.\n";
+  cerr << "       filestem is made and deleted for each format.\n";
+  cerr << "       numkeys defaults to 100000, lookups to 100000, cachesize to 64,\n";
+  cerr << "       keysize to 32\n";
+}
+
+
+// The filler differs from key to key but never decides an order
+static void MakeKey(const SIZE_T i, const SIZE_T keysize, KEY_T &key)
+{
+  char buf[40];
+
+  snprintf(buf,sizeof(buf),"t%04u/2026-10-%02u/%015u",
+	   (unsigned)(i%8),(unsigned)(1+(i/8)%28),(unsigned)i);
+  key.Resize(keysize,false);
+  memcpy(key.data,buf,32);
+  for (SIZE_T j=32;j<keysize;j++) {
+    key.data[j]='a'+(i*31+j*7)%26;
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<2 || argc>6) {
+    usage();
+    exit(-1);
+  }
+
+  string stem(argv[1]);
+  SIZE_T numkeys = argc>=3 ? atoi(argv[2]) : 100000;
+  SIZE_T lookups = argc>=4 ? atoi(argv[3]) : 100000;
+  SIZE_T cachesize = argc>=5 ? atoi(argv[4]) : 64;
+  SIZE_T keysize = argc>=6 ? atoi(argv[5]) : 32;
+  SIZE_T valuesize=8, blocksize=4096, blockspertrack=64;
+
+  if (numkeys==0 || lookups==0 || cachesize<8 || keysize<32 || keysize>1024) {
+    usage();
+    exit(-1);
+  }
+
+  // every key once, in random order
+  vector<SIZE_T> order(numkeys);
+  for (SIZE_T i=0;i<numkeys;i++) {
+    order[i]=i;
+  }
+  srandom(1);
+  for (SIZE_T i=numkeys-1;i>0;i--) {
+    SIZE_T j=random()%(i+1);
+    SIZE_T t=order[i]; order[i]=order[j]; order[j]=t;
+  }
+
+  cout << numkeys << " keys of "<<keysize<<" bytes, "<<blocksize<<" byte blocks, "
+       << cachesize << " block cache\n";
+  cout << "per leaf and interior node, average slots, keys, and bytes kept once,\n";
+  cout << "and disk reads to insert every key and to look up "<<lookups<<"\n";
+  cout << setw(7) << "format" << setw(7) << "height"
+       << setw(8) << "leaves" << setw(7) << "slots" << setw(7) << "keys" << setw(7) << "common"
+       << setw(10) << "interior" << setw(7) << "slots" << setw(7) << "keys"
+       << setw(10) << "build" << setw(10) << "lookup" << "\n";
+
+  // not format 7, whose keys are integers of up to 8 bytes
+  for (SIZE_T format=BTREE_FORMAT_V1;format<=BTREE_FORMAT_V6;format++) {
+    ERROR_T rc;
+    KEY_T key;
+    VALUE_T value;
+    TreeShape shape;
+    SIZE_T buildreads, lookupreads;
+
+    // room for the tree with its nodes half full, and then some
+    BLOCKNUM_T numblocks = 4*numkeys*(keysize+valuesize)/blocksize + 4*blockspertrack;
+    numblocks -= numblocks%blockspertrack;
+
+    deletedisk(stem);
+    {
+      DiskSystem disk(stem,true,0,numblocks,blocksize,1,blockspertrack,
+		      numblocks/blockspertrack,1,1,1);
+      BufferCache cache(&disk,cachesize);
+      BTreeIndex btree(keysize,valuesize,&cache,true,format);
+
+      cache.Attach();
+      if ((rc=btree.Attach(0,true))) {
+	cerr << "prefixbench: cannot make a btree, error "<<rc<<"\n";
+	return -1;
+      }
+
+      SIZE_T start=cache.GetNumDiskReads();
+      for (SIZE_T i=0;i<numkeys;i++) {
+	MakeKey(order[i],keysize,key);
+	value=VALUE_T("value");
+	if ((rc=btree.Insert(key,value))) {
+	  cerr << "prefixbench: insert failed, error "<<rc<<"\n";
+	  return -1;
+	}
+      }
+      buildreads=cache.GetNumDiskReads()-start;
+
+      start=cache.GetNumDiskReads();
+      for (SIZE_T i=0;i<lookups;i++) {
+	MakeKey(order[(i*7919)%numkeys],keysize,key);
+	if (btree.Lookup(key,value)) {
+	  cerr << "prefixbench: lookup failed\n";
+	  return -1;
+	}
+      }
+      lookupreads=cache.GetNumDiskReads()-start;
+
+      BLOCKNUM_T superblock;
+      btree.Detach(superblock);
+
+      BTreeNode super;
+      if ((rc=super.Unserialize(&cache,0)) || (rc=WalkTree(&cache,super.info.rootnode,1,shape))) {
+	cerr << "prefixbench: cannot walk the btree, error "<<rc<<"\n";
+	return -1;
+      }
+      cache.Detach();
+    }
+    deletedisk(stem);
+
+    cout << setw(7) << format << setw(7) << shape.height
+	 << fixed << setprecision(1)
+	 << setw(8) << shape.leaves
+	 << setw(7) << (double)shape.leafslots/shape.leaves
+	 << setw(7) << (double)shape.leafkeys/shape.leaves
+	 << setw(7) << (double)shape.leafcommon/shape.leaves
+	 << setw(10) << shape.interiors
+	 << setw(7) << (double)shape.interiorslots/shape.interiors
+	 << setw(7) << (double)shape.interiorkeys/shape.interiors
+	 << setw(10) << buildreads << setw(10) << lookupreads << "\n";
+  }
+
+  return 0;
+}
@@ -15,7 +15,7 @@ int main(int argc, char *argv[])
     usage();
     exit(-1);
   }
-  SIZE_T blocknum=atoi(argv[2]);
+  BLOCKNUM_T blocknum=strtoull(argv[2],0,0);
   SIZE_T numblocks=atoi(argv[3]);
   double reqtime;
 
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "btree.h"
+#include "benchutil.h"
+
+using namespace std;
+
+
+void usage()
+{
+  cerr << "usage: recordbench filestem [numkeys [lookups [cachesize [keysize [valuesize]]]]]\n";
+  cerr << "       builds the same btree in each node format, of keys and values of\n";
+  cerr << "       mixed lengths (keys of 12 bytes up to keysize, values of up to\n";
+  cerr << "       valuesize), and reports the leaves and keys per leaf, the height,\n";
+  cerr << "       the blocks used, and the disk reads to build it and to look keys\n";
+  cerr << "       up through a cache of cachesize blocks.  Formats other than 5\n";
+  cerr << "       keep every key and value at full size, so they get them padded\n";
+  cerr << "       with zeros.  filestem is made and deleted for each format.\n";
+  cerr << "       numkeys defaults to 100000, lookups to 100000, cachesize to 64,\n";
+  cerr << "       keysize to 64, valuesize to 256\n";
+}
+
+
+// A scrambled serial number that keeps the keys apart, then filler to
+// a length of the key's own.  Padded is the key a format that keeps
+// keys at full size gets.
+static void MakeKey(const SIZE_T i, const SIZE_T keysize, const bool padded, KEY_T &key)
+{
+  char buf[16];
+  SIZE_T length=12+(i*2654435761u)%(keysize-11);
+
+  snprintf(buf,sizeof(buf),"%08x/",(unsigned)(i*2654435761u));
+  key.Resize(padded ? keysize : length,false);
+  memset(key.data,0,key.length);
+  memcpy(key.data,buf,9);
+  for (SIZE_T j=9;j<length;j++) {
+    key.data[j]='a'+(i*31+j*7)%26;
+  }
+}
+
+
+static void MakeValue(const SIZE_T i, const SIZE_T valuesize, const bool padded, VALUE_T &value)
+{
+  SIZE_T length=(i*40503u)%(valuesize+1);
+
+  value.Resize(padded ? valuesize : length,false);
+  memset(value.data,0,value.length);
+  for (SIZE_T j=0;j<length;j++) {
+    value.data[j]='A'+(i+j)%26;
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<2 || argc>7) {
+    usage();
+    exit(-1);
+  }
+
+  string stem(argv[1]);
+  SIZE_T numkeys = argc>=3 ? atoi(argv[2]) : 100000;
+  SIZE_T lookups = argc>=4 ? atoi(argv[3]) : 100000;
+  SIZE_T cachesize = argc>=5 ? atoi(argv[4]) : 64;
+  SIZE_T keysize = argc>=6 ? atoi(argv[5]) : 64;
+  SIZE_T valuesize = argc>=7 ? atoi(argv[6]) : 256;
+  SIZE_T blocksize=4096, blockspertrack=64;
+
+  if (numkeys==0 || lookups==0 || cachesize<8 || keysize<16 || keysize>512 || valuesize>1024) {
+    usage();
+    exit(-1);
+  }
+
+  // every key once, in random order
+  vector<SIZE_T> order(numkeys);
+  for (SIZE_T i=0;i<numkeys;i++) {
+    order[i]=i;
+  }
+  srandom(1);
+  for (SIZE_T i=numkeys-1;i>0;i--) {
+    SIZE_T j=random()%(i+1);
+    SIZE_T t=order[i]; order[i]=order[j]; order[j]=t;
+  }
+
+  cout << numkeys << " keys of up to "<<keysize<<" bytes with values of up to "<<valuesize
+       << " bytes, "<<blocksize<<" byte blocks, " << cachesize << " block cache\n";
+  cout << "leaves and keys per leaf, blocks in the tree, and disk reads to insert\n";
+  cout << "every key and to look up "<<lookups<<"\n";
+  cout << setw(7) << "format" << setw(7) << "height"
+       << setw(8) << "leaves" << setw(7) << "keys"
+       << setw(10) << "interior" << setw(8) << "blocks"
+       << setw(10) << "build" << setw(10) << "lookup" << "\n";
+
+  // not format 7, whose keys are integers of up to 8 bytes
+  for (SIZE_T format=BTREE_FORMAT_V1;format<=BTREE_FORMAT_V6;format++) {
+    ERROR_T rc;
+    KEY_T key;
+    VALUE_T value;
+    TreeShape shape;
+    SIZE_T buildreads, lookupreads;
+    bool padded = format!=BTREE_FORMAT_V5;
+
+    // room for the tree with its nodes half full, and then some
+    BLOCKNUM_T numblocks = 4*numkeys*(keysize+valuesize)/blocksize + 4*blockspertrack;
+    numblocks -= numblocks%blockspertrack;
+
+    deletedisk(stem);
+    {
+      DiskSystem disk(stem,true,0,numblocks,blocksize,1,blockspertrack,
+		      numblocks/blockspertrack,1,1,1);
+      BufferCache cache(&disk,cachesize);
+      BTreeIndex btree(keysize,valuesize,&cache,true,format);
+
+      cache.Attach();
+      if ((rc=btree.Attach(0,true))) {
+	cerr << "recordbench: cannot make a btree, error "<<rc<<"\n";
+	return -1;
+      }
+
+      SIZE_T start=cache.GetNumDiskReads();
+      for (SIZE_T i=0;i<numkeys;i++) {
+	MakeKey(order[i],keysize,padded,key);
+	MakeValue(order[i],valuesize,padded,value);
+	if ((rc=btree.Insert(key,value))) {
+	  cerr << "recordbench: insert failed, error "<<rc<<"\n";
+	  return -1;
+	}
+      }
+      buildreads=cache.GetNumDiskReads()-start;
+
+      start=cache.GetNumDiskReads();
+      for (SIZE_T i=0;i<lookups;i++) {
+	MakeKey(order[(i*7919)%numkeys],keysize,padded,key);
+	if (btree.Lookup(key,value)) {
+	  cerr << "recordbench: lookup failed\n";
+	  return -1;
+	}
+      }
+      lookupreads=cache.GetNumDiskReads()-start;
+
+      BLOCKNUM_T superblock;
+      btree.Detach(superblock);
+
+      BTreeNode super;
+      if ((rc=super.Unserialize(&cache,0)) || (rc=WalkTree(&cache,super.info.rootnode,1,shape))) {
+	cerr << "recordbench: cannot walk the btree, error "<<rc<<"\n";
+	return -1;
+      }
+      cache.Detach();
+    }
+    deletedisk(stem);
+
+    cout << setw(7) << format << setw(7) << shape.height
+	 << setw(8) << shape.leaves
+	 << fixed << setprecision(1)
+	 << setw(7) << (double)shape.leafkeys/shape.leaves
+	 << setw(10) << shape.interiors
+	 << setw(8) << shape.leaves+shape.interiors
+	 << setw(10) << buildreads << setw(10) << lookupreads << "\n";
+  }
+
+  return 0;
+}
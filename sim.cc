@@ -27,7 +27,7 @@ int main(int argc, char *argv[])
 
   char *filestem=argv[1];
   SIZE_T cachesize=atoi(argv[2]);
-  SIZE_T superblocknum;
+  BLOCKNUM_T superblocknum;
 
   FILE *file; 
   char line[1024];
@@ -0,0 +1,244 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "btree.h"
+#include "benchutil.h"
+#include "btree_static.h"
+
+using namespace std;
+
+
+void usage()
+{
+  cerr << "usage: staticbench filestem [numkeys [lookups [cachesize]]]\n";
+  cerr << "       times inserts and lookups of 8 byte keys and values in 4096 byte\n";
+  cerr << "       blocks, in a BTreeIndex in formats "<<BTREE_FORMAT_V1<<" and "<<BTREE_FORMAT_V6
+       << " and in StaticBTreeIndex\n";
+  cerr << "       (btree_static.h) with the keys as integers and as FixedKey<8>.\n";
+  cerr << "       The keys sort the same way in all of them.  filestem is made and\n";
+  cerr << "       deleted for each.  numkeys defaults to 100000, lookups to 400000,\n";
+  cerr << "       and cachesize to 2048 blocks, which holds the whole tree\n";
+}
+
+
+// Distinct keys in no particular order: multiplying by an odd number
+// permutes the 64 bit integers
+static unsigned long long MakeKey(const SIZE_T i)
+{
+  return (i+1)*0x9e3779b97f4a7c15ull;
+}
+
+
+// The key's bytes, big endian, so that they sort as the integer does
+static void KeyBytes(const unsigned long long k, BYTE_T *bytes)
+{
+  for (SIZE_T j=0;j<8;j++) {
+    bytes[j]=(BYTE_T)(k>>(56-8*j));
+  }
+}
+
+
+struct Result {
+  double insertns, lookupns;
+  SIZE_T lookupreads;
+};
+
+
+class Disk {
+public:
+  DiskSystem  disk;
+  BufferCache cache;
+
+  Disk(const string &stem, const BLOCKNUM_T numblocks, const SIZE_T cachesize)
+    : disk(stem,true,0,numblocks,4096,1,64,numblocks/64,1,1,1), cache(&disk,cachesize) {
+    cache.Attach();
+  }
+  ~Disk() { cache.Detach(); }
+};
+
+
+static ERROR_T RunDynamic(const string &stem, const BLOCKNUM_T numblocks, const SIZE_T cachesize,
+			  const SIZE_T format, const SIZE_T numkeys, const SIZE_T lookups, Result &r)
+{
+  ERROR_T rc;
+  KEY_T key;
+  VALUE_T value, found;
+  double start;
+
+  deletedisk(stem);
+  Disk d(stem,numblocks,cachesize);
+  BTreeIndex btree(8,8,&d.cache,true,format);
+
+  if ((rc=btree.Attach(0,true))) {
+    return rc;
+  }
+  key.Resize(8,false);
+  value.Resize(8,false);
+
+  start=cpunow();
+  for (SIZE_T i=0;i<numkeys;i++) {
+    unsigned long long v=i;
+    KeyBytes(MakeKey(i),key.data);
+    memcpy(value.data,&v,8);
+    if ((rc=btree.Insert(key,value))) {
+      return rc;
+    }
+  }
+  r.insertns=(cpunow()-start)/numkeys;
+
+  SIZE_T reads=d.cache.GetNumDiskReads();
+  start=cpunow();
+  for (SIZE_T i=0;i<lookups;i++) {
+    SIZE_T k=(i*7919)%numkeys;
+    unsigned long long v;
+    KeyBytes(MakeKey(k),key.data);
+    if ((rc=btree.Lookup(key,found))) {
+      return rc;
+    }
+    memcpy(&v,found.data,8);
+    if (v!=k) {
+      return ERROR_INSANE;
+    }
+  }
+  r.lookupns=(cpunow()-start)/lookups;
+  r.lookupreads=d.cache.GetNumDiskReads()-reads;
+
+  if ((rc=btree.SanityCheck())) {
+    return rc;
+  }
+  BLOCKNUM_T superblock;
+  return btree.Detach(superblock);
+}
+
+
+// KEYOF makes the static index's key from the integer
+template <typename KEY>
+static ERROR_T RunStatic(const string &stem, const BLOCKNUM_T numblocks, const SIZE_T cachesize,
+			 KEY (*keyof)(unsigned long long),
+			 const SIZE_T numkeys, const SIZE_T lookups, Result &r)
+{
+  ERROR_T rc;
+  double start;
+
+  deletedisk(stem);
+  Disk d(stem,numblocks,cachesize);
+  StaticBTreeIndex<KEY,unsigned long long,4096> btree(&d.cache);
+
+  if ((rc=btree.Attach(0,true))) {
+    return rc;
+  }
+
+  start=cpunow();
+  for (SIZE_T i=0;i<numkeys;i++) {
+    if ((rc=btree.Insert(keyof(MakeKey(i)),i))) {
+      return rc;
+    }
+  }
+  r.insertns=(cpunow()-start)/numkeys;
+
+  SIZE_T reads=d.cache.GetNumDiskReads();
+  start=cpunow();
+  for (SIZE_T i=0;i<lookups;i++) {
+    SIZE_T k=(i*7919)%numkeys;
+    unsigned long long v;
+    if ((rc=btree.Lookup(keyof(MakeKey(k)),v))) {
+      return rc;
+    }
+    if (v!=k) {
+      return ERROR_INSANE;
+    }
+  }
+  r.lookupns=(cpunow()-start)/lookups;
+  r.lookupreads=d.cache.GetNumDiskReads()-reads;
+
+  if ((rc=btree.SanityCheck())) {
+    return rc;
+  }
+  BLOCKNUM_T superblock;
+  return btree.Detach(superblock);
+}
+
+
+static unsigned long long IntegerKey(unsigned long long k)
+{
+  return k;
+}
+
+
+static FixedKey<8> BytesKey(unsigned long long k)
+{
+  FixedKey<8> key;
+  KeyBytes(k,key.bytes);
+  return key;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<2 || argc>5) {
+    usage();
+    exit(-1);
+  }
+
+  string stem(argv[1]);
+  SIZE_T numkeys = argc>=3 ? atoi(argv[2]) : 100000;
+  SIZE_T lookups = argc>=4 ? atoi(argv[3]) : 400000;
+  SIZE_T cachesize = argc>=5 ? atoi(argv[4]) : 2048;
+
+  if (numkeys==0 || lookups==0 || cachesize<8) {
+    usage();
+    exit(-1);
+  }
+
+  // room for the tree with its nodes half full, and then some
+  BLOCKNUM_T numblocks = 4*numkeys*16/4096 + 4*64;
+  numblocks -= numblocks%64;
+
+  cout << numkeys << " keys, 8 byte keys and values, 4096 byte blocks, "
+       << cachesize << " block cache\n";
+  cout << "CPU time per insert and per lookup, and disk reads for "<<lookups<<" lookups\n";
+  cout << setw(20) << "index" << setw(12) << "insert ns" << setw(12) << "lookup ns"
+       << setw(10) << "reads" << "\n";
+
+  for (SIZE_T run=0;run<4;run++) {
+    Result r;
+    ERROR_T rc;
+    string name;
+
+    switch (run) {
+    case 0:
+      name="format 1";
+      rc=RunDynamic(stem,numblocks,cachesize,BTREE_FORMAT_V1,numkeys,lookups,r);
+      break;
+    case 1:
+      name="format 6";
+      rc=RunDynamic(stem,numblocks,cachesize,BTREE_FORMAT_V6,numkeys,lookups,r);
+      break;
+    case 2:
+      name="static integer";
+      rc=RunStatic(stem,numblocks,cachesize,IntegerKey,numkeys,lookups,r);
+      break;
+    default:
+      name="static FixedKey<8>";
+      rc=RunStatic(stem,numblocks,cachesize,BytesKey,numkeys,lookups,r);
+      break;
+    }
+    deletedisk(stem);
+
+    if (rc) {
+      cerr << "staticbench: "<<name<<" failed, error "<<rc<<"\n";
+      return -1;
+    }
+
+    cout << setw(20) << name << fixed << setprecision(1)
+	 << setw(12) << r.insertns << setw(12) << r.lookupns
+	 << setw(10) << r.lookupreads << "\n";
+  }
+
+  return 0;
+}
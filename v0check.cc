@@ -0,0 +1,295 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "btree.h"
+#include "benchutil.h"
+
+using namespace std;
+
+
+void usage()
+{
+  cerr << "usage: v0check filestem [numkeys]\n";
+  cerr << "       writes a btree of 8 byte keys and 4 byte values on 512 byte\n";
+  cerr << "       blocks in format 0, laid out as btree_init and btree_insert did\n";
+  cerr << "       before nodes recorded a format: 28 byte headers, 32 bit\n";
+  cerr << "       pointers and a chain of free blocks.  Then attaches it, looks\n";
+  cerr << "       up and inserts keys, and checks that what is left is still a\n";
+  cerr << "       format 0 image whose free chain and btree account for every\n";
+  cerr << "       block.  filestem is made and deleted.  numkeys defaults to 300,\n";
+  cerr << "       and is from 21 to 800, so the root has 2 to 40 leaves.  Exits\n";
+  cerr << "       nonzero if any check fails.\n";
+}
+
+
+// The header every block had before the format word, which is what
+// the rest of this writes and reads
+struct OldHeader {
+  int nodetype;
+  unsigned int keysize;
+  unsigned int valuesize;
+  unsigned int blocksize;
+  unsigned int rootnode;
+  unsigned int freelist;
+  unsigned int numkeys;
+};
+
+static const SIZE_T keysize=8, valuesize=4, blocksize=512, blockspertrack=16;
+static const SIZE_T numblocks=1024, perleaf=20;
+
+
+static void MakeKey(const unsigned long long k, KEY_T &key)
+{
+  key.Resize(8,false);
+  for (SIZE_T j=0;j<8;j++) {
+    key.data[j]=(BYTE_T)(k>>(56-8*j));
+  }
+}
+
+
+static ERROR_T WriteOld(BufferCache &cache, const BLOCKNUM_T n, const int type,
+			const unsigned int freelist, const unsigned int numkeys,
+			const BYTE_T *data=0, const SIZE_T len=0)
+{
+  Block block(blocksize);
+  OldHeader h;
+
+  h.nodetype=type;
+  h.keysize=keysize;
+  h.valuesize=valuesize;
+  h.blocksize=blocksize;
+  h.rootnode=1;
+  h.freelist=freelist;
+  h.numkeys=numkeys;
+  memset(block.data,0,blocksize);
+  memcpy(block.data,&h,sizeof(h));
+  if (len) {
+    memcpy(block.data+sizeof(h),data,len);
+  }
+  return cache.WriteBlock(n,block);
+}
+
+
+// Superblock at 0, root at 1 and every other block free and chained
+// in order, as btree_init left it.  Then the keys, in leaves taken off
+// the chain one after another and each perleaf keys long, under the
+// root with the last key of each leaf but the last as separators, as
+// btree_insert would have split them.  A key equal to a separator is
+// to its left.
+static ERROR_T MakeOldImage(BufferCache &cache, const vector<unsigned long long> &keys)
+{
+  SIZE_T numleaves=(keys.size()+perleaf-1)/perleaf;
+  SIZE_T stride=sizeof(unsigned int)+keysize;
+  BYTE_T root[blocksize], leaf[blocksize];
+  KEY_T key;
+  ERROR_T rc;
+
+  for (BLOCKNUM_T i=2;i<numblocks;i++) {
+    if ((rc=WriteOld(cache,i,BTREE_UNALLOCATED_BLOCK,i+1==numblocks ? 0 : i+1,0))) {
+      return rc;
+    }
+  }
+
+  // PTR KEY PTR KEY ... PTR
+  memset(root,0,sizeof(root));
+  for (SIZE_T l=0;l<numleaves;l++) {
+    unsigned int ptr=2+l;
+    SIZE_T first=l*perleaf, n=0;
+    SIZE_T len=sizeof(unsigned int);
+
+    // PTR KEY VALUE KEY VALUE ..., with the pointer not used
+    memset(leaf,0,sizeof(leaf));
+    for (SIZE_T i=first;i<keys.size() && i<first+perleaf;i++, n++) {
+      unsigned int value=i;
+      MakeKey(keys[i],key);
+      memcpy(leaf+len,key.data,keysize);
+      memcpy(leaf+len+keysize,&value,valuesize);
+      len+=keysize+valuesize;
+    }
+    if ((rc=WriteOld(cache,ptr,BTREE_LEAF_NODE,0,n,leaf,len))) {
+      return rc;
+    }
+
+    memcpy(root+l*stride,&ptr,sizeof(ptr));
+    if (l+1<numleaves) {
+      MakeKey(keys[first+n-1],key);
+      memcpy(root+l*stride+sizeof(ptr),key.data,keysize);
+    }
+  }
+
+  if ((rc=WriteOld(cache,1,BTREE_ROOT_NODE,2,numleaves-1,root,(numleaves-1)*stride+sizeof(unsigned int)))) {
+    return rc;
+  }
+  return WriteOld(cache,0,BTREE_SUPERBLOCK,2+numleaves<numblocks ? 2+numleaves : 0,0);
+}
+
+
+// Every key is there, with its index as its value
+static bool Check(BTreeIndex &btree, const vector<unsigned long long> &keys, const char *when)
+{
+  KEY_T key;
+  VALUE_T value;
+  ERROR_T rc;
+
+  if ((rc=btree.SanityCheck())) {
+    cerr << "v0check: btree is not sane "<<when<<", error "<<rc<<"\n";
+    return false;
+  }
+  for (SIZE_T i=0;i<keys.size();i++) {
+    unsigned int v=0;
+    MakeKey(keys[i],key);
+    rc=btree.Lookup(key,value);
+    if (!rc) {
+      memcpy(&v,value.data,valuesize);
+    }
+    if (rc || value.length!=valuesize || v!=i) {
+      cerr << "v0check: key "<<keys[i]<<" not found "<<when<<", error "<<rc<<"\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// The superblock has no format word, and the blocks on the free chain
+// and those in the btree are all the blocks there are
+static bool CheckOldImage(BufferCache &cache)
+{
+  Block block;
+  OldHeader h;
+  TreeShape shape;
+  vector<bool> seen(numblocks,false);
+  SIZE_T numfree=0;
+  unsigned int rootnode;
+  ERROR_T rc;
+
+  if ((rc=cache.ReadBlock(0,block))) {
+    cerr << "v0check: cannot read the superblock, error "<<rc<<"\n";
+    return false;
+  }
+  memcpy(&h,block.data,sizeof(h));
+  if (h.nodetype!=BTREE_SUPERBLOCK || h.keysize!=keysize || h.valuesize!=valuesize ||
+      h.blocksize!=blocksize) {
+    cerr << "v0check: the superblock is no longer in format 0\n";
+    return false;
+  }
+  rootnode=h.rootnode;
+
+  for (unsigned int n=h.freelist; n!=0; n=h.freelist, numfree++) {
+    if (n>=numblocks || seen[n]) {
+      cerr << "v0check: the free chain is broken at block "<<n<<"\n";
+      return false;
+    }
+    seen[n]=true;
+    if ((rc=cache.ReadBlock(n,block))) {
+      cerr << "v0check: cannot read free block "<<n<<", error "<<rc<<"\n";
+      return false;
+    }
+    memcpy(&h,block.data,sizeof(h));
+    if (h.nodetype!=BTREE_UNALLOCATED_BLOCK) {
+      cerr << "v0check: block "<<n<<" on the free chain is in use\n";
+      return false;
+    }
+  }
+
+  if ((rc=WalkTree(&cache,rootnode,1,shape))) {
+    cerr << "v0check: cannot walk the btree, error "<<rc<<"\n";
+    return false;
+  }
+  if (1+shape.leaves+shape.interiors+numfree!=numblocks) {
+    cerr << "v0check: "<<shape.leaves+shape.interiors<<" nodes and "<<numfree
+	 <<" free blocks do not add up to "<<numblocks-1<<"\n";
+    return false;
+  }
+  return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc<2 || argc>3) {
+    usage();
+    exit(-1);
+  }
+
+  string stem(argv[1]);
+  SIZE_T numkeys = argc>=3 ? atoi(argv[2]) : 300;
+  bool ok;
+
+  if (numkeys<=perleaf || numkeys>40*perleaf) {
+    usage();
+    exit(-1);
+  }
+
+  // the image gets the even keys, the inserts the odd ones between
+  vector<unsigned long long> keys(numkeys), all;
+  for (SIZE_T i=0;i<numkeys;i++) {
+    keys[i]=2*i+2;
+  }
+  all=keys;
+  for (SIZE_T i=0;i<numkeys;i++) {
+    all.push_back(2*i+1);
+  }
+
+  deletedisk(stem);
+  {
+    DiskSystem disk(stem,true,0,numblocks,blocksize,1,blockspertrack,
+		    numblocks/blockspertrack,1,1,1);
+    BufferCache cache(&disk,64);
+    BLOCKNUM_T superblock;
+    ERROR_T rc;
+
+    cache.Attach();
+    if ((rc=MakeOldImage(cache,keys))) {
+      cerr << "v0check: cannot write the image, error "<<rc<<"\n";
+      return -1;
+    }
+
+    {
+      BTreeIndex btree(keysize,valuesize,&cache);
+      KEY_T key;
+      VALUE_T value;
+
+      if ((rc=btree.Attach(0,false))) {
+	cerr << "v0check: cannot attach, error "<<rc<<"\n";
+	return -1;
+      }
+      ok = Check(btree,keys,"after attaching");
+
+      value.Resize(valuesize,false);
+      for (SIZE_T i=numkeys;ok && i<all.size();i++) {
+	unsigned int v=i;
+	MakeKey(all[i],key);
+	memcpy(value.data,&v,valuesize);
+	if ((rc=btree.Insert(key,value))) {
+	  cerr << "v0check: insert failed, error "<<rc<<"\n";
+	  ok=false;
+	}
+      }
+      btree.Detach(superblock);
+    }
+
+    ok = ok && CheckOldImage(cache);
+
+    // attached again, every key is still there
+    if (ok) {
+      BTreeIndex btree(keysize,valuesize,&cache);
+
+      if ((rc=btree.Attach(0,false))) {
+	cerr << "v0check: cannot attach again, error "<<rc<<"\n";
+	return -1;
+      }
+      ok = Check(btree,all,"after inserting");
+      btree.Detach(superblock);
+    }
+    cache.Detach();
+  }
+  deletedisk(stem);
+
+  cout << "format 0 image of "<<numkeys<<" keys: "<<(ok ? "ok" : "FAILED")<<"\n";
+  return ok ? 0 : -1;
+}
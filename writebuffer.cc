@@ -16,7 +16,7 @@ int main(int argc, char *argv[])
     exit(-1);
   }
   SIZE_T cachesize=atoi(argv[2]);
-  SIZE_T blocknum=atoi(argv[3]);
+  BLOCKNUM_T blocknum=strtoull(argv[3],0,0);
   SIZE_T numblocks=atoi(argv[4]);
 
   DiskSystem disk(argv[1]);
@@ -26,7 +26,7 @@ int main(int argc, char *argv[])
 
   cache.Attach();
 
-  for (unsigned i=blocknum;i<(blocknum+numblocks);i++) { 
+  for (BLOCKNUM_T i=blocknum;i<(blocknum+numblocks);i++) { 
     Block block(blocksize);
     ERROR_T rc;
     for (unsigned j=0;j<blocksize;j++) { 
@@ -57,6 +57,7 @@ int main(int argc, char *argv[])
   cerr << endl;
 
   cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+  disk.PrintStats(cerr);
 
   return 0;
 }